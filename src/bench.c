@@ -0,0 +1,188 @@
+/* bench.c
+ * Time the editor and the browser on large inputs, through the same
+ * functions and commands that edbrowse runs.
+ * make bench, then ./bench [-r reps] [lines ...] [page ...]
+ * A numeric argument is the size of a generated file, in lines,
+ * default 1000000. Anything else is a local html page to browse,
+ * default ../doc/usersguide.html and acid3, run from the src directory.
+ * Results are csv on stdout, test,op,input,size,ms,
+ * everything else edbrowse would print is thrown away.
+ * Save the output before and after a change and compare.
+ * main.c is compiled into bench-main.o with main renamed,
+ * for its globals and functions. The setup is done as main does it:
+ * setupEdbrowse, the config file, the javascript runtime,
+ * and the init function, so pages load as they would in edbrowse.
+ * This file is part of the edbrowse project, released under GPL.
+ */
+
+#include "eb.h"
+
+static FILE *out;
+
+static void report(const char *test, const char *op, const char *input,
+		   long long size, double ms)
+{
+	fprintf(out, "%s,%s,%s,%lld,%.3f\n", test, op, input, size, ms);
+	fflush(out);
+}
+
+static void fail(const char *what)
+{
+	fprintf(stderr, "bench: %s: %s\n", what,
+		(errorMsg[0] ? errorMsg : "failed"));
+	exit(1);
+}
+
+/* run an edbrowse command as a script would, and time it */
+static void timeCommand(const char *op, const char *line, int lines)
+{
+	double t0 = secondsNow();
+	if (!edbrowseCommand(line, true))
+		fail(line);
+	report("buffer", op, "generated", lines,
+	       (secondsNow() - t0) * 1000.0);
+}
+
+/* a fresh session 1, with nothing in it */
+static void freshSession(void)
+{
+	if (cw)
+		cxQuit(context, 3);
+	cxSwitch(1, false);
+}
+
+static void bufferTests(int lines)
+{
+	static const char fmt[] =
+	    "the quick brown fox jumps over the lazy dog %d\n";
+	char *text;
+	int i, len = 0;
+	double t0;
+
+	text = allocMem((sizeof(fmt) + 12) * (size_t)lines + 1);
+	for (i = 1; i <= lines; ++i)
+		len += sprintf(text + len, fmt, i);
+
+	freshSession();
+	t0 = secondsNow();
+	if (!addTextToBuffer((pst) text, len, 0, false))
+		fail("addTextToBuffer");
+	report("buffer", "addTextToBuffer", "generated", lines,
+	       (secondsNow() - t0) * 1000.0);
+	free(text);
+
+	timeCommand("substituteText", ",s/quick/slow/", lines);
+/* one line in ten, doGlobal marks them all and then visits each */
+	timeCommand("doGlobal", "g/9$/s/fox/cat/", lines);
+/* undoCompare runs at the start of the next change,
+ * and sorts out which of the old lines can be freed. */
+	timeCommand("undoCompare", "1d", lines);
+
+	t0 = secondsNow();
+	delText(1, cw->dol);
+	report("buffer", "delText", "generated", lines,
+	       (secondsNow() - t0) * 1000.0);
+	cw->changeMode = false;
+}				/* bufferTests */
+
+/*********************************************************************
+Browse a page, reps times, and report the best time for each phase,
+from the profile that the b command leaves on the window.
+parse is html into tags, tidy or native, and render is the text.
+css is only applied by the javascript engine, so it doesn't show up
+on pages without scripts, or if js is off.
+*********************************************************************/
+
+static void pageTests(const char *page, int reps)
+{
+	struct PROFILE best;
+	const struct PROFILE *p;
+	char *cmd;
+	off_t size = fileSizeByName(page);
+	int i, r;
+
+	if (size < 0)
+		fail(page);
+	cmd = allocMem(strlen(page) + 3);
+	sprintf(cmd, "b %s", page);
+	memset(&best, 0, sizeof(best));
+
+	for (r = 0; r < reps; ++r) {
+		freshSession();
+		if (!edbrowseCommand(cmd, true))
+			fail(cmd);
+		if (!(p = cw->prof))
+			fail(cmd);
+		if (!r || p->load < best.load)
+			best.load = p->load;
+		for (i = 0; i < PROF_PHASES; ++i) {
+			if (!r || p->ms[i] < best.ms[i])
+				best.ms[i] = p->ms[i];
+			best.calls[i] = p->calls[i];
+		}
+	}
+
+	report("page", "load", page, size, best.load);
+	for (i = 0; i < PROF_PHASES; ++i)
+		if (best.calls[i])
+			report("page", profNames[i], page, size, best.ms[i]);
+	nzFree(cmd);
+}				/* pageTests */
+
+int main(int argc, char **argv)
+{
+	static const char *defpages[] = { "../doc/usersguide.html", "acid3" };
+	int reps = 5, nsizes = 0, npages = 0, i, fd;
+	int *sizes;
+	const char **pages;
+
+	++argv, --argc;
+	if (argc >= 2 && stringEqual(argv[0], "-r")) {
+		reps = atoi(argv[1]);
+		argv += 2, argc -= 2;
+	}
+	if (reps <= 0) {
+		fprintf(stderr, "usage: bench [-r reps] [lines ...] [page ...]\n");
+		exit(1);
+	}
+	sizes = allocMem((argc + 1) * sizeof(int));
+	pages = allocMem((argc + 2) * sizeof(char *));
+	for (i = 0; i < argc; ++i) {
+		if (isdigitByte(argv[i][0]))
+			sizes[nsizes++] = atoi(argv[i]);
+		else
+			pages[npages++] = argv[i];
+	}
+	if (!nsizes && !npages) {
+		sizes[nsizes++] = 1000000;
+		pages[npages++] = defpages[0];
+		pages[npages++] = defpages[1];
+	}
+
+/* results on the real stdout, edbrowse chatter to /dev/null */
+	fflush(stdout);
+	out = fdopen(dup(1), "w");
+	fd = open("/dev/null", O_WRONLY);
+	if (!out || fd < 0) {
+		fprintf(stderr, "bench: cannot redirect stdout\n");
+		exit(1);
+	}
+	dup2(fd, 1);
+	close(fd);
+
+	setupEdbrowse();
+	readConfigFile();
+	js_main();
+	cxSwitch(1, false);
+	runEbFunction("init");
+
+	fprintf(out, "test,op,input,size,ms\n");
+	for (i = 0; i < nsizes; ++i)
+		if (sizes[i] > 0)
+			bufferTests(sizes[i]);
+	for (i = 0; i < npages; ++i)
+		pageTests(pages[i], reps);
+
+	fclose(out);
+	return 0;
+}
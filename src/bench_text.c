@@ -0,0 +1,190 @@
+/* bench_text.c
+ * Time the text classifiers, converters, and base64 and quoted printable
+ * codecs in format.c on large generated inputs.
+ * make bench_text, then ./bench_text [megabytes]
+ * Default is 256 megabytes per input.
+ * This file is part of the edbrowse project, released under GPL.
+ */
+
+#include "eb.h"
+
+// stubs needed by other edbrowse functions that we are pulling in.
+int context;
+struct ebWindow *cw;
+struct ebSession sessionList[2];
+bool cxCompare(int cx) { return false; }
+bool cxActive(int cx) { return false; }
+bool cxQuit(int cx, int action) { return true; }
+void cxSwitch(int cx, bool interactive) {}
+bool browseCurrentBuffer(void) { return false; }
+int sideBuffer(int cx, const char *text, int textlen, const char *bufname){ return 0; }
+struct MACCOUNT accounts[MAXACCOUNT];
+int maxAccount;
+void preFormatCheck(int tagno, bool * pretag, bool * slash) {}
+void profStart(int phase) {}
+void profEnd(int phase) {}
+bool isDataURI(const char *u){ return false; }
+void unpercentString(char *s) {}
+void ebClose(int n) { exit(n); }
+
+/* Fill with lines of text, and every so often a nonascii character,
+ * in the style of the input: a ascii, i iso8859, u utf8, b binary. */
+static void fill(uchar *buf, int len, char style)
+{
+	static const char words[] = "the quick brown fox jumps over the lazy dog ";
+	unsigned seed = 17;
+	int i, w = 0;
+
+	for (i = 0; i < len; ++i) {
+		seed = seed * 1103515245 + 12345;
+		if (style == 'b') {
+			buf[i] = seed >> 16;
+			continue;
+		}
+		if (i % 72 == 71) {
+			buf[i] = '\n';
+			continue;
+		}
+		if (style != 'a' && (seed >> 16) % 200 == 0) {
+			if (style == 'i' || i + 1 == len) {
+				buf[i] = 0xe9;
+				continue;
+			}
+			buf[i++] = 0xc3;
+			buf[i] = 0xa9;
+			continue;
+		}
+		buf[i] = words[w++];
+		if (!words[w])
+			w = 0;
+	}
+}
+
+/* Quoted printable version of buf, for qpDecode to chew on */
+static char *qpMake(const uchar *buf, int len, int *qp_l)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	char *qp = allocMem(len * 3 + len / 24 + 2);
+	int i, l = 0, colno = 0;
+
+	for (i = 0; i < len; ++i) {
+		uchar c = buf[i];
+		if (c == '\n' && colno) {
+			qp[l++] = c;
+			colno = 0;
+			continue;
+		}
+		if (c < ' ' || c >= 0x7f || c == '=') {
+			qp[l++] = '=';
+			qp[l++] = hex[c >> 4];
+			qp[l++] = hex[c & 15];
+			colno += 3;
+		} else {
+			qp[l++] = c;
+			++colno;
+		}
+		if (colno >= 72) {
+			qp[l++] = '=';
+			qp[l++] = '\n';
+			colno = 0;
+		}
+	}
+	qp[l] = 0;
+	*qp_l = l;
+	return qp;
+}				/* qpMake */
+
+static void report(const char *what, char style, int mb, double secs)
+{
+	printf("%s %c %d MB %.3f s %.0f MB/s\n", what, style, mb, secs,
+	       mb / secs);
+}
+
+int main(int argc, char **argv)
+{
+	static const char styles[] = "aiub";
+	int mb = 256, len, k;
+	uchar *buf, *out;
+	char *wide, *narrow, *b64, *b64_end;
+	int out_l, wide_l, narrow_l, used, rc;
+	bool bin, iso, utf8;
+	double t0;
+
+	if (argc > 1)
+		mb = atoi(argv[1]);
+	if (mb <= 0 || mb > 2000) {
+		fprintf(stderr, "usage: bench_text [megabytes]\n");
+		exit(1);
+	}
+	len = mb * 1024 * 1024;
+	buf = allocMem(len + 1);
+
+	for (k = 0; styles[k]; ++k) {
+		fill(buf, len, styles[k]);
+		buf[len] = 0;
+
+		t0 = secondsNow();
+		bin = looksBinary(buf, len);
+		report("looksBinary", styles[k], mb, secondsNow() - t0);
+
+		t0 = secondsNow();
+		looks_8859_utf8(buf, len, &iso, &utf8);
+		report("looks_8859_utf8", styles[k], mb, secondsNow() - t0);
+
+		t0 = secondsNow();
+		textClassify(buf, len, &bin, &iso, &utf8);
+		report("textClassify", styles[k], mb, secondsNow() - t0);
+		printf("%c: binary %d iso8859 %d utf8 %d\n", styles[k], bin,
+		       iso, utf8);
+
+		t0 = secondsNow();
+		b64 = base64Encode((char *)buf, len, true);
+		report("base64Encode", styles[k], mb, secondsNow() - t0);
+		b64_end = b64 + strlen(b64);
+		t0 = secondsNow();
+		rc = base64Decode(b64, &b64_end);
+		report("base64Decode", styles[k], mb, secondsNow() - t0);
+		if (rc != GOOD_BASE64_DECODE || b64_end - b64 != len
+		    || memcmp(b64, buf, len))
+			printf("%c: base64 round trip failed\n", styles[k]);
+		nzFree(b64);
+
+		b64 = qpMake(buf, len, &out_l);
+		t0 = secondsNow();
+		b64_end = qpDecode(b64, b64 + out_l);
+		report("qpDecode", styles[k], mb, secondsNow() - t0);
+/* nulls come back as spaces, so binary data won't match */
+		if (!memchr(buf, 0, len) &&
+		    (b64_end - b64 != len || memcmp(b64, buf, len)))
+			printf("%c: qp round trip failed\n", styles[k]);
+		nzFree(b64);
+
+		if (bin)
+			continue;
+
+		t0 = secondsNow();
+		if (utf8)
+			utf2iso(buf, len, &out, &out_l);
+		else
+			iso2utf(buf, len, &out, &out_l);
+		report((utf8 ? "utf2iso" : "iso2utf"), styles[k], mb,
+		       secondsNow() - t0);
+		nzFree(out);
+
+		cons_utf8 = utf8;
+		t0 = secondsNow();
+		utfHigh((char *)buf, len, &wide, &wide_l, utf8, false, false);
+		report("utfHigh", styles[k], mb, secondsNow() - t0);
+		narrow = allocMem(wide_l * 2 + 1);
+		t0 = secondsNow();
+		narrow_l = utfLowChunk(wide, wide_l, narrow, &used, true, 1);
+		report("utfLow", styles[k], mb, secondsNow() - t0);
+		if (narrow_l != len || memcmp(narrow, buf, len))
+			printf("%c: utf16 round trip failed\n", styles[k]);
+		nzFree(wide);
+		nzFree(narrow);
+	}
+
+	free(buf);
+	return 0;
+}
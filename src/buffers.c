@@ -7,6 +7,8 @@
 
 #ifndef DOSLIKE
 #include <sys/select.h>
+#include <sys/uio.h>
+#include <limits.h>
 #endif
 
 /* If this include file is missing, you need the pcre package,
@@ -164,6 +166,7 @@ static pst fetchLineContext(int n, int show, int cx)
 	struct lineMap *map, *t;
 	int dol;
 	pst p;			/* the resulting copy of the string */
+	unsigned len;
 
 	if (!lw)
 		i_printfExit(MSG_InvalidSession, cx);
@@ -175,7 +178,9 @@ static pst fetchLineContext(int n, int show, int cx)
 	t = map + n;
 	if (show < 0)
 		return t->text;
-	p = clonePstring(t->text);
+	len = lineLength(t);
+	p = (pst) allocMem(len);
+	memcpy(p, t->text, len);
 	if (show && lw->browseMode)
 		removeHiddenNumbers(p, '\n');
 	return p;
@@ -186,6 +191,24 @@ pst fetchLine(int n, int show)
 	return fetchLineContext(n, show, context);
 }				/* fetchLine */
 
+/* Line n of session cx, to go into another buffer, as fetchLine(n, 1) would
+ * give it, but the text is shared, not copied, unless hidden numbers
+ * have to come out of a browsed line. */
+static pst shareLineContext(int n, int cx, int *len_p)
+{
+	struct ebWindow *lw = sessionList[cx].lw;
+	struct lineMap *t = lw->map + n;
+	pst p;
+
+	*len_p = lineLength(t);
+	if (!lw->browseMode)
+		return shareLine(t->text);
+	p = cloneLine(t->text, *len_p);
+	removeHiddenNumbers(p, '\n');
+	*len_p = pstLength(p);
+	return p;
+}				/* shareLineContext */
+
 static int apparentSizeW(const struct ebWindow *w, bool browsing)
 {
 	int ln, size = 0;
@@ -193,6 +216,10 @@ static int apparentSizeW(const struct ebWindow *w, bool browsing)
 	if (!w)
 		return -1;
 	for (ln = 1; ln <= w->dol; ++ln) {
+		if (!(browsing && w->browseMode)) {
+			size += lineLength(w->map + ln);
+			continue;
+		}
 		p = w->map[ln].text;
 		while (*p != '\n') {
 			if (*p == InternalCodeChar && browsing && w->browseMode) {
@@ -737,7 +764,7 @@ static void freeLine(struct lineMap *t)
 			printf("free ");
 		print_pst(t->text);
 	}
-	nzFree(t->text);
+	releaseLine(t->text);
 }				/* freeLine */
 
 static void freeWindowLines(struct lineMap *map)
@@ -756,6 +783,19 @@ static void freeWindowLines(struct lineMap *map)
 	debugPrint(6, "freeWindowLines = %d", cnt);
 }				/* freeWindowLines */
 
+/* In directory mode, r_map holds the ls stats for each file,
+ * as ordinary strings, not lines. */
+static void freeDirStats(struct lineMap *map)
+{
+	struct lineMap *t;
+
+	if ((t = map)) {
+		for (++t; t->text; ++t)
+			nzFree(t->text);
+		free(map);
+	}
+}				/* freeDirStats */
+
 /*********************************************************************
 Garbage collection for text lines.
 There is an undo window that holds a snapshot of the buffer as it was before.
@@ -784,6 +824,11 @@ Return, and the calling function makes its change.
 But we call undoCompare at other times, like switching buffers,
 pop the window stack, browse, or quit.
 These make undo impossible, so free the lines in the undo window.
+Lines are reference counted, see allocLine in stringfile.c.
+Each line in cw->map holds a reference, and the undo map holds
+one more for each copy of a line that is no longer in cw->map.
+So comm -23 has to count duplicates, in case t or r has put
+the same line in the buffer twice, and it does.
 *********************************************************************/
 
 static bool madeChanges;
@@ -864,6 +909,7 @@ static void undoPush(void)
 /* if in browse mode, we really shouldn't be here at all!
  * But we could if substituting on an input field, since substitute is also
  * a regular ed command. */
+	cw->diskMode = false;
 	if (cw->browseMode)
 		return;
 
@@ -912,12 +958,16 @@ static void freeWindow(struct ebWindow *w)
 		free(label);
 	}
 	freeWindowLines(w->map);
-	freeWindowLines(w->r_map);
+	if (w->dirMode)
+		freeDirStats(w->r_map);
+	else
+		freeWindowLines(w->r_map);
 	nzFree(w->htmltitle);
 	nzFree(w->htmldesc);
 	nzFree(w->htmlkey);
 	nzFree(w->saveURL);
 	nzFree(w->mailInfo);
+	nzFree(w->prof);
 	nzFree(w->referrer);
 	nzFree(w->baseDirName);
 	free(w);
@@ -1155,11 +1205,13 @@ bool addTextToBuffer(const pst inbuf, int length, int destl, bool showtrail)
 				break;
 		if (inbuf[i - 1] == '\n') {
 /* normal line */
-			t->text = allocMem(i - j);
+			t->text = allocLine(i - j);
+			t->len = i - j;
 		} else {
 /* last line with no nl */
-			t->text = allocMem(i - j + 1);
+			t->text = allocLine(i - j + 1);
 			t->text[i - j] = '\n';
+			t->len = i - j + 1;
 		}
 		memcpy(t->text, inbuf + j, i - j);
 		++t;
@@ -1196,8 +1248,9 @@ static bool inputLinesIntoBuffer(void)
 			np = reallocMem(np, cap * LMSIZE);
 			t = np + linecount;
 		}
-		t->text = clonePstring(line);
+		t->text = cloneLine(line, pstLength(line));
 		t->ds1 = t->ds2 = 0;
+		t->len = 0;
 		++t, ++linecount;
 		line = inputLine();
 	}
@@ -1295,7 +1348,7 @@ void delText(int start, int end)
 /* browse has no undo command */
 	if (cw->browseMode) {
 		for (ln = start; ln <= end; ++ln)
-			nzFree(cw->map[ln].text);
+			releaseLine(cw->map[ln].text);
 	} else {
 		undoPush();
 	}
@@ -1474,13 +1527,48 @@ gone:
 	return true;
 }				/* delFiles */
 
+static char ls_sort;		// sort method for directory listing
+static bool ls_reverse;		// reverse sort
+
+/* Where a file belongs in the current directory buffer,
+ * the line to put it after, found by binary search,
+ * so we don't have to sort the directory again.
+ * This uses the sort that was in effect when the directory was read,
+ * not the one in effect now.
+ * If the listing is sorted by size or time, or we don't know how it is sorted,
+ * the file just goes on the end. */
+static int dirInsertPoint(const char *file)
+{
+	int lo = 0, hi = cw->dol, mid, l, rc;
+	char name[ABSPATH];
+	const char *t;
+
+	if (!cw->dirSorted || cw->dirSort)
+		return cw->dol;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		t = (const char *)cw->map[mid].text;
+		for (l = 0; t[l] != '\n' && l < ABSPATH - 1; ++l)
+			name[l] = t[l];
+		name[l] = 0;
+		rc = dirNameCompare(name, file);
+		if (cw->dirReverse)
+			rc = -rc;
+		if (rc <= 0)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}				/* dirInsertPoint */
+
 // Move or copy files from one directory to another
 static bool moveFiles(void)
 {
 	struct ebWindow *cw1 = cw;
 	struct ebWindow *cw2 = sessionList[destLine].lw;
 	char *path1, *path2;
-	int ln, cnt, dol;
+	int ln, cnt, dol, at;
 
 	if (!dirWrite) {
 		setError(MSG_DirNoWrite);
@@ -1596,22 +1684,25 @@ moved:
 		free(path1);
 		if(icmd == 'm')
 			delText(ln, ln);
-// add it to the other directory
-*t++ = '\n';
+// add it to the other directory, in its place
 		cw = cw2;
 		dol = cw->dol;
-		addTextToBuffer((pst)file, t-file, dol, false);
+		at = dirInsertPoint(file);
+*t++ = '\n';
+		addTextToBuffer((pst)file, t-file, at, false);
 		free(file);
-		cw->dot = ++dol;
-		cw->map[dol].ds1 = ftype[0];
+		cw->dot = ++at;
+		cw->map[at].ds1 = ftype[0];
 		if(ftype[0])
-			cw->map[dol].ds2 = ftype[1];
+			cw->map[at].ds2 = ftype[1];
 // if attributes were displayed in that directory - more work to do.
 // I just leave a space for them; I don't try to derive them.
 		if(cw->r_map) {
-			cw->r_map = reallocMem(cw->r_map, LMSIZE * (dol + 2));
-			memset(cw->r_map + dol, 0, LMSIZE*2);
-			cw->r_map[dol].text = (uchar*)emptyString;
+			cw->r_map = reallocMem(cw->r_map, LMSIZE * (dol + 3));
+			memmove(cw->r_map + at + 1, cw->r_map + at,
+			LMSIZE * (dol + 2 - at));
+			memset(cw->r_map + at, 0, LMSIZE);
+			cw->r_map[at].text = (uchar*)emptyString;
 		}
 		cw = cw1; // put it back
 	}
@@ -1649,8 +1740,10 @@ static bool moveCopy(void)
 
 	if (cmd == 't') {
 		newpiece = t = allocZeroMem(n_lines * LMSIZE);
-		for (i = sr; i < er; ++i, ++t)
-			t->text = fetchLine(i, 0);
+		for (i = sr; i < er; ++i, ++t) {
+			t->text = shareLine(cw->map[i].text);
+			t->len = cw->map[i].len;
+		}
 		addToMap(n_lines, destLine);
 		return true;
 	}
@@ -1713,11 +1806,11 @@ static bool joinText(void)
 
 	size = 0;
 	for (j = startRange; j <= endRange; ++j)
-		size += pstLength(fetchLine(j, -1));
-	t = newline = allocMem(size);
+		size += lineLength(cw->map + j);
+	t = newline = allocLine(size);
 	for (j = startRange; j <= endRange; ++j) {
 		pst p = fetchLine(j, -1);
-		size = pstLength(p);
+		size = lineLength(cw->map + j);
 		memcpy(t, p, size);
 		t += size;
 		if (j < endRange) {
@@ -1731,6 +1824,7 @@ static bool joinText(void)
 
 	newpiece = allocZeroMem(LMSIZE);
 	newpiece->text = newline;
+	newpiece->len = t - newline;
 	addToMap(1, startRange - 1);
 
 	cw->dot = startRange;
@@ -1751,8 +1845,6 @@ struct DSR {
 };
 static struct DSR *dsr_list;
 extern struct stat this_stat;
-static char ls_sort;		// sort method for directory listing
-static bool ls_reverse;		// reverse sort
 static char lsformat[12];	/* size date etc on a directory listing */
 
 /* compare routine for quicksort directory scan */
@@ -1797,10 +1889,13 @@ static int dircmp(const void *s, const void *t)
 /* Read the contents of a directory into the current buffer */
 static bool readDirectory(const char *filename)
 {
-	int len, j, linecount;
+	int len, j, k, linecount;
 	char *v;
 	struct lineMap *mptr;
 	struct lineMap *backpiece = 0;
+	struct FILESTAT *stats, *fs;
+	const char **paths;
+	bool needstat;
 
 	cw->baseDirName = cloneString(filename);
 /* get rid of trailing slash */
@@ -1818,6 +1913,13 @@ static bool readDirectory(const char *filename)
 		i_puts(MSG_DirMode);
 		if (lsformat[0])
 			backpiece = allocZeroMem(LMSIZE * (linecount + 2));
+/* remember how this listing is sorted, for dirInsertPoint */
+		cw->dirSort = ls_sort;
+		cw->dirReverse = ls_reverse;
+		cw->dirSorted = true;
+	} else {
+/* a second listing on the end, the buffer isn't in one order any more */
+		cw->dirSorted = false;
 	}
 
 	if (!linecount) {	/* empty directory */
@@ -1832,6 +1934,23 @@ static bool readDirectory(const char *filename)
 	if (ls_sort)
 		dsr_list = allocZeroMem(sizeof(struct DSR) * linecount);
 
+/* Stat the files up front, all at once, in parallel.
+ * We don't need to if readdir told us the file type,
+ * and that's all we want, no sizes or times or attributes. */
+	needstat = (ls_sort || lsformat[0]);
+	stats = allocMem(sizeof(struct FILESTAT) * linecount);
+	paths = allocMem(sizeof(char *) * linecount);
+	for (j = k = 0; j < linecount; ++j) {
+		if (!needstat && newpiece[j].ds1)
+			continue;
+		v = makeAbsPath((char *)newpiece[j].text);
+		paths[k++] = cloneString(v ? v : emptyString);
+	}
+	statFileList(paths, k, stats);
+	while (k)
+		nzFree((char *)paths[--k]);
+	free(paths);
+
 /* change 0 to nl and count bytes */
 	fileSize = 0;
 	mptr = newpiece;
@@ -1839,6 +1958,12 @@ static bool readDirectory(const char *filename)
 		char c, ftype;
 		pst t = mptr->text;
 		char *abspath = makeAbsPath((char *)t);
+		char known = mptr->ds1;	/* file type from readdir */
+
+		mptr->ds1 = 0;
+		fs = 0;
+		if (needstat || !known)
+			fs = stats + k++;
 
 // make sure this gets done.
 		if (backpiece)
@@ -1857,7 +1982,7 @@ static bool readDirectory(const char *filename)
 		if (!abspath)
 			continue;	/* should never happen */
 
-		ftype = fileTypeByName(abspath, true);
+		ftype = (fs ? fileTypeByStat(fs, true) : known);
 		if (!ftype)
 			continue;
 		if (isupperByte(ftype)) {	/* symbolic link */
@@ -1916,7 +2041,7 @@ static bool readDirectory(const char *filename)
 		} else {
 /* have to realloc at this point */
 			int l1 = t - mptr->text;
-			mptr->text = reallocMem(mptr->text, l1 + len + 3);
+			mptr->text = reallocLine(mptr->text, l1 + len + 3);
 			t = mptr->text + l1;
 			*t++ = ' ';
 			strcpy((char *)t, v);
@@ -1925,6 +2050,7 @@ static bool readDirectory(const char *filename)
 			*t = 0;
 		}
 	}			/* loop fixing files in the directory scan */
+	free(stats);
 
 	if (ls_sort) {
 		struct lineMap *tmp;
@@ -1967,9 +2093,14 @@ static bool readFile(const char *filename, const char *post, bool newwin,
 	bool fileprot = false;
 	char *nopound;
 	char filetype;
+	bool isbin, is8859, isutf8;
+	int filebom = 0;	// utf16 or utf32 file, converted as it was read
+	bool fromdisk = false, whole;	// a whole file, just as it is on disk
 
 	serverData = 0;
 	serverDataLen = 0;
+	if (newwin && !fromframe && cmd == 'b')
+		loadStamp(LOAD_START);
 
 	if (newwin) {
 		nzFree(cw->saveURL);
@@ -2022,11 +2153,22 @@ static bool readFile(const char *filename, const char *post, bool newwin,
 			g.uriEncoded = uriEncoded;
 		g.url = filename;
 		g.thisfile = fromthis;
+/* tokenize the page as it comes in, if we are going to browse it */
+		if (newwin && !fromframe && cmd == 'b' && nativeParser)
+			g.pipeline = true;
 		rc = httpConnect(&g);
 		serverData = g.buffer;
 		serverDataLen = g.length;
+		if (g.pipeline) {
+			if (rc)
+				pipelineEnd();
+			else
+				pipelineDrop();
+		}
 		if (!rc)
 			return false;
+		if (newwin && !fromframe)
+			loadStamp(LOAD_BODY);
 		changeFileName = g.cfn;	// allocated
 		if (newwin) {
 			cw->referrer = g.referrer;	// allocated
@@ -2199,14 +2341,22 @@ badfile:
 		rbuf = findHash(nopound);
 		if (rbuf && !filetype)
 			*rbuf = 0;
-		rc = fileIntoMemory(nopound, &rbuf, &fileSize);
+// utf16 and utf32 are converted as we read, in blocks,
+// rather than holding the whole file twice.
+		if (iuConvert && filetype == 'f')
+			filebom = utfLowFile(nopound, &rbuf, &fileSize);
+		rc = (filebom ? true :
+		      fileIntoMemory(nopound, &rbuf, &fileSize));
 		nzFree(nopound);
+		fromdisk = (filetype == 'f');
 	}
 
 	if (!rc)
 		goto badfile;
 	serverData = rbuf;
 	serverDataLen = fileSize;
+	if (newwin && !fromframe)
+		loadStamp(LOAD_BODY);
 	if (fileSize == 0) {	/* empty file */
 		if (!fromframe) {
 			cw->dot = endRange;
@@ -2217,8 +2367,10 @@ badfile:
 
 gotdata:
 
-	if (!looksBinary((uchar *) rbuf, fileSize)) {
-		char *tbuf;
+/* one pass to see if this is text, and what kind of text */
+	textClassify((uchar *) rbuf, fileSize, &isbin, &is8859, &isutf8);
+	if (!isbin) {
+		char *tbuf, *nl;
 		int i, j;
 		bool crlf_yes = false, crlf_no = false, dosmode = false;
 
@@ -2242,15 +2394,16 @@ gotdata:
 #else
 
 // convert in unix, only if each \n has \r preceeding.
-		if (iuConvert) {
-			for (i = 0; i < fileSize; ++i) {
-				char c = rbuf[i];
-				if (c != '\n')
-					continue;
-				if (i && rbuf[i - 1] == '\r')
+// A utf16 or utf32 file never matched this, as raw bytes, so leave it alone.
+		if (iuConvert && !filebom) {
+			for (nl = rbuf;
+			     (nl = memchr(nl, '\n', rbuf + fileSize - nl)); ++nl) {
+				if (nl > rbuf && nl[-1] == '\r')
 					crlf_yes = true;
 				else
 					crlf_no = true;
+				if (crlf_yes && crlf_no)
+					break;
 			}
 			if (crlf_yes && !crlf_no)
 				dosmode = true;
@@ -2273,9 +2426,10 @@ gotdata:
 #endif
 
 		if (iuConvert) {
-			bool is8859 = false, isutf8 = false;
 /* Classify this incoming text as ascii or 8859 or utf-x */
-			int bom = byteOrderMark((uchar *) rbuf, fileSize);
+			int bom = filebom;
+			if (!bom)
+				bom = byteOrderMark((uchar *) rbuf, fileSize);
 			if (bom) {
 				debugPrint(3, "text type is %s%s",
 					   ((bom & 4) ? "big " : ""),
@@ -2284,14 +2438,18 @@ gotdata:
 							&& !isURL(filename)))
 					i_puts(cons_utf8 ? MSG_ConvUtf8 :
 					       MSG_Conv8859);
-				utfLow(rbuf, fileSize, &tbuf, &fileSize, bom);
-				nzFree(rbuf);
-				rbuf = tbuf;
-				serverData = rbuf;
-				serverDataLen = fileSize;
+				if (!filebom) {
+					utfLow(rbuf, fileSize, &tbuf, &fileSize,
+					       bom);
+					nzFree(rbuf);
+					rbuf = tbuf;
+					serverData = rbuf;
+					serverDataLen = fileSize;
+				}
+// the classification above was of utf16 or utf32 bytes, it means nothing,
+// or of the converted text, which is not what the file holds.
+				is8859 = isutf8 = false;
 			} else {
-				looks_8859_utf8((uchar *) rbuf, fileSize,
-						&is8859, &isutf8);
 				debugPrint(3, "text type is %s",
 					   (isutf8 ? "utf8"
 					    : (is8859 ? "8859" : "ascii")));
@@ -2375,9 +2533,17 @@ gotdata:
 	}
 
 intext:
+	whole = (fromdisk && !cw->dol && cf->fileName &&
+		 stringEqual(filename, cf->fileName));
 	rc = addTextToBuffer((const pst)rbuf, fileSize, endRange,
 			     !isURL(filename));
 	nzFree(rbuf);
+/* The buffer is the file, until something changes; see browseCurrentBuffer */
+	if (rc && whole) {
+		cw->diskMode = true;
+		cw->diskTime = fileTimeByName(filename);
+		cw->diskSize = fileSizeByName(filename);
+	}
 	return rc;
 }				/* readFile */
 
@@ -2390,13 +2556,142 @@ bool readFileArgv(const char *filename, int fromframe)
 			(newwin ? 0 : cw->f0.fileName));
 }				/* readFileArgv */
 
-/* Write a range to a file. */
+/*********************************************************************
+Write a range to a file.
+Lines are not written one at a time; each line becomes a piece
+of an iovec, pointing right into the buffer where possible,
+and the pieces go out together through writev.
+Lines that must be converted, or decorated with a directory suffix,
+are built into one output buffer that is reused from batch to batch,
+and that buffer is just another piece of the iovec.
+*********************************************************************/
+
+#define WV_PIECES 512		// pieces per writev
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+#define WV_BYTES 65536		// size of the output buffer
+
+struct WRITEV {
+	int fd;
+	int n;			// number of pieces
+	struct iovec iov[WV_PIECES];
+	char *buf;		// converted or copied bytes
+	int buflen, bufmax;
+	char *hold[WV_PIECES];	// allocated lines, free after the write
+	int nhold;
+};
+
+static bool wvFlush(struct WRITEV *w)
+{
+	struct iovec *v = w->iov;
+	int n = w->n;
+	bool rc = true;
+
+	while (n) {
+#ifdef DOSLIKE
+		int rc1 = write(w->fd, v->iov_base, v->iov_len);
+#else
+		ssize_t rc1 = writev(w->fd, v, (n < IOV_MAX ? n : IOV_MAX));
+#endif
+		if (rc1 < 0) {
+			if (errno == EINTR)
+				continue;
+			rc = false;
+			break;
+		}
+/* step past what was written, which may end part way through a piece */
+		while (n && rc1 >= (ssize_t)v->iov_len) {
+			rc1 -= v->iov_len;
+			++v, --n;
+		}
+		if (n) {
+			v->iov_base = (char *)v->iov_base + rc1;
+			v->iov_len -= rc1;
+		}
+	}
+
+	while (w->nhold)
+		free(w->hold[--w->nhold]);
+	w->n = 0;
+	w->buflen = 0;
+	return rc;
+}				/* wvFlush */
+
+static bool wvPiece(struct WRITEV *w, const char *p, int len)
+{
+	struct iovec *v;
+	if (!len)
+		return true;
+	if (w->n) {
+		v = w->iov + w->n - 1;
+		if ((char *)v->iov_base + v->iov_len == p) {
+			v->iov_len += len;
+			return true;
+		}
+	}
+	v = w->iov + w->n++;
+	v->iov_base = (char *)p;
+	v->iov_len = len;
+/* Flush after the piece is in place, not before;
+ * a held line or the output buffer may be waiting on this piece. */
+	if (w->n == WV_PIECES)
+		return wvFlush(w);
+	return true;
+}				/* wvPiece */
+
+/* Room for len bytes at the end of the output buffer.
+ * The buffer can only grow when nothing points into it. */
+static char *wvRoom(struct WRITEV *w, int len)
+{
+	if (w->buflen + len <= w->bufmax)
+		return w->buf + w->buflen;
+	if (!wvFlush(w))
+		return 0;
+	if (len > w->bufmax) {
+		nzFree(w->buf);
+		w->bufmax = len + 256;
+		w->buf = allocMem(w->bufmax);
+	}
+	return w->buf;
+}				/* wvRoom */
+
+/* len bytes have been placed at wvRoom */
+static bool wvUsed(struct WRITEV *w, int len)
+{
+	char *p = w->buf + w->buflen;
+	w->buflen += len;
+	return wvPiece(w, p, len);
+}				/* wvUsed */
+
+static bool wvCopy(struct WRITEV *w, const char *p, int len)
+{
+	char *t = wvRoom(w, len);
+	if (!t)
+		return false;
+	memcpy(t, p, len);
+	return wvUsed(w, len);
+}				/* wvCopy */
+
+/* p was allocated; free it after it is written.
+ * Hold it before its pieces are queued. */
+static bool wvHold(struct WRITEV *w, char *p)
+{
+	if (w->nhold == WV_PIECES && !wvFlush(w)) {
+		free(p);
+		return false;
+	}
+	w->hold[w->nhold++] = p;
+	return true;
+}				/* wvHold */
+
 static bool writeFile(const char *name, int mode)
 {
-	int i;
-	FILE *fh;
-	char *modeString;
-	int modeString_l;
+	int i, flags;
+	struct WRITEV w;
+	int used;
+	bool convert, iso2utf, utf2iso, toutf16;
+	double t0;
 
 	fileSize = 0;
 
@@ -2424,48 +2719,43 @@ static bool writeFile(const char *name, int mode)
 	}
 
 /* mode should be TRUNC or APPEND */
-	modeString = initString(&modeString_l);
-	if (mode & O_APPEND)
-		stringAndChar(&modeString, &modeString_l, 'a');
-	else
-		stringAndChar(&modeString, &modeString_l, 'w');
+	flags = O_WRONLY | O_CREAT;
+	flags |= (mode & O_APPEND) ? O_APPEND : O_TRUNC;
 	if (cw->binMode | cw->utf16Mode | cw->utf32Mode)
-		stringAndChar(&modeString, &modeString_l, 'b');
+		flags |= O_BINARY;
 
-	fh = fopen(name, modeString);
-	nzFree(modeString);
-	if (fh == NULL) {
+	t0 = secondsNow();
+	memset(&w, 0, sizeof(w));
+	w.fd = open(name, flags, MODE_rw);
+	if (w.fd < 0) {
 		setError(MSG_NoCreate2, name);
 		return false;
 	}
+	w.bufmax = WV_BYTES;
+	w.buf = allocMem(w.bufmax);
+
+	convert = (name == cf->fileName && iuConvert);
+	utf2iso = convert && cw->iso8859Mode && cons_utf8;
+	iso2utf = convert && cw->utf8Mode && !cons_utf8;
+	toutf16 = convert && (cw->utf16Mode | cw->utf32Mode);
+
 // If writing to the same file and converting, print message,
 // and perhaps write the byte order mark.
-	if (name == cf->fileName && iuConvert) {
-		if (cw->iso8859Mode && cons_utf8)
-			if (debugLevel >= 1)
-				i_puts(MSG_Conv8859);
-		if (cw->utf8Mode && !cons_utf8)
-			if (debugLevel >= 1)
-				i_puts(MSG_ConvUtf8);
+	if (convert) {
+		if (utf2iso && debugLevel >= 1)
+			i_puts(MSG_Conv8859);
+		if (iso2utf && debugLevel >= 1)
+			i_puts(MSG_ConvUtf8);
 		if (cw->utf16Mode) {
 			if (debugLevel >= 1)
 				i_puts(MSG_ConvUtf16);
-			if (fwrite
-			    ((cw->bigMode ? "\xfe\xff" : "\xff\xfe"), 2, 1,
-			     fh) <= 0) {
-badwrite:
-				setError(MSG_NoWrite2, name);
-				fclose(fh);
-				return false;
-			}
+			wvPiece(&w, (cw->bigMode ? "\xfe\xff" : "\xff\xfe"), 2);
 		}
 		if (cw->utf32Mode) {
 			if (debugLevel >= 1)
 				i_puts(MSG_ConvUtf32);
-			if (fwrite
-			    ((cw->bigMode ? "\x00\x00\xfe\xff" :
-			      "\xff\xfe\x00\x00"), 4, 1, fh) <= 0)
-				goto badwrite;
+			wvPiece(&w, (cw->bigMode ? "\x00\x00\xfe\xff" :
+				     "\xff\xfe\x00\x00"), 4);
 		}
 		if (cw->dosMode && debugLevel >= 1)
 			i_puts(MSG_ConvDos);
@@ -2473,122 +2763,130 @@ badwrite:
 
 	for (i = startRange; i <= endRange; ++i) {
 		pst p = fetchLine(i, (cw->browseMode ? 1 : -1));
-		int len = pstLength(p);
+		int len =
+		    (cw->browseMode ? pstLength(p) : lineLength(cw->map + i));
 		char *suf = dirSuffix(i);
 		char *tp;
 		int tlen;
-		bool alloc_p = cw->browseMode;
-		bool rc = true;
+		bool dosline = false;
+		bool encode = (!cw->dirMode && (utf2iso | iso2utf | toutf16));
+
+/* A browse line that is encoded into the output buffer is freed right after.
+ * Holding it instead would let wvRoom flush, and free it, before it is read. */
+		if (cw->browseMode && !encode && !wvHold(&w, (char *)p))
+			goto badwrite;
 
 		if (!cw->dirMode) {
 			if (i == cw->dol && cw->nlMode)
 				--len;
 
-			if (name == cf->fileName && iuConvert) {
-				if (cw->dosMode && len && p[len - 1] == '\n') {
 // dos mode should not be set with utf16 or utf32; I hope.
-					tp = allocMem(len + 2);
-					memcpy(tp, p, len - 1);
-					memcpy(tp + len - 1, "\r\n", 3);
-					if (alloc_p)
-						free(p);
-					alloc_p = true;
-					p = (pst) tp;
-					++len;
-				}
-
-				if (cw->iso8859Mode && cons_utf8) {
-					utf2iso((uchar *) p, len,
-						(uchar **) & tp, &tlen);
-					if (alloc_p)
-						free(p);
-					alloc_p = true;
-					p = (pst) tp;
-					if (fwrite(p, tlen, 1, fh) <= 0)
-						rc = false;
-					len = tlen;
-					goto endline;
-				}
-
-				if (cw->utf8Mode && !cons_utf8) {
-					iso2utf((uchar *) p, len,
-						(uchar **) & tp, &tlen);
-					if (alloc_p)
-						free(p);
-					alloc_p = true;
-					p = (pst) tp;
-					if (fwrite(p, tlen, 1, fh) <= 0)
-						rc = false;
-					len = tlen;
-					goto endline;
+			if (convert && cw->dosMode && len && p[len - 1] == '\n')
+				dosline = true, --len;
+
+			if (encode) {
+// convert straight into the output buffer
+				tp = wvRoom(&w, len * 4 + 8);
+				if (!tp) {
+					if (cw->browseMode)
+						free((char *)p);
+					goto badwrite;
 				}
-
-				if (cw->utf16Mode || cw->utf32Mode) {
-					utfHigh((char *)p, len, &tp, &tlen,
-						cons_utf8, cw->utf32Mode,
-						cw->bigMode);
-					if (alloc_p)
-						free(p);
-					alloc_p = true;
-					p = (pst) tp;
-					if (fwrite(p, tlen, 1, fh) <= 0)
-						rc = false;
-					len = tlen;
-					goto endline;
+				if (utf2iso)
+					tlen = utf2isoChunk((uchar *) p, len,
+							    (uchar *) tp, &used, true);
+				else if (iso2utf)
+					tlen = iso2utfChunk((uchar *) p, len,
+							    (uchar *) tp);
+				else
+					tlen = utfHighChunk((char *)p, len,
+							    tp, &used, true,
+							    cons_utf8,
+							    cw->utf32Mode,
+							    cw->bigMode);
+/* crlf goes through the same encoder, 2 bytes each in utf16, 4 in utf32 */
+				if (dosline && toutf16)
+					tlen += utfHighChunk("\r\n", 2, tp + tlen,
+							     &used, true, false,
+							     cw->utf32Mode,
+							     cw->bigMode);
+				else if (dosline) {
+					memcpy(tp + tlen, "\r\n", 2);
+					tlen += 2;
 				}
+				if (cw->browseMode)
+					free((char *)p);
+				if (!wvUsed(&w, tlen))
+					goto badwrite;
+				fileSize += tlen;
+				continue;
 			}
 
-			if (fwrite(p, len, 1, fh) <= 0)
-				rc = false;
-			goto endline;
+			if (!wvPiece(&w, (char *)p, len))
+				goto badwrite;
+			fileSize += len;
+			if (dosline) {
+				if (!wvPiece(&w, "\r\n", 2))
+					goto badwrite;
+				fileSize += 2;
+			}
+			continue;
 		}
 
 /* Write this line with directory suffix, and possibly attributes */
 		--len;
-		if (fwrite(p, len, 1, fh) <= 0) {
-badline:
-			rc = false;
-			goto endline;
-		}
+		if (!wvPiece(&w, (char *)p, len))
+			goto badwrite;
+		fileSize += len;
+
+/* suffix is a static string, copy it out */
+		len = strlen(suf);
+		if (len && !wvCopy(&w, suf, len))
+			goto badwrite;
 		fileSize += len;
 
 		if (cw->r_map) {
-			int l;
 /* extra ls stats to write */
-			char *extra;
-			len = strlen(suf);
-			if (len && fwrite(suf, len, 1, fh) <= 0)
-				goto badline;
-			++len;	/* for nl */
-			extra = (char *)cw->r_map[i].text;
-			l = strlen(extra);
-			if (l) {
-				if (fwrite(" ", 1, 1, fh) <= 0)
-					goto badline;
-				++len;
-				if (fwrite(extra, l, 1, fh) <= 0)
-					goto badline;
-				len += l;
+			char *extra = (char *)cw->r_map[i].text;
+			len = strlen(extra);
+			if (len) {
+				if (!wvPiece(&w, " ", 1) ||
+				    !wvPiece(&w, extra, len))
+					goto badwrite;
+				fileSize += len + 1;
 			}
-			if (fwrite("\n", 1, 1, fh) <= 0)
-				goto badline;
-			goto endline;
 		}
 
-		strcat(suf, "\n");
-		len = strlen(suf);
-		if (fwrite(suf, len, 1, fh) <= 0)
-			goto badline;
-
-endline:
-		if (alloc_p)
-			free(p);
-		if (!rc)
+		if (!wvPiece(&w, "\n", 1))
 			goto badwrite;
-		fileSize += len;
+		++fileSize;
 	}			/* loop over lines */
 
-	fclose(fh);
+	if (!wvFlush(&w)) {
+badwrite:
+/* don't write the rest, just free what is held */
+		w.n = 0;
+		wvFlush(&w);
+		setError(MSG_NoWrite2, name);
+		close(w.fd);
+		nzFree(w.buf);
+		return false;
+	}
+
+	nzFree(w.buf);
+	if (close(w.fd) < 0) {
+		setError(MSG_NoWrite2, name);
+		return false;
+	}
+
+	if (debugLevel >= 3) {
+		double secs = secondsNow() - t0;
+		if (secs < 0.000001)
+			secs = 0.000001;
+		debugPrint(3, "wrote %d bytes in %.3f seconds, %.1f MB/s",
+			   fileSize, secs, fileSize / secs / 1000000.0);
+	}
+
 /* This is not an undoable operation, nor does it change data.
  * In fact the data is "no longer modified" if we have written all of it. */
 	if (startRange == 1 && endRange == cw->dol)
@@ -2616,15 +2914,19 @@ static bool readContext(int cx)
 		cw->nlMode = false;
 	newpiece = t = allocZeroMem(fardol * LMSIZE);
 	for (i = 1; i <= fardol; ++i, ++t) {
-		pst p = fetchLineContext(i, (lw->dirMode ? -1 : 1), cx);
-		int len = pstLength(p);
-		if (lw->dirMode) {
+		pst p;
+		int len;
+		if (!lw->dirMode) {
+			p = shareLineContext(i, cx, &len);
+		} else {
 			char *suf = dirSuffixContext(i, cx);
 			char *q;
+			p = fetchLineContext(i, -1, cx);
+			len = pstLength(p);
 			if (lw->r_map) {
 				char *extra = (char *)lw->r_map[i].text;
 				int elen = strlen(extra);
-				q = allocMem(len + 4 + elen);
+				q = (char *)allocLine(len + 4 + elen);
 				memcpy(q, p, len);
 				--len;
 				strcpy(q + len, suf);
@@ -2634,7 +2936,7 @@ static bool readContext(int cx)
 				}
 				strcat(q, "\n");
 			} else {
-				q = allocMem(len + 3);
+				q = (char *)allocLine(len + 3);
 				memcpy(q, p, len);
 				--len;
 				strcat(suf, "\n");
@@ -2644,6 +2946,7 @@ static bool readContext(int cx)
 			p = (pst) q;
 		}
 		t->text = p;
+		t->len = len;
 		fileSize += len;
 	}			/* loop over lines in the "other" context */
 
@@ -2681,15 +2984,17 @@ static bool writeContext(int cx)
 	if (startRange) {
 		newmap = t = allocZeroMem((fardol + 2) * LMSIZE);
 		for (i = startRange, ++t; i <= endRange; ++i, ++t) {
-			p = fetchLine(i, (cw->dirMode ? -1 : 1));
-			len = pstLength(p);
-			if (cw->dirMode) {
+			if (!cw->dirMode) {
+				p = shareLineContext(i, context, &len);
+			} else {
 				char *q;
 				char *suf = dirSuffix(i);
+				p = fetchLine(i, -1);
+				len = pstLength(p);
 				if (cw->r_map) {
 					char *extra = (char *)cw->r_map[i].text;
 					int elen = strlen(extra);
-					q = allocMem(len + 4 + elen);
+					q = (char *)allocLine(len + 4 + elen);
 					memcpy(q, p, len);
 					--len;
 					strcpy(q + len, suf);
@@ -2699,7 +3004,7 @@ static bool writeContext(int cx)
 					}
 					strcat(q, "\n");
 				} else {
-					q = allocMem(len + 3);
+					q = (char *)allocLine(len + 3);
 					memcpy(q, p, len);
 					--len;
 					strcat(suf, "\n");
@@ -2709,6 +3014,7 @@ static bool writeContext(int cx)
 				p = (pst) q;
 			}
 			t->text = p;
+			t->len = len;
 			fileSize += len;
 		}
 		lw->map = newmap;
@@ -2784,8 +3090,7 @@ static char *apostropheMacros(const char *line)
 frombuf:
 				++t;
 				if (pass == 1) {
-					p = fetchLine(n, -1);
-					linesize += pstLength(p) - 1;
+					linesize += lineLength(cw->map + n) - 1;
 				} else {
 					p = fetchLine(n, 1);
 					if (perl2c((char *)p)) {
@@ -3107,6 +3412,242 @@ regexpCheck(const char *line, bool isleft, bool ebmuck,
 	return true;
 }				/* regexpCheck */
 
+/* The text of line n, to match against a regexp, and its length
+ * without the newline.  This is the line itself, no copy,
+ * except in browse mode, where the copy has the hidden numbers removed,
+ * and the caller must free it. */
+static char *searchLine(int n, int *len)
+{
+	char *s;
+	if (!cw->browseMode) {
+		*len = lineLength(cw->map + n) - 1;
+		return (char *)cw->map[n].text;
+	}
+	s = (char *)fetchLine(n, 1);
+	*len = pstLength((pst) s) - 1;
+	return s;
+}				/* searchLine */
+
+/*********************************************************************
+Literal search.
+Most searches are plain strings, with no metacharacters.
+Look for these with memmem, which is a vectorized two way matcher
+in glibc, rather than running pcre against every line.
+Case insensitive is supported for ascii strings only;
+pcre knows how to fold the rest.
+A very large buffer is split into parts, in search order,
+and the parts are scanned in parallel, first hit wins.
+*********************************************************************/
+
+static char lit_string[MAXRE + 20];
+static int lit_len;
+static bool lit_ci;
+
+/* Is this regular expression, as produced by regexpCheck, a literal string?
+ * If so, it is unescaped into lit_string. */
+static bool literalPattern(const char *re, bool ci)
+{
+	char *t = lit_string;
+	uchar c;
+
+	while ((c = *re++)) {
+		if (c == '\\') {
+/* \d \w \b \1 etc are not literal, but \. \( \/ are */
+			c = *re++;
+			if (!c || isalnumByte(c))
+				return false;
+		} else if (strchr("^$.[]|()?*+{}", c))
+			return false;
+		if (ci && (c & 0x80))
+			return false;
+		*t++ = c;
+	}
+
+	lit_len = t - lit_string;
+	lit_ci = ci;
+	return lit_len > 0;
+}				/* literalPattern */
+
+static bool literalFind(const char *s, int len)
+{
+	const char *end = s + len - lit_len;
+	uchar c = lit_string[0];
+	uchar d = c;
+
+	if (len < lit_len)
+		return false;
+
+	if (!lit_ci) {
+#ifndef DOSLIKE
+		return memmem(s, len, lit_string, lit_len) != 0;
+#else
+		for (; s <= end; ++s) {
+			s = memchr(s, c, end - s + 1);
+			if (!s)
+				return false;
+			if (!memcmp(s, lit_string, lit_len))
+				return true;
+		}
+		return false;
+#endif
+	}
+
+/* look for the first letter in either case, with memchr,
+ * and compare the rest only where it is found */
+	if (isupperByte(c))
+		d = tolower(c);
+	if (islowerByte(c))
+		d = toupper(c);
+	while (s <= end) {
+		const char *p = memchr(s, c, end - s + 1);
+		if (d != c) {
+			const char *q = memchr(s, d, (p ? p : end + 1) - s);
+			if (q)
+				p = q;
+		}
+		if (!p)
+			return false;
+		if (memEqualCI(p + 1, lit_string + 1, lit_len - 1))
+			return true;
+		s = p + 1;
+	}
+	return false;
+}				/* literalFind */
+
+/* The kth line in search order, from start, going forward or back. */
+static int searchOrder(int start, int incr, int k)
+{
+	int dol = cw->dol;
+	int ln = (start - 1 + incr * k) % dol;
+	if (ln < 0)
+		ln += dol;
+	return ln + 1;
+}				/* searchOrder */
+
+#define SEARCHTHREADS 8
+#define SEARCHTHREADLINES 200000	// don't bother with threads below this
+#define SEARCHCHECK 1024	// lines between looks at the cutoff
+
+/* The earliest hit so far, in search order, across the threads.
+ * A thread scanning a later slice stops when it passes this,
+ * so a hit near the start doesn't wait for the whole buffer. */
+static struct {
+	int k;
+	pthread_mutex_t lock;
+} searchCut = {.lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int cutoffGet(void)
+{
+	int k;
+	pthread_mutex_lock(&searchCut.lock);
+	k = searchCut.k;
+	pthread_mutex_unlock(&searchCut.lock);
+	return k;
+}				/* cutoffGet */
+
+static void cutoffLower(int k)
+{
+	pthread_mutex_lock(&searchCut.lock);
+	if (k < searchCut.k)
+		searchCut.k = k;
+	pthread_mutex_unlock(&searchCut.lock);
+}				/* cutoffLower */
+
+/* Scan positions from through to - 1 in search order;
+ * return the first that matches, or 0.
+ * If threaded, give up once an earlier slice has a hit. */
+static int literalScan(int start, int incr, int from, int to, bool threaded)
+{
+	int k, len;
+	char *s;
+	bool hit;
+
+	for (k = from; k < to; ++k) {
+		if (threaded && !((k - from) % SEARCHCHECK) && k >= cutoffGet())
+			return 0;
+		s = searchLine(searchOrder(start, incr, k), &len);
+		hit = literalFind(s, len);
+		if (cw->browseMode)
+			free(s);
+		if (hit) {
+			if (threaded)
+				cutoffLower(k);
+			return k;
+		}
+	}
+	return 0;
+}				/* literalScan */
+
+struct SEARCHPART {
+	int start, incr, from, to;
+	int hit;
+};
+
+static void *literalWorker(void *ptr)
+{
+	struct SEARCHPART *sp = ptr;
+	sp->hit = literalScan(sp->start, sp->incr, sp->from, sp->to, true);
+	return NULL;
+}				/* literalWorker */
+
+/* Search for lit_string, starting after line start, as / or ? would.
+ * Returns the line number, or 0 if not found. */
+static int literalSearch(int start, int incr)
+{
+	struct SEARCHPART parts[SEARCHTHREADS];
+	pthread_t tids[SEARCHTHREADS];
+	bool started[SEARCHTHREADS];
+	int n, nt = 1, j, k = 0;
+
+/* how many lines to look at, in search order */
+	n = cw->dol;
+	if (!searchWrap)
+		n = (incr > 0 ? cw->dol - start : start - 1);
+	if (n <= 0)
+		return 0;
+
+#ifndef DOSLIKE
+/* The map is shared, read only, and browse mode makes copies;
+ * keep that to one thread. */
+	if (n >= SEARCHTHREADLINES && !cw->browseMode) {
+		nt = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nt > SEARCHTHREADS)
+			nt = SEARCHTHREADS;
+		if (nt < 1)
+			nt = 1;
+	}
+#endif
+
+	if (nt == 1) {
+		k = literalScan(start, incr, 1, n + 1, false);
+		return (k ? searchOrder(start, incr, k) : 0);
+	}
+
+	searchCut.k = n + 1;
+	for (j = 0; j < nt; ++j) {
+		parts[j].start = start, parts[j].incr = incr;
+		parts[j].from = 1 + (long long)n * j / nt;
+		parts[j].to = 1 + (long long)n * (j + 1) / nt;
+		parts[j].hit = 0;
+		started[j] =
+		    !pthread_create(tids + j, NULL, literalWorker, parts + j);
+	}
+	for (j = 0; j < nt; ++j) {
+		if (started[j])
+			pthread_join(tids[j], NULL);
+		else
+			literalWorker(parts + j);
+	}
+	debugPrint(4, "search %d lines in %d threads", n, nt);
+
+/* The first part with a hit has the first hit in search order.
+ * A part that stopped at the cutoff has no hit, but an earlier part does. */
+	for (j = 0; j < nt; ++j)
+		if ((k = parts[j].hit))
+			break;
+	return (k ? searchOrder(start, incr, k) : 0);
+}				/* literalSearch */
+
 /* regexp variables */
 static int re_count;
 static int re_vector[11 * 3];
@@ -3195,15 +3736,24 @@ static bool getRangePart(const char *line, int *lineno, const char **split)
 		}
 
 		/* second delimiter */
+		incr = (first == '/' ? 1 : -1);
+		if (literalPattern(re, ci)) {
+			ln = literalSearch(ln, incr);
+			if (!ln) {
+				setError(MSG_NotFound);
+				return false;
+			}
+			goto matched;
+		}
 		regexpCompile(re, ci);
 		if (!re_cc)
 			return false;
 /* We should probably study the pattern, if the file is large.
  * But then again, it's probably not worth it,
  * since the expressions are simple, and the lines are short. */
-		incr = (first == '/' ? 1 : -1);
 		while (true) {
 			char *subject;
+			int sublen;
 			ln += incr;
 			if (!searchWrap && (ln == 0 || ln > cw->dol)) {
 				pcre_free(re_cc);
@@ -3214,12 +3764,12 @@ static bool getRangePart(const char *line, int *lineno, const char **split)
 				ln = 1;
 			if (ln == 0)
 				ln = cw->dol;
-			subject = (char *)fetchLine(ln, 1);
+			subject = searchLine(ln, &sublen);
 			re_count =
-			    pcre_exec(re_cc, 0, subject,
-				      pstLength((pst) subject) - 1, 0, 0,
+			    pcre_exec(re_cc, 0, subject, sublen, 0, 0,
 				      re_vector, 33);
-			free(subject);
+			if (cw->browseMode)
+				free(subject);
 // An error in evaluation is treated like text not found.
 // This usually happens because this particular line has bad binary, not utf8.
 			if (re_count < -1 && pcre_utf8_error_stop) {
@@ -3238,6 +3788,8 @@ static bool getRangePart(const char *line, int *lineno, const char **split)
 		pcre_free(re_cc);
 /* and ln is the line that matches */
 	}
+
+matched:
 	/* Now add or subtract from this number */
 	while ((first = *line) == '+' || first == '-') {
 		int add = 1;
@@ -3292,6 +3844,7 @@ static bool doGlobal(const char *line)
 	char delim = *line;
 	struct lineMap *t;
 	char *re;		/* regular expression */
+	bool lit;		/* just a string */
 	int i, origdot, yesdot, nodot;
 
 	if (!delim) {
@@ -3317,15 +3870,23 @@ static bool doGlobal(const char *line)
 		t->gflag = false;
 
 /* Find the lines that match the pattern. */
-	regexpCompile(re, ci);
-	if (!re_cc)
-		return false;
+	lit = literalPattern(re, ci);
+	if (!lit) {
+		regexpCompile(re, ci);
+		if (!re_cc)
+			return false;
+	}
 	for (i = startRange; i <= endRange; ++i) {
-		char *subject = (char *)fetchLine(i, 1);
-		re_count =
-		    pcre_exec(re_cc, 0, subject, pstLength((pst) subject) - 1,
-			      0, 0, re_vector, 33);
-		free(subject);
+		int sublen;
+		char *subject = searchLine(i, &sublen);
+		if (lit)
+			re_count = (literalFind(subject, sublen) ? 1 : -1);
+		else
+			re_count =
+			    pcre_exec(re_cc, 0, subject, sublen, 0, 0,
+				      re_vector, 33);
+		if (cw->browseMode)
+			free(subject);
 		if (re_count < -1 && pcre_utf8_error_stop) {
 			pcre_free(re_cc);
 			setError(MSG_RexpError2, i);
@@ -3337,7 +3898,8 @@ static bool doGlobal(const char *line)
 			cw->map[i].gflag = true;
 		}
 	}			/* loop over line */
-	pcre_free(re_cc);
+	if (!lit)
+		pcre_free(re_cc);
 
 	if (!gcnt) {
 		setError((cmd == 'v') + MSG_NoMatchG);
@@ -3876,7 +4438,7 @@ static int substituteText(const char *line)
 		replaceString = 0;
 
 		p = (char *)fetchLine(ln, -1);
-		len = pstLength((pst) p);
+		len = lineLength(cw->map + ln);
 
 		if (bl_mode) {
 			int newlen;
@@ -4017,9 +4579,10 @@ static int substituteText(const char *line)
 /* normal substitute */
 				undoPush();
 				mptr = cw->map + ln;
-				mptr->text = allocMem(replaceStringLength + 1);
+				mptr->text = allocLine(replaceStringLength + 1);
 				memcpy(mptr->text, replaceString,
 				       replaceStringLength + 1);
+				mptr->len = replaceStringLength + 1;
 				if (cw->dirMode || cw->sqlMode) {
 					undoCompare();
 					cw->undoable = false;
@@ -4230,6 +4793,12 @@ static int twoLetter(const char *line, const char **runThis)
 		return true;
 	}
 
+	if (stringEqual(line, "prof"))
+		return profShow(0);
+
+	if (!strncmp(line, "prof>", 5))
+		return profShow(line + 5);
+
 	if (stringEqual(line, "bw")) {
 		cw->changeMode = false;
 		cw->quitMode = true;
@@ -4545,8 +5114,13 @@ pwd:
 			cw->r_map = 0;
 		} else {
 et_go:
-			for (i = 1; i <= cw->dol; ++i)
+/* the rendered text is what's left, it isn't the file any more */
+			cw->diskMode = false;
+			for (i = 1; i <= cw->dol; ++i) {
+				cw->map[i].text = ownLine(cw->map[i].text);
 				removeHiddenNumbers(cw->map[i].text, '\n');
+				cw->map[i].len = 0;
+			}
 			freeWindowLines(cw->r_map);
 			cw->r_map = 0;
 		}
@@ -4686,8 +5260,8 @@ et_go:
 // In case we haven't started curl yet.
 			if (!curlActive) {
 				eb_curl_global_init();
-// we don't need cookies and cache for email, but http might follow.
-				cookiesFromJar();
+// we don't need the cache for email, but http might follow.
+// The cookie jar waits for the first http request.
 				setupEdbrowseCache();
 			}
 			return sendMailCurrent(account, dosig);
@@ -5374,7 +5948,7 @@ bool unfoldBufferW(const struct ebWindow *w, bool cr, char **data, int *len)
 	*data = buf;
 	for (ln = 1; ln <= w->dol; ++ln) {
 		pst line = w->map[ln].text;
-		l = pstLength(line) - 1;
+		l = lineLength(w->map + ln) - 1;
 		if (l) {
 			memcpy(buf, line, l);
 			buf += l;
@@ -5552,7 +6126,7 @@ This means no embedded nulls.
 If you want to use null in a search or substitute, use \0.
 *********************************************************************/
 
-bool runCommand(const char *line)
+static bool runCommand_0(const char *line)
 {
 	int i, j, n;
 	int writeMode = O_TRUNC;
@@ -6123,6 +6697,7 @@ replaceframe:
 			}
 			nzFree(cf->fileName);
 			cf->fileName = cloneString(line);
+			cw->diskMode = false;
 		}
 		s = cf->fileName;
 		if (s)
@@ -6279,7 +6854,7 @@ replaceframe:
 		}
 		cw->dot = endRange;
 		p = (char *)fetchLine(endRange, -1);
-		j = pstLength((pst) p);
+		j = lineLength(cw->map + endRange);
 		--j;
 		p[j] = 0;	/* temporary */
 		dirline = makeAbsPath(p);
@@ -6924,6 +7499,17 @@ afterdelete:
 
 	setError(MSG_CNYI, icmd);
 	return (globSub = false);
+}				/* runCommand_0 */
+
+/* A page tokenized as it came in, see pipelineStart() in html.c,
+ * is only for the b command that fetched it. If that command didn't
+ * get as far as htmlParse, because the page went to a plugin,
+ * or wasn't html after all, or something failed, throw the tags away. */
+bool runCommand(const char *line)
+{
+	bool rc = runCommand_0(line);
+	pipelineDrop();
+	return rc;
 }				/* runCommand */
 
 bool edbrowseCommand(const char *line, bool script)
@@ -7051,7 +7637,16 @@ bool browseCurrentBuffer(void)
 		return false;
 	}
 
-	if (!unfoldBuffer(context, false, &rawbuf, &rawsize))
+/* A mail file that is just as it was read can be parsed from disk,
+ * with its attachments decoded straight to spool files.
+ * Not if anything has changed, in the buffer, its name, or the file. */
+	newbuf = 0;
+	if (bmode == 1 && cw->diskMode && !(cw->utf16Mode | cw->utf32Mode) &&
+	    fileTimeByName(cf->fileName) == cw->diskTime &&
+	    fileSizeByName(cf->fileName) == cw->diskSize)
+		newbuf = emailParseFile(cf->fileName);
+
+	if (!newbuf && !unfoldBuffer(context, false, &rawbuf, &rawsize))
 		return false;	/* should never happen */
 
 	if (bmode == 3) {
@@ -7081,7 +7676,8 @@ bool browseCurrentBuffer(void)
 	}
 
 /* this shouldn't do any harm if the output is text */
-	prepareForBrowse(rawbuf, rawsize);
+	if (!newbuf)
+		prepareForBrowse(rawbuf, rawsize);
 
 /* No harm in running this code in mail client, but no help either,
  * and it begs for bugs, so leave it out. */
@@ -7091,7 +7687,8 @@ bool browseCurrentBuffer(void)
 	}
 
 	if (bmode == 1) {
-		newbuf = emailParse(rawbuf);
+		if (!newbuf)
+			newbuf = emailParse(rawbuf);
 		j = strlen(newbuf);
 
 /* mail could need utf8 conversion, after qp decode */
@@ -7138,6 +7735,10 @@ bool browseCurrentBuffer(void)
 	free(newbuf);
 	cw->undoable = false;
 	cw->changeMode = save_ch;
+	if (bmode == 2) {
+		loadStamp(LOAD_FIRSTLINE);
+		loadReport();
+	}
 
 	if (cf->fileName) {
 		j = strlen(cf->fileName);
@@ -1593,6 +1593,7 @@ void cssDocLoad(int frameNumber, char *start, bool pageload)
 	Frame *save_cf = cf;
 	struct cssmaster *cm;
 	bool recompile = false;
+	profStart(PROF_CSS);
 	frameFromWindow(frameNumber);
 	cm = cf->cssmaster;
 	if (!cm) {
@@ -1634,6 +1635,7 @@ void cssDocLoad(int frameNumber, char *start, bool pageload)
 
 done:
 	cf = save_cf;
+	profEnd(PROF_CSS);
 }
 
 static void chainFree(struct asel *asel)
@@ -154,6 +154,8 @@ void sql_rollbackWork(void);
 void sql_deferConstraints(void);
 bool sql_execNF(const char *stmt);
 bool sql_exec(const char *stmt, ...);
+bool sql_execBound(const char *stmt, const char *ptypes,
+		   const char **values, int nrows);
 void retsCopy(bool allstrings, void *first, ...);
 bool sql_select(const char *stmt, ...);
 bool sql_selectNF(const char *stmt, ...);
@@ -172,6 +174,8 @@ bool sql_fetchLast(int cid, ...);
 bool sql_fetchNext(int cid, ...);
 bool sql_fetchPrev(int cid, ...);
 bool sql_fetchAbs(int cid, long rownum, ...);
+int sql_fetchBlock(int cid, int nrows);
+void sql_blockRow(int cid, int row);
 void sql_blobInsert(const char *tabname, const char *colname, int rowid,
 		    const char *filename, void *offset, int length);
 void getPrimaryKey(char *tname, int *part1, int *part2, int *part3, int *part4);
@@ -283,9 +283,16 @@ static struct OCURS {
 	SQLHSTMT hstmt;
 	long rownum;
 	char rv_type[NUMRETS];
+	short width[NUMRETS];	/* column widths, for block fetch */
 	short cid;		/* cursor ID */
 	char flag;
 	char numrets;
+/* column arrays and null indicators for block fetch, see sql_fetchBlock() */
+	char *block;
+	SQLLEN *blockind;
+	int blockoff[NUMRETS];
+	int blocksize;		/* rows the arrays can hold */
+	SQLULEN blockrows;	/* rows in the current block */
 } ocurs[NUMCURSORS];
 
 /* values for struct OCURS.flag */
@@ -330,6 +337,36 @@ static struct OCURS *findCursor(int cid)
 	return o;
 }				/* findCursor */
 
+/*********************************************************************
+A small cache of prepared statements, for sql_execBound().
+These statements carry ? placeholders, rather than the values,
+so the text is the shape of the statement, and makes a good key.
+Inserting or updating many rows, one statement per row,
+should not prepare the same statement over and over again.
+*********************************************************************/
+
+#define NUMSTATEMENTS 8
+static struct PSTMT {
+	char *text;		/* the statement, with ? placeholders */
+	SQLHSTMT hstmt;
+	long used;		/* when last used, to find the oldest */
+} pstmts[NUMSTATEMENTS];
+static long pstmt_clock;
+
+/* forget the cached statements, and free the handles if they are still live */
+static void dropStatements(bool freehandles)
+{
+	short i;
+	for (i = 0; i < NUMSTATEMENTS; ++i) {
+		if (pstmts[i].hstmt != SQL_NULL_HSTMT && freehandles)
+			SQLFreeHandle(SQL_HANDLE_STMT, pstmts[i].hstmt);
+		pstmts[i].hstmt = SQL_NULL_HSTMT;
+		nzFree(pstmts[i].text);
+		pstmts[i].text = 0;
+		pstmts[i].used = 0;
+	}
+}				/* dropStatements */
+
 /* This doesn't close/free anything; it simply puts variables in an initial state. */
 /* part of the disconnect() procedure */
 static void clearAllCursors(void)
@@ -338,7 +375,12 @@ static void clearAllCursors(void)
 	for (i = 0; i < NUMCURSORS; ++i) {
 		ocurs[i].flag = CURSOR_NONE;
 		ocurs[i].hstmt = SQL_NULL_HSTMT;
+		nzFree(ocurs[i].block);
+		ocurs[i].block = 0;
+		nzFree(ocurs[i].blockind);
+		ocurs[i].blockind = 0;
 	}
+	dropStatements(false);
 }				/* clearAllCursors */
 
 /*********************************************************************
@@ -620,6 +662,10 @@ static void endTrans(bool commit)
 			o->hstmt = SQL_NULL_HSTMT;
 		}
 
+/* prepared statements go the way of the cursors */
+		if (newstate == CURSOR_NONE)
+			dropStatements(true);
+
 		/* back to singleton transactions */
 		rc = SQLSetConnectOption(hdbc, SQL_AUTOCOMMIT,
 					 SQL_AUTOCOMMIT_ON);
@@ -812,14 +858,52 @@ static va_list sqlargs;
 /* Temp area to read the values as strings */
 static char retstring[NUMRETS][STRINGLEN + 4];
 static bool everything_null;
+/* declared widths of the columns, from the last prepare */
+static short colwidth[NUMRETS];
+
+/* turn the string form of a date or time, from ODBC, into our own format */
+static long dateFromOdbc(char *s)
+{
+	bool yearfirst = false;
+	long dt;
+	if (s[4] == '-')
+		yearfirst = true;
+	dt = stringDate(s, yearfirst);
+	if (dt < 0)
+		errorPrint("@database holds invalid date %s", s);
+	return dt;
+}				/* dateFromOdbc */
+
+static long timeFromOdbc(char *s)
+{
+	long dt;
+	if (s[0] == 0)
+		return nullint;
+/* thanks to stringTime(), this works for either hh:mm or hh:mm:ss */
+/* Note that Informix introduces a leading space, how about ODBC? */
+	leftClipString(s);
+	if (s[1] == ':')
+		shiftRight(s, '0');
+	dt = stringTime(s);
+	if (dt < 0)
+		errorPrint("@database holds invalid time %s", s);
+	return dt;
+}				/* timeFromOdbc */
+
+/* money comes back as a double; round it to pennies, away from zero,
+ * so that -1.23 is -123 and not -122 */
+static long pennies(double f)
+{
+	return (f < 0 ? f * 100.0 - 0.5 : f * 100.0 + 0.5);
+}				/* pennies */
 
 static void retsFromOdbc(void)
 {
 	void *q, *q1;
 	int i, l;
 	int fd, flags;
-	bool yearfirst, indata = false;
-	long dt;		/* temporarily hold date or time */
+	bool indata = false;
+	long dt;		/* temporarily hold money */
 	char *s;
 	short c_type;		/* C data type */
 	long input_length, output_length;
@@ -962,41 +1046,18 @@ static void retsFromOdbc(void)
 			break;
 
 		case 'D':
-			yearfirst = false;
-			if (s[4] == '-')
-				yearfirst = true;
-			dt = stringDate(s, yearfirst);
-			if (dt < 0)
-				errorPrint("@database holds invalid date %s",
-					   s);
-			*(long *)q = dt;
+			*(long *)q = dateFromOdbc(s);
 			break;
 
 		case 'I':
-			/* thanks to stringTime(), this works
-			   for either hh:mm or hh:mm:ss */
-			if (s[0] == 0)
-				*(long *)q = nullint;
-			else {
-				/* Note that Informix introduces a leading space,
-				   how about ODBC? */
-				leftClipString(s);
-				if (s[1] == ':')
-					shiftRight(s, '0');
-				dt = stringTime(s);
-				if (dt < 0)
-					errorPrint
-					    ("@database holds invalid time %s",
-					     s);
-				*(long *)q = dt;
-			}
+			*(long *)q = timeFromOdbc(s);
 			break;
 
 		case 'M':
 			if (fmoney == nullfloat)
 				dt = nullint;
 			else
-				dt = fmoney * 100.0 + 0.5;
+				dt = pennies(fmoney);
 			*(long *)q = dt;
 			break;
 
@@ -1219,6 +1280,9 @@ Count(*) becomes decimal(15,0).  So be careful.
 		}
 
 		rv_nullable[i] = (nullable != SQL_NO_NULLS);
+		colwidth[i] = STRINGLEN;
+		if (colprec && colprec < STRINGLEN)
+			colwidth[i] = colprec;
 
 		switch (coltype) {
 		case SQL_BIT:
@@ -1461,6 +1525,390 @@ int sql_procOne(const char *stmt, ...)
 	return oneRetValue(0, 0);
 }				/* sql_procOne */
 
+/*********************************************************************
+Run a statement with ? placeholders, binding the values as strings.
+ptypes holds the edbrowse type of each parameter, as in rv_type,
+and values holds nrows sets of parameters, one row after another.
+A null or empty value is a null parameter.
+With more than one row, the parameters go across as arrays,
+through SQL_ATTR_PARAMSET_SIZE, and the statement runs once,
+or once per row if the driver can't manage parameter arrays.
+The prepared statement is cached, see dropStatements() above.
+rv_lastNrows is the total number of rows affected,
+though some drivers only report the count for the last row.
+*********************************************************************/
+
+static short paramType(char type)
+{
+	if (type == 'N')
+		return SQL_INTEGER;
+	if (type == 'F')
+		return SQL_DOUBLE;
+	return SQL_VARCHAR;
+}				/* paramType */
+
+bool sql_execBound(const char *stmt, const char *ptypes,
+		   const char **values, int nrows)
+{
+	struct PSTMT *p, *oldest;
+	int nparams = strlen(ptypes);
+	int width[NUMRETS];
+	int i, j, l, w, sets, size = 0;
+	const char *v;
+	char *buf, *q;
+	SQLLEN *ind;
+	SQLLEN count;
+	bool ok = false;
+
+	checkConnect();
+	if (nparams > NUMRETS)
+		errorPrint("2cannot bind more than %d parameters", NUMRETS);
+	if (nrows < 1)
+		errorPrint("@sql_execBound with no rows");
+	stmt_text = stmt;
+	debugStatement();
+	rv_lastNrows = 0;
+
+	if (openfirst) {
+/* this driver can't prepare, so there is nothing to cache */
+		newStatement();
+	} else {
+		oldest = p = pstmts;
+		for (i = 0; i < NUMSTATEMENTS; ++i, ++p) {
+			if (p->text && stringEqual(p->text, stmt))
+				break;
+			if (p->used < oldest->used)
+				oldest = p;
+		}
+		if (i == NUMSTATEMENTS) {
+			p = oldest;
+			if (p->hstmt != SQL_NULL_HSTMT)
+				SQLFreeHandle(SQL_HANDLE_STMT, p->hstmt);
+			nzFree(p->text);
+			p->text = 0;
+			rc = SQLAllocStmt(hdbc, &p->hstmt);
+			if (rc)
+				errorPrint
+				    ("@could not alloc ODBC statement handle");
+			hstmt = p->hstmt;
+			rc = SQLPrepare(hstmt, (uchar *) stmt, SQL_NTS);
+			if (errorTrap(0)) {
+				SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+				p->hstmt = SQL_NULL_HSTMT;
+				exclist = 0;
+				return false;
+			}
+			p->text = cloneString(stmt);
+		} else if (sql_debug)
+			appendFile(sql_debuglog, "statement is already prepared");
+		p->used = ++pstmt_clock;
+		hstmt = p->hstmt;
+	}
+
+/* Lay the values out column-wise, each column as wide as its longest value. */
+	for (j = 0; j < nparams; ++j) {
+		w = 2;
+		for (i = 0; i < nrows; ++i) {
+			v = values[i * nparams + j];
+			if (v && (l = strlen(v)) >= w)
+				w = l + 1;
+		}
+		width[j] = w;
+		size += w * nrows;
+	}
+	buf = allocMem(size + 1);
+	ind = allocMem(sizeof(SQLLEN) * (nparams * nrows + 1));
+	for (j = 0, q = buf; j < nparams; ++j) {
+		for (i = 0; i < nrows; ++i, q += width[j]) {
+			v = values[i * nparams + j];
+			if (isnullstring(v)) {
+				*q = 0;
+				ind[j * nrows + i] = SQL_NULL_DATA;
+			} else {
+				strcpy(q, v);
+				ind[j * nrows + i] = SQL_NTS;
+			}
+		}
+	}
+
+/* all the rows at once, if the driver lets us */
+	sets = nrows;
+	rc = SQLSetStmtAttr(hstmt, SQL_ATTR_PARAM_BIND_TYPE,
+			    (SQLPOINTER) SQL_PARAM_BIND_BY_COLUMN, 0);
+	if (!rc)
+		rc = SQLSetStmtAttr(hstmt, SQL_ATTR_PARAMSET_SIZE,
+				    (SQLPOINTER) (SQLULEN) nrows, 0);
+	if (rc && nrows > 1) {
+		if (sql_debug)
+			appendFile(sql_debuglog,
+				   "no parameter arrays, one row at a time");
+		sets = 1;
+		SQLSetStmtAttr(hstmt, SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER) 1,
+			       0);
+	}
+
+	for (i = 0; i < nrows; i += sets) {
+		SQLFreeStmt(hstmt, SQL_RESET_PARAMS);
+		for (j = 0, q = buf; j < nparams; ++j) {
+			w = width[j];
+			rc = SQLBindParameter(hstmt, (ushort) (j + 1),
+					      SQL_PARAM_INPUT, SQL_C_CHAR,
+					      paramType(ptypes[j]), w - 1, 0,
+					      q + i * w, w,
+					      ind + j * nrows + i);
+			if (errorTrap(0))
+				goto done;
+			q += w * nrows;
+		}
+		if (openfirst)
+			rc = SQLExecDirect(hstmt, (uchar *) stmt, SQL_NTS);
+		else
+			rc = SQLExecute(hstmt);
+		if (!rc) {
+			count = 0;
+			rc = SQLRowCount(hstmt, &count);
+			rv_lastNrows += count;
+		}
+		if (errorTrap(0))
+			goto done;
+	}
+
+	if (sql_debug)
+		appendFile(sql_debuglog, "%d rows affected", rv_lastNrows);
+	if (sql_debug2)
+		printf("%ld rows affected\n", rv_lastNrows);
+	ok = true;
+
+done:
+	SQLFreeStmt(hstmt, SQL_RESET_PARAMS);
+	if (sets > 1)
+		SQLSetStmtAttr(hstmt, SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER) 1,
+			       0);
+	if (openfirst)
+		SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+	nzFree(buf);
+	nzFree(ind);
+	exclist = 0;
+	return ok;
+}				/* sql_execBound */
+
+/*********************************************************************
+Block fetch.  Rather than one SQLFetch and a SQLGetData per column
+for every row, bind each column to an array, column-wise,
+and let the driver hand back a block of rows at a time.
+sql_fetchBlock() returns the number of rows in the block, 0 at the end,
+or -1 on error, and sql_blockRow() moves one of those rows into rv_data,
+just as sql_fetchNext() would have.
+Blob columns are not bound, and come back null;
+fetch row by row if you want the blobs.
+*********************************************************************/
+
+/* don't let the arrays grow beyond this many bytes */
+#define BLOCKBYTES 4000000
+
+/* bytes per row for a column in the block */
+static int blockWidth(char type, int width)
+{
+	switch (type) {
+	case 'S':
+/* width is in characters, which could be up to 4 bytes each in utf8 */
+		width *= 4;
+		if (width > STRINGLEN)
+			width = STRINGLEN;
+		return width + 1;
+	case 'C':
+		return 2;
+	case 'F':
+	case 'M':
+		return sizeof(double);
+	case 'N':
+		return sizeof(SQLINTEGER);
+	case 'D':
+		return 11;
+	case 'I':
+		return 10;
+	}			/* switch */
+	return 0;
+}				/* blockWidth */
+
+static short blockCType(char type)
+{
+	switch (type) {
+	case 'F':
+	case 'M':
+		return SQL_C_DOUBLE;
+	case 'N':
+		return SQL_C_SLONG;
+	case 'B':
+	case 'T':
+		return 0;
+	}			/* switch */
+	return SQL_C_CHAR;
+}				/* blockCType */
+
+/* unbind the arrays and go back to fetching one row at a time */
+static void blockRelease(struct OCURS *o)
+{
+	if (!o->block)
+		return;
+	SQLFreeStmt(o->hstmt, SQL_UNBIND);
+	SQLSetStmtAttr(o->hstmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER) 1, 0);
+	SQLSetStmtAttr(o->hstmt, SQL_ATTR_ROWS_FETCHED_PTR, 0, 0);
+	nzFree(o->block);
+	o->block = 0;
+	nzFree(o->blockind);
+	o->blockind = 0;
+	o->blocksize = 0;
+	o->blockrows = 0;
+}				/* blockRelease */
+
+static bool blockBind(struct OCURS *o, int nrows)
+{
+	int i, w, offset = 0;
+	long rowsize = 0;
+	short c_type;
+
+	for (i = 0; i < rv_numRets; ++i)
+		rowsize += blockWidth(rv_type[i], o->width[i]);
+	if (nrows < 1)
+		nrows = 1;
+	if (rowsize && rowsize * nrows > BLOCKBYTES)
+		nrows = BLOCKBYTES / rowsize;
+	if (!nrows)
+		nrows = 1;
+
+	stmt_text = "bind block";
+	debugStatement();
+	if (sql_debug)
+		appendFile(sql_debuglog, "%d rows per block", nrows);
+
+/* each column array starts on an 8 byte boundary, for the doubles */
+	for (i = 0; i < rv_numRets; ++i) {
+		o->blockoff[i] = offset;
+		w = blockWidth(rv_type[i], o->width[i]) * nrows;
+		offset += (w + 7) & ~7;
+	}
+	o->block = allocMem(offset + 8);
+	o->blockind = allocMem(sizeof(SQLLEN) * rv_numRets * nrows);
+	o->blocksize = nrows;
+	o->blockrows = 0;
+
+	hstmt = o->hstmt;
+	rc = SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_BIND_TYPE,
+			    (SQLPOINTER) SQL_BIND_BY_COLUMN, 0);
+	if (!rc)
+		rc = SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_ARRAY_SIZE,
+				    (SQLPOINTER) (SQLULEN) nrows, 0);
+	if (!rc)
+		rc = SQLSetStmtAttr(hstmt, SQL_ATTR_ROWS_FETCHED_PTR,
+				    &o->blockrows, 0);
+	for (i = 0; !rc && i < rv_numRets; ++i) {
+		c_type = blockCType(rv_type[i]);
+		if (!c_type)
+			continue;
+		rc = SQLBindCol(hstmt, (ushort) (i + 1), c_type,
+				o->block + o->blockoff[i],
+				blockWidth(rv_type[i], o->width[i]),
+				o->blockind + i * nrows);
+	}
+	if (errorTrap(0)) {
+		blockRelease(o);
+		return false;
+	}
+	return true;
+}				/* blockBind */
+
+int sql_fetchBlock(int cid, int nrows)
+{
+	struct OCURS *o = findCursor(cid);
+
+	if (o->flag != CURSOR_OPENED)
+		errorPrint("2cannot fetch from cursor %d, not yet opened", cid);
+	if (!o->block && !blockBind(o, nrows))
+		goto abort;
+
+	stmt_text = "fetch block";
+	debugStatement();
+	hstmt = o->hstmt;
+	o->blockrows = 0;
+	rc = SQLFetch(hstmt);
+	if (rc == SQL_NO_DATA) {
+		blockRelease(o);
+		exclist = 0;
+		return 0;
+	}
+/* string truncation is not an error, retsFromOdbc doesn't complain either */
+	if (errorTrap("01004")) {
+		blockRelease(o);
+		goto abort;
+	}
+	o->rownum += o->blockrows;
+	exclist = 0;
+	return o->blockrows;
+
+abort:
+	exclist = 0;
+	return -1;
+}				/* sql_fetchBlock */
+
+void sql_blockRow(int cid, int row)
+{
+	struct OCURS *o = findCursor(cid);
+	int i;
+	char *p;
+	bool isnull;
+
+	if (!o->block || row < 0 || row >= (int)o->blockrows)
+		errorPrint("@sql_blockRow, row %d is not in the current block",
+			   row);
+	rv_blobLoc = 0;
+	rv_blobSize = nullint;
+
+	for (i = 0; i < rv_numRets; ++i) {
+		p = o->block + o->blockoff[i] +
+		    row * blockWidth(rv_type[i], o->width[i]);
+		isnull = (o->blockind[i * o->blocksize + row] == SQL_NULL_DATA);
+		if (isnull && blockCType(rv_type[i]) == SQL_C_CHAR)
+			*p = 0;
+
+		switch (rv_type[i]) {
+		case 'S':
+			trimWhite(p);
+			rv_data[i].ptr = p;
+			break;
+
+		case 'C':
+			rv_data[i].l = (*p == ' ' ? 0 : (uchar) * p);
+			break;
+
+		case 'F':
+			rv_data[i].f = (isnull ? nullfloat : *(double *)p);
+			break;
+
+		case 'N':
+			rv_data[i].l = (isnull ? nullint : *(SQLINTEGER *) p);
+			break;
+
+		case 'M':
+			rv_data[i].l = (isnull ? nullint : pennies(*(double *)p));
+			break;
+
+		case 'D':
+			trimWhite(p);
+			rv_data[i].l = dateFromOdbc(p);
+			break;
+
+		case 'I':
+			trimWhite(p);
+			rv_data[i].l = timeFromOdbc(p);
+			break;
+
+		default:	/* blobs */
+			rv_data[i].l = nullint;
+		}		/* switch */
+	}
+}				/* sql_blockRow */
+
 /*********************************************************************
 Prepare, open, close, and free SQL cursors.
 *********************************************************************/
@@ -1487,6 +1935,7 @@ static int prepareCursor(const char *stmt, bool scrollflag)
 		return -1;
 	o->numrets = rv_numRets;
 	memcpy(o->rv_type, rv_type, NUMRETS);
+	memcpy(o->width, colwidth, sizeof(colwidth));
 	o->flag = (openfirst ? CURSOR_OPENED : CURSOR_PREPARED);
 	o->rownum = 0;
 	return o->cid;
@@ -1572,6 +2021,7 @@ void sql_close(int cid)
 
 	stmt_text = "close";
 	debugStatement();
+	blockRelease(o);
 	hstmt = o->hstmt;
 	rc = SQLCloseCursor(hstmt);
 	if (errorTrap(0))
@@ -717,38 +717,25 @@ static void pushQuoted(char **s, int *slen, const char *value, int colno)
 
 static char *lineFields[MAXTCOLS];
 
-static char *keysQuoted(void)
+/* Append the where clause on the key columns, with placeholders,
+ * and push the key values from lineFields, and their types,
+ * onto the parameters for sql_execBound(). */
+static void keysBound(char **s, int *slen, char *ptypes, const char **vals,
+		      int *nvals)
 {
-	char *u;
-	int ulen;
-	int key1 = td->key1, key2 = td->key2;
-	int key3 = td->key3;
-	if (!key1)
-		return 0;
-	u = initString(&ulen);
-	--key1;
-	stringAndString(&u, &ulen, "where ");
-	stringAndString(&u, &ulen, td->cols[key1]);
-	stringAndString(&u, &ulen, " = ");
-	pushQuoted(&u, &ulen, lineFields[key1], key1);
-	if (!key2)
-		return u;
-
-	--key2;
-	stringAndString(&u, &ulen, " and ");
-	stringAndString(&u, &ulen, td->cols[key2]);
-	stringAndString(&u, &ulen, " = ");
-	pushQuoted(&u, &ulen, lineFields[key2], key2);
-	if (!key3)
-		return u;
-
-	--key3;
-	stringAndString(&u, &ulen, " and ");
-	stringAndString(&u, &ulen, td->cols[key3]);
-	stringAndString(&u, &ulen, " = ");
-	pushQuoted(&u, &ulen, lineFields[key3], key3);
-	return u;
-}				/* keysQuoted */
+	int keys[3], j, k;
+	keys[0] = td->key1, keys[1] = td->key2, keys[2] = td->key3;
+	for (j = 0; j < 3 && keys[j]; ++j) {
+		k = keys[j] - 1;
+		stringAndString(s, slen, (j ? " and " : " where "));
+		stringAndString(s, slen, td->cols[k]);
+		stringAndString(s, slen, " = ?");
+		ptypes[*nvals] = td->types[k];
+		vals[*nvals] = lineFields[k];
+		++*nvals;
+	}
+	ptypes[*nvals] = 0;
+}				/* keysBound */
 
 static void buildSelectClause(void)
 {
@@ -1033,17 +1020,107 @@ void showForeign(void)
 	fetchForeign(td->name);
 }				/* showForeign */
 
+/* Append the row in rv_data onto the buffer, in unload format.
+ * This is sql_mkunld('|') without the intermediate string,
+ * and with the checks for pipes and newlines folded in. */
+static bool unloadRow(char **rbuf, int *rbuflen)
+{
+	int i;
+	long n;
+	double f;
+	char *s, *r;
+	char fbuf[60];
+
+	for (i = 0; i < rv_numRets; ++i) {
+		if (i)
+			stringAndChar(rbuf, rbuflen, '|');
+		n = rv_data[i].l;
+		switch (rv_type[i]) {
+		case 'S':
+			s = rv_data[i].ptr;
+			if (isnullstring(s))
+				break;
+			if ((r = strpbrk(s, "|\n"))) {
+				setError(*r == '|' ? MSG_DBPipes : MSG_DBNewline);
+				return false;
+			}
+			stringAndString(rbuf, rbuflen, s);
+			break;
+
+		case 'C':
+			if (!n)
+				break;
+			if (n == '|' || n == '\n') {
+				setError(n == '|' ? MSG_DBPipes : MSG_DBNewline);
+				return false;
+			}
+			stringAndChar(rbuf, rbuflen, n);
+			break;
+
+		case 'D':
+			if (isnotnull(n))
+				stringAndString(rbuf, rbuflen,
+						dateString(n, DTDELIMIT));
+			break;
+
+		case 'I':
+			if (isnotnull(n))
+				stringAndString(rbuf, rbuflen,
+						timeString(n, DTDELIMIT));
+			break;
+
+		case 'F':
+			f = rv_data[i].f;
+			if (isnullfloat(f))
+				break;
+			snprintf(fbuf, sizeof(fbuf), "%f", f);
+/* show float as an integer, if it is an integer, as lineFormat does */
+			r = strchr(fbuf, '.');
+			if (r) {
+				s = r;
+				while (*++s == '0') ;
+				if (!*s)
+					*r = 0;
+			}
+			stringAndString(rbuf, rbuflen, fbuf);
+			break;
+
+		default:	/* N M B T */
+			if (isnotnull(n))
+				stringAndNum(rbuf, rbuflen, n);
+		}		/* switch */
+	}
+
+	stringAndChar(rbuf, rbuflen, '\n');
+	return true;
+}				/* unloadRow */
+
 /* Select rows of data and put them into the text buffer */
 static bool rowsIntoBuffer(int cid, const char *types, char **bufptr, int *lcnt)
 {
 	char *rbuf, *unld, *u, *v, *s, *end;
-	int rbuflen;
+	int rbuflen, nrows, j;
 	bool rc = false;
 
 	*bufptr = emptyString;
 	*lcnt = 0;
 	rbuf = initString(&rbuflen);
 
+/* Fetch in blocks, unless we need the blobs, which come a row at a time. */
+	if (sqlFetchRows > 1 && !(fetchBlobColumns && strpbrk(types, "BT"))) {
+		while ((nrows = sql_fetchBlock(cid, sqlFetchRows)) > 0) {
+			for (j = 0; j < nrows; ++j) {
+				sql_blockRow(cid, j);
+				if (!unloadRow(&rbuf, &rbuflen))
+					goto abort;
+				++*lcnt;
+			}
+		}
+		if (nrows == 0)
+			rc = true;
+		goto abort;
+	}
+
 	while (sql_fetchNext(cid, 0)) {
 		unld = sql_mkunld('\177');
 		if (strchr(unld, '|')) {
@@ -1245,13 +1322,19 @@ bool sqlDelRows(int start, int end)
  * I have to write the one-line-at-a-time code anyways,
  * I'll just use that for now. */
 	while (ndel--) {
-		char *wherekeys;
+		char *stmt;
+		int stmtlen, nvals = 0;
+		char ptypes[4];
+		const char *vals[3];
 		char *line = (char *)fetchLine(ln, 0);
 		intoFields(line);
-		wherekeys = keysQuoted();
+		stmt = initString(&stmtlen);
+		stringAndString(&stmt, &stmtlen, "delete from ");
+		stringAndString(&stmt, &stmtlen, td->name);
+		keysBound(&stmt, &stmtlen, ptypes, vals, &nvals);
 		sql_exclist(insupdExceptions);
-		sql_exec("delete from %s %s", td->name, wherekeys);
-		nzFree(wherekeys);
+		sql_execBound(stmt, ptypes, vals, 1);
+		nzFree(stmt);
 		nzFree(line);
 		if (!insupdError(0, 1))
 			return false;
@@ -1264,11 +1347,14 @@ bool sqlDelRows(int start, int end)
 bool sqlUpdateRow(pst source, int slen, pst dest, int dlen)
 {
 	char *d2;		/* clone of dest */
-	char *wherekeys;
 	char *s, *t;
 	int j, l1, l2, nkeys, key1, key2;
-	char *u1;		/* column=value of the update statement */
+	char *u1;		/* the update statement */
 	int u1len;
+/* the changed values, then the keys, bound to the placeholders */
+	char ptypes[MAXTCOLS + 4];
+	const char *vals[MAXTCOLS + 3];
+	int nvals = 0;
 
 /* compare all the way out to newline, so we know both strings end at the same time */
 	if (slen == dlen && !memcmp(source, dest, slen + 1))
@@ -1291,6 +1377,9 @@ bool sqlUpdateRow(pst source, int slen, pst dest, int dlen)
 
 	j = 0;
 	u1 = initString(&u1len);
+	stringAndString(&u1, &u1len, "update ");
+	stringAndString(&u1, &u1len, td->name);
+	stringAndString(&u1, &u1len, " set ");
 	s = (char *)source;
 
 	while (1) {
@@ -1310,11 +1399,12 @@ bool sqlUpdateRow(pst source, int slen, pst dest, int dlen)
 				setError(MSG_DBChangeText);
 				goto abort;
 			}
-			if (*u1)
+			if (nvals)
 				stringAndString(&u1, &u1len, ", ");
 			stringAndString(&u1, &u1len, td->cols[j]);
-			stringAndString(&u1, &u1len, " = ");
-			pushQuoted(&u1, &u1len, lineFields[j], j);
+			stringAndString(&u1, &u1len, " = ?");
+			ptypes[nvals] = td->types[j];
+			vals[nvals++] = lineFields[j];
 		}
 
 		if (*t == '\n')
@@ -1323,10 +1413,9 @@ bool sqlUpdateRow(pst source, int slen, pst dest, int dlen)
 		++j;
 	}
 
-	wherekeys = keysQuoted();
+	keysBound(&u1, &u1len, ptypes, vals, &nvals);
 	sql_exclist(insupdExceptions);
-	sql_exec("update %s set %s %s", td->name, u1, wherekeys);
-	nzFree(wherekeys);
+	sql_execBound(u1, ptypes, vals, 1);
 	if (!insupdError(2, 1))
 		goto abort;
 
@@ -1340,13 +1429,68 @@ abort:
 	return false;
 }				/* sqlUpdateRow */
 
+/* Insert the rows that have been entered, and add them to the buffer.
+ * Several rows go in as one array, in one transaction.
+ * If that fails, go back and insert them one at a time,
+ * so the errors are reported against the rows that caused them.
+ * The fields and lines are freed. */
+static bool insertRows(const char *stmt, const char *ptypes, char **vals,
+		       char **lines, int nrows, int *ln)
+{
+	int i, j, nfields = strlen(ptypes);
+	bool ok = false, rc = true;
+
+	if (nrows > 1) {
+		sql_begTrans();
+		if (!rv_lastStatus) {
+			sql_exclist(insupdExceptions);
+			ok = sql_execBound(stmt, ptypes, (const char **)vals,
+					   nrows);
+			if (ok) {
+				sql_commitWork();
+				ok = !rv_lastStatus;
+			}
+			if (!ok)
+				sql_rollbackWork();
+		}
+	}
+
+	for (i = 0; i < nrows; ++i) {
+		if (!ok) {
+			sql_exclist(insupdExceptions);
+			sql_execBound(stmt, ptypes,
+				      (const char **)vals + i * nfields, 1);
+			if (!insupdError(1, 1)) {
+				printf("Error: ");
+				showError();
+				goto next;
+			}
+		}
+/* We don't fetch the row back; don't know how to do that without rowid. */
+		if (rc) {
+			rc = addTextToBuffer((pst) lines[i], strlen(lines[i]),
+					     *ln, false);
+			++*ln;
+		}
+next:
+		for (j = 0; j < nfields; ++j)
+			nzFree(vals[i * nfields + j]);
+		nzFree(lines[i]);
+	}
+
+	return rc;
+}				/* insertRows */
+
 bool sqlAddRows(int ln)
 {
-	char *u1, *u2;		/* pieces of the insert statement */
+	char *stmt;		/* the insert statement, with placeholders */
+	char ptypes[MAXTCOLS + 1];
+	char **vals;		/* fields of the rows waiting to go in */
+	char **lines;		/* and the same rows with pipes, for the buffer */
 	char *u3;		/* line with pipes */
-	char *unld, *s;
-	int u1len, u2len, u3len;
-	int j, l;
+	char *s;
+	int stmtlen, u3len;
+	int j, k, l, nfields, nrows, batch;
 	double dv;
 	char inp[256];
 	bool rc;
@@ -1354,10 +1498,37 @@ bool sqlAddRows(int ln)
 	if (!setTable())
 		return false;
 
+/* The insert statement is the same for every row, only the values change,
+ * so build it once, and the database layer keeps it prepared. */
+	stmt = initString(&stmtlen);
+	stringAndString(&stmt, &stmtlen, "insert into ");
+	stringAndString(&stmt, &stmtlen, td->name);
+	stringAndString(&stmt, &stmtlen, " (");
+	for (j = nfields = 0; j < td->ncols; ++j) {
+		if (strchr("BT", td->types[j]))
+			continue;
+		if (nfields)
+			stringAndChar(&stmt, &stmtlen, ',');
+		stringAndString(&stmt, &stmtlen, td->cols[j]);
+		ptypes[nfields++] = td->types[j];
+	}
+	ptypes[nfields] = 0;
+	stringAndString(&stmt, &stmtlen, ") values (");
+	for (j = 0; j < nfields; ++j)
+		stringAndString(&stmt, &stmtlen, (j ? ",?" : "?"));
+	stringAndChar(&stmt, &stmtlen, ')');
+
+/* Rows typed at the terminal go in as they are entered,
+ * rows from a script or a pipe go in a block at a time. */
+	batch = (isInteractive ? 1 : sqlFetchRows);
+	vals = allocZeroMem(sizeof(char *) * nfields * batch);
+	lines = allocZeroMem(sizeof(char *) * batch);
+	nrows = 0;
+	rc = true;
+
 	while (1) {
-		u1 = initString(&u1len);
-		u2 = initString(&u2len);
 		u3 = initString(&u3len);
+		k = nrows * nfields;
 
 		for (j = 0; j < td->ncols; ++j) {
 reenter:
@@ -1367,16 +1538,18 @@ reenter:
 			fflush(stdout);
 			if (!fgets(inp, sizeof(inp), stdin)) {
 				puts("EOF");
+				insertRows(stmt, ptypes, vals, lines, nrows,
+					   &ln);
 				ebClose(1);
 			}
 			l = strlen(inp);
 			if (l && inp[l - 1] == '\n')
 				inp[--l] = 0;
 			if (stringEqual(inp, ".")) {
-				nzFree(u1);
-				nzFree(u2);
+				while (k > nrows * nfields)
+					nzFree(vals[--k]);
 				nzFree(u3);
-				return true;
+				goto done;
 			}
 
 			if (inp[0] == 0) {
@@ -1434,7 +1607,25 @@ goodfield:
 /* turn 0 into next serial number */
 			if (j == td->key1 - 1 && td->types[j] == 'N' &&
 			    stringEqual(inp, "0")) {
-				int nextkey =
+				int nextkey;
+/* max() has to see the rows that are waiting to go in */
+				if (nrows) {
+					int m = k - nrows * nfields;
+					char **v = vals + nrows * nfields;
+					if (!insertRows(stmt, ptypes, vals,
+							lines, nrows, &ln))
+						rc = false;
+					nrows = 0;
+					memmove(vals, v, m * sizeof(char *));
+					k = m;
+					if (!rc) {
+						while (k)
+							nzFree(vals[--k]);
+						nzFree(u3);
+						goto done;
+					}
+				}
+				nextkey =
 				    sql_selectOne("select max(%s) from %s",
 						  td->cols[j], td->name);
 				if (isnull(nextkey)) {
@@ -1444,53 +1635,29 @@ goodfield:
 				sprintf(inp, "%d", nextkey + 1);
 			}
 
-			if (*u1)
-				stringAndChar(&u1, &u1len, ',');
-			stringAndString(&u1, &u1len, td->cols[j]);
-
-			if (*u2)
-				stringAndChar(&u2, &u2len, ',');
-			pushQuoted(&u2, &u2len, inp, j);
-
+			vals[k++] = cloneString(inp);
 			stringAndString(&u3, &u3len, inp);
 			stringAndChar(&u3, &u3len, '|');
 		}
 
-		sql_exclist(insupdExceptions);
-		sql_exec("insert into %s (%s) values (%s)", td->name, u1, u2);
-		nzFree(u1);
-		nzFree(u2);
-		if (!insupdError(1, 1)) {
-			nzFree(u3);
-			printf("Error: ");
-			showError();
+		l = strlen(u3);
+		u3[l - 1] = '\n';	/* overwrite the last pipe */
+		lines[nrows++] = u3;
+		if (nrows < batch)
 			continue;
-		}
-#if 0
-/* Fetch the row just entered. */
-/* Don't know how to do this without rowid. */
-		rowid = rv_lastRowid;
-		buildSelectClause();
-		sql_select("%s where rowid = %d", scl, rowid, 0);
-		nzFree(scl);
-		unld = sql_mkunld('|');
-		l = strlen(unld);
-		unld[l - 1] = '\n';	/* overwrite the last pipe */
-#else
-		unld = u3;
-		l = strlen(unld);
-		unld[l - 1] = '\n';	/* overwrite the last pipe */
-#endif
-
-		rc = addTextToBuffer((pst) unld, l, ln, false);
-		nzFree(u3);
+		rc = insertRows(stmt, ptypes, vals, lines, nrows, &ln);
+		nrows = 0;
 		if (!rc)
-			return false;
-		++ln;
+			goto done;
 	}
 
-/* This pointis not reached; make the compilerhappy */
-	return true;
+done:
+	if (rc)
+		rc = insertRows(stmt, ptypes, vals, lines, nrows, &ln);
+	nzFree(vals);
+	nzFree(lines);
+	nzFree(stmt);
+	return rc;
 }				/* sqlAddRows */
 
 /*********************************************************************
@@ -26,28 +26,78 @@ static void pushAttributes(const Tag *t);
 
 static bool treeOverflow;
 
-static void traverseNode(Tag *node)
-{
-	Tag *child;
+/*********************************************************************
+Walk the tree without recursion; a page with thousands of nested divs
+would otherwise run us off the end of the stack.
+Each frame on our own stack is an open node and the child we are on.
+The next child is fetched after the previous subtree is finished,
+as the recursive version did, so callbacks can rearrange the nodes
+below them, or add children to a node they are closing.
+A callback could start another traversal, by way of innerHTML,
+so the stack belongs to the walk, not to the file.
+*********************************************************************/
+
+struct travFrame {
+	Tag *node, *child;
+};
+
+struct travStack {
+	struct travFrame *frames;
+	int max;
+};
 
+static bool visitNode(Tag *node)
+{
 	if (node->visited) {
 		treeOverflow = true;
 		debugPrint(4, "node revisit %s %d", node->info->name,
 			   node->seqno);
-		return;
+		return false;
 	}
 	node->visited = true;
-
 	(*traverse_callback) (node, true);
-	for (child = node->firstchild; child; child = child->sibling)
-		traverseNode(child);
-	(*traverse_callback) (node, false);
+	return true;
+}
+
+static void traverseNode(Tag *node, struct travStack *ts)
+{
+	int depth = 0;
+	struct travFrame *top;
+	Tag *child;
+
+	if (!visitNode(node))
+		return;
+	top = ts->frames;
+	top->node = node, top->child = 0;
+
+	while (true) {
+		child = (top->child ? top->child->sibling : top->node->firstchild);
+		top->child = child;
+		if (!child) {
+			(*traverse_callback) (top->node, false);
+			if (!depth)
+				break;
+			top = ts->frames + --depth;
+			continue;
+		}
+		if (!visitNode(child))
+			continue;
+		if (++depth == ts->max) {
+			ts->max *= 2;
+			ts->frames =
+			    reallocMem(ts->frames,
+				       ts->max * sizeof(struct travFrame));
+		}
+		top = ts->frames + depth;
+		top->node = child, top->child = 0;
+	}
 }
 
 void traverseAll(int start)
 {
 	Tag *t;
 	int i;
+	struct travStack ts;
 
 	treeOverflow = false;
 	for (i = start; i < cw->numTags; ++i) {
@@ -55,13 +105,16 @@ void traverseAll(int start)
 		t->visited = false;
 	}
 
+	ts.max = 64;
+	ts.frames = allocMem(ts.max * sizeof(struct travFrame));
 	for (i = start; i < cw->numTags; ++i) {
 		t = tagList[i];
 		if (!t->parent && !t->slash && !t->dead) {
 			debugPrint(6, "traverse start at %s %d", t->info->name, t->seqno);
-			traverseNode(t);
+			traverseNode(t, &ts);
 		}
 	}
+	free(ts.frames);
 
 	if (treeOverflow)
 		debugPrint(3, "malformed tree!");
@@ -260,26 +313,22 @@ static void insert_tbody1(Tag *s1, Tag *s2,
 			  Tag *tbl);
 static bool tagBelow(Tag *t, int action);
 
-static void insert_tbody(int start)
+static void insert_tbody(Tag *tbl)
 {
-	int i, end = cw->numTags;
-	Tag *tbl, *s1, *s2;
+	Tag *s1, *s2;
 
-	for (i = start; i < end; ++i) {
-		tbl = tagList[i];
-		if (tbl->action != TAGACT_TABLE)
-			continue;
-		s1 = 0;
-		do {
-			s2 = (s1 ? s1->sibling : tbl->firstchild);
-			while (s2 && s2->action != TAGACT_TBODY
-			       && s2->action != TAGACT_THEAD
-			       && s2->action != TAGACT_TFOOT)
-				s2 = s2->sibling;
-			insert_tbody1(s1, s2, tbl);
-			s1 = s2;
-		} while (s1);
-	}
+	if (tbl->action != TAGACT_TABLE)
+		return;
+	s1 = 0;
+	do {
+		s2 = (s1 ? s1->sibling : tbl->firstchild);
+		while (s2 && s2->action != TAGACT_TBODY
+		       && s2->action != TAGACT_THEAD
+		       && s2->action != TAGACT_TFOOT)
+			s2 = s2->sibling;
+		insert_tbody1(s1, s2, tbl);
+		s1 = s2;
+	} while (s1);
 }
 
 static void insert_tbody1(Tag *s1, Tag *s2,
@@ -371,35 +420,31 @@ static bool tagBelow(Tag *t, int action)
 	return false;
 }
 
-static void emptyAnchors(int start)
+static void emptyAnchors(Tag *a0)
 {
-	int j;
-	Tag *a0, *div, *up;
+	Tag *div, *up;
 
-	for (j = start; j < cw->numTags; ++j) {
-		a0 = tagList[j];
-		if (a0->action != TAGACT_A || a0->firstchild)
-			continue;
+	if (a0->action != TAGACT_A || a0->firstchild)
+		return;
 // anchor no children
-		for (up = a0; up; up = up->parent)
-			if (up->sibling)
-				break;
-		if (!up || !(div = up->sibling) || div->action != TAGACT_DIV)
-			continue;
+	for (up = a0; up; up = up->parent)
+		if (up->sibling)
+			break;
+	if (!up || !(div = up->sibling) || div->action != TAGACT_DIV)
+		return;
 // div follows
 /* would moving this create nested anchors? */
-		if (tagBelow(div, TAGACT_A))
-			continue;
+	if (tagBelow(div, TAGACT_A))
+		return;
 /* shouldn't have inputs or forms in an anchor. */
-		if (tagBelow(div, TAGACT_INPUT))
-			continue;
-		if (tagBelow(div, TAGACT_FORM))
-			continue;
-		up->sibling = div->sibling;
-		a0->firstchild = div;
-		div->parent = a0;
-		div->sibling = 0;
-	}
+	if (tagBelow(div, TAGACT_INPUT))
+		return;
+	if (tagBelow(div, TAGACT_FORM))
+		return;
+	up->sibling = div->sibling;
+	a0->firstchild = div;
+	div->parent = a0;
+	div->sibling = 0;
 }
 
 /*********************************************************************
@@ -409,29 +454,25 @@ Check for an empty form beneath table, and move all the following siblings
 down into the form.
 *********************************************************************/
 
-static void tableForm(int start)
+static void tableForm(Tag *form)
 {
-	int j;
-	Tag *form, *table, *t;
+	Tag *table, *t;
 
-	for (j = start; j < cw->numTags; ++j) {
-		form = tagList[j];
-		if (form->action != TAGACT_FORM || form->firstchild)
-			continue;
-		t = form;
-		for (table = form->sibling; table; table = table->sibling) {
-			if (table->action == TAGACT_TABLE &&
-			    tagBelow(table, TAGACT_INPUT)) {
+	if (form->action != TAGACT_FORM || form->firstchild)
+		return;
+	t = form;
+	for (table = form->sibling; table; table = table->sibling) {
+		if (table->action == TAGACT_TABLE &&
+		    tagBelow(table, TAGACT_INPUT)) {
 /* table with inputs below; move it to form */
 /* hope this doesn't break anything */
-				table->parent = form;
-				form->firstchild = table;
-				t->sibling = table->sibling;
-				table->sibling = 0;
-				break;
-			}
-			t = table;
+			table->parent = form;
+			form->firstchild = table;
+			t->sibling = table->sibling;
+			table->sibling = 0;
+			break;
 		}
+		t = table;
 	}
 }
 
@@ -443,60 +484,57 @@ It may not be the right approach, but the easiest is to spin it off into
 three separate link tags with the appropriate urls.
 *********************************************************************/
 
-static void linkPipe(int start)
+static void linkPipe(Tag *l)
 {
-	int j, n, last = cw->numTags;
+	int n;
 	char *mark, *url, *follow, *a, *b;
 	const char *rel, *type;
-	Tag *l, *e;
+	Tag *e;
 
-	for (j = start; j < last; ++j) {
-		l = tagList[j];
-		if (l->action != TAGACT_LINK)
-			continue;
-		if(!l->href || !isURL(l->href) ||
-		!(mark = strchr(l->href, '|')))
-			continue;
-		rel = attribVal(l, "rel");
-		type = attribVal(l, "type");
-		if (!stringEqualCI(type, "text/css") &&
-		    !stringEqualCI(rel, "stylesheet"))
+	if (l->action != TAGACT_LINK)
+		return;
+	if(!l->href || !isURL(l->href) ||
+	!(mark = strchr(l->href, '|')))
+		return;
+	rel = attribVal(l, "rel");
+	type = attribVal(l, "type");
+	if (!stringEqualCI(type, "text/css") &&
+	    !stringEqualCI(rel, "stylesheet"))
 // not a stylesheet, it doesn't matter
-			continue;
-		e = l->sibling;
-		n = mark - l->href;
-		url = allocMem(n + 1);
-		strncpy(url, l->href, n);
-		url[n] = 0;
-		a = follow = cloneString(mark+1);
-		while(*a) {
-			char *resolve;
-			if((b = strchr(a, ',')))
-				*b = 0;
-			resolve = resolveURL(url, a);
-			if(a == follow) {
+		return;
+	e = l->sibling;
+	n = mark - l->href;
+	url = allocMem(n + 1);
+	strncpy(url, l->href, n);
+	url[n] = 0;
+	a = follow = cloneString(mark+1);
+	while(*a) {
+		char *resolve;
+		if((b = strchr(a, ',')))
+			*b = 0;
+		resolve = resolveURL(url, a);
+		if(a == follow) {
 // first one, just displace the href url
-				nzFree(l->href);
-				l->href = resolve;
-			} else {
-				Tag *t = newTag(cf, "link");
-				t->href = resolve;
-				if(rel)
-					setTagAttr(t, "rel", cloneString(rel));
-				if(type)
-					setTagAttr(t, "type", cloneString(type));
-				t->parent = l->parent;
-				t->sibling = e;
-				l->sibling = t;
-				l = t;
-			}
-			if(!b)
-				break;
-			a = b + 1;
+			nzFree(l->href);
+			l->href = resolve;
+		} else {
+			Tag *t = newTag(cf, "link");
+			t->href = resolve;
+			if(rel)
+				setTagAttr(t, "rel", cloneString(rel));
+			if(type)
+				setTagAttr(t, "type", cloneString(type));
+			t->parent = l->parent;
+			t->sibling = e;
+			l->sibling = t;
+			l = t;
 		}
-		free(url);
-		free(follow);
+		if(!b)
+			break;
+		a = b + 1;
 	}
+	free(url);
+	free(follow);
 }
 
 void formControl(Tag *t, bool namecheck)
@@ -930,14 +968,57 @@ static void prerenderNode(Tag *t, bool opentag)
 	}			/* switch */
 }
 
+/*********************************************************************
+The tidy workarounds above, all but nestedAnchors, look at one tag
+and its immediate surroundings, and don't care whether the others
+have run on the tags before it or after it.
+So they run together, in one sweep over the new tags,
+rather than a sweep apiece.
+nestedAnchors has to finish first, because emptyAnchors wants to see
+every anchor after it has been pulled up to its proper level.
+Tags created along the way, tbody or link, don't need fixing,
+so the sweep stops where it started.
+*********************************************************************/
+
+static void (*const fixups[]) (Tag *) = {
+	emptyAnchors, insert_tbody, tableForm, linkPipe, 0
+};
+
+static void fixupTree(int start)
+{
+	int j, k, end = cw->numTags;
+	Tag *t;
+
+	for (j = start; j < end; ++j) {
+		t = tagList[j];
+		for (k = 0; fixups[k]; ++k)
+			(*fixups[k]) (t);
+	}
+}
+
+/* time the passes over the tree, at debug level 4 */
+static double pass_t;
+static void passTime(const char *pass, int start)
+{
+	double t;
+	if (debugLevel < 4)
+		return;
+	t = secondsNow();
+	if (pass)
+		debugPrint(4, "%s %d tags %.3f ms", pass,
+			   cw->numTags - start, (t - pass_t) * 1000.0);
+	pass_t = t;
+}
+
 void prerender(int start)
 {
+	profStart(PROF_PRERENDER);
+	passTime(0, start);
 /* some cleanup routines to rearrange the tree */
 	nestedAnchors(start);
-	emptyAnchors(start);
-	insert_tbody(start);
-	tableForm(start);
-linkPipe(start);
+	passTime("nested anchors", start);
+	fixupTree(start);
+	passTime("tree fixups", start);
 
 	currentForm = currentSel = currentOpt = NULL;
 	currentTitle = currentScript = currentTA = NULL;
@@ -949,6 +1030,8 @@ linkPipe(start);
 	currentForm = NULL;
 	nzFree(radioCheck);
 	radioCheck = 0;
+	passTime("prerender", start);
+	profEnd(PROF_PRERENDER);
 }
 
 static char fakePropLast[24];
@@ -1529,8 +1612,12 @@ static void pushAttributes(const Tag *t)
 /* decorate the tree of nodes with js objects */
 void decorate(int start)
 {
+	profStart(PROF_DECORATE);
+	passTime(0, start);
 	traverse_callback = jsNode;
 	traverseAll(start);
+	passTime("decorate", start);
+	profEnd(PROF_DECORATE);
 }				/* decorate */
 
 /* paranoia check on the number of tags */
@@ -1878,12 +1965,14 @@ static const int tdb = 5;	// tree debug level
 
 void htmlNodesIntoTree(int start, Tag *attach)
 {
+	profStart(PROF_TREE);
 	treeAttach = attach;
 	tree_pos = start;
 	treeDisable = false;
 	debugPrint(tdb, "@@tree of nodes");
 	intoTree(0);
 	debugPrint(tdb, "}\n@@end tree");
+	profEnd(PROF_TREE);
 }				/* htmlNodesIntoTree */
 
 /* Convert a list of html nodes, properly nested open close, into a tree.
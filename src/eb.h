@@ -124,6 +124,19 @@ enum ej_proptype {
 enum { ENC_PLAIN, ENC_COMPRESS, ENC_GZIP, ENC_URL, ENC_MFD };
 enum { CT_OTHER, CT_TEXT, CT_HTML, CT_RICH, CT_APPLIC, CT_MULTI, CT_ALT };
 enum { CE_7BIT, CE_8BIT, CE_QP, CE_64 };
+/* stages of loading a web page, for the timestamps in html.c */
+enum { LOAD_START, LOAD_FIRSTBYTE, LOAD_BODY, LOAD_PARSE, LOAD_TREE,
+	LOAD_SCRIPTS, LOAD_RENDER, LOAD_FIRSTLINE, LOAD_STAGES };
+/* phases of loading and running a web page, timed by profStart/profEnd */
+enum { PROF_HTTP, PROF_PARSE, PROF_TREE, PROF_PRERENDER, PROF_DECORATE,
+	PROF_SCRIPTS, PROF_CSS, PROF_RENDER, PROF_REFORMAT, PROF_RERENDER,
+	PROF_PHASES };
+struct PROFILE {
+	double ms[PROF_PHASES];	/* milliseconds in each phase */
+	int calls[PROF_PHASES];
+	double load;		/* from the b command to the first line */
+};
+extern const char *const profNames[];	/* the phases, for reports */
 
 /* This program was originally written in perl.
  * So I got use to perl strings, which admit nulls.
@@ -224,6 +237,8 @@ struct i_get {
 	bool cacheable;
 	bool last_curlin;
 	bool move_capable;
+	bool condstore_capable;
+	bool pipeline; // parse the html as it comes in
 	char error[CURL_ERROR_SIZE + 1];
 	long code;		/* example, 404 */
 /* an assortment of variables that are gleaned from the incoming http headers */
@@ -330,11 +345,13 @@ extern char *ebTempDir;		/* edbrowse temp, such as /tmp/.edbrowse */
 extern char *ebUserDir;		/* $ebTempDir/nnn user ID appended */
 extern char *dbarea, *dblogin, *dbpw;	/* to log into the database */
 extern bool fetchBlobColumns;
+extern int sqlFetchRows;	/* rows per block, reading or adding to a table */
 extern bool caseInsensitive, searchStringsAll, searchWrap;
 extern bool allowRedirection;	/* from http code 301, or http refresh */
 extern bool sendReferrer;	/* in the http header */
 extern bool allowJS;		/* javascript on */
 extern bool blockJS; // javascript is blocked
+extern bool nativeParser;	/* built in html parser rather than tidy */
 extern bool htmlGenerated;
 extern bool ftpActive;
 extern bool helpMessagesOn;	/* no need to type h */
@@ -376,9 +393,20 @@ struct lineMap {
 	char ds1, ds2;		/* directory suffix */
 	bool gflag;		/* for g// */
 	char filler;
+/* Length of text, including its newline, or 0 if not yet known.
+ * This sits in what would be padding, so the map is no larger.
+ * Set it to 0 whenever text changes, or use lineLength(). */
+	int len;
 };
 #define LMSIZE sizeof(struct lineMap)
 
+/* what fileTypeByName learns about a file, kept for later */
+struct FILESTAT {
+	struct stat st;
+	char ftype;		/* f d b c p s, or 0 if inaccessible */
+	bool waslink, brokenlink;
+};
+
 /* an edbrowse frame, as when there are many frames in an html page.
  * There could be several frames in an edbrowse window or buffer, chained
  * together in a linked list, but usually there is just one, as when editing
@@ -440,6 +468,7 @@ struct ebWindow {
 	char *htmltitle, *htmldesc, *htmlkey;	/* title, description, keywords */
 	char *saveURL;		// for the fu command
 	char *mailInfo;
+	struct PROFILE *prof;	/* where the time went, for the prof command */
 	char lhs[MAXRE], rhs[MAXRE];	/* remembered substitution strings */
 	struct lineMap *map, *r_map;
 /* The labels that you set with the k command, and access via 'x.
@@ -476,10 +505,17 @@ struct ebWindow {
 	bool changeMode:1;	/* something has changed in this file */
 	bool quitMode:1;	/* you can quit this buffer any time */
 	bool dirMode:1;		/* directory mode */
+	bool dirSorted:1;	/* dirSort and dirReverse were recorded */
+	bool dirReverse:1;	/* ls_reverse when the directory was read */
 	bool undoable:1;	/* undo is possible */
 	bool sqlMode:1;		// accessing a table
+	bool diskMode:1;	/* text is just as it was read from f0.fileName */
 	struct DBTABLE *table;	/* if in sqlMode */
+	char dirSort;		/* ls_sort when the directory was read */
 	time_t nextrender;
+/* modification time and size of that file, when it was read */
+	time_t diskTime;
+	off_t diskSize;
 };
 extern struct ebWindow *cw;	/* current window */
 #define foregroundWindow (cw == sessionList[context].lw)
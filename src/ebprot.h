@@ -60,6 +60,7 @@ void scanMail(void);
 bool emailTest(void);
 void mail64Error(int err);
 char *emailParse(char *buf);
+char *emailParseFile(const char *filename);
 bool setupReply(bool all);
 
 /* sourcefile=format.c */
@@ -72,17 +73,24 @@ void extractEmailAddresses(char *line);
 void cutDuplicateEmails(char *tolist, char *cclist, const char *reply);
 bool isEmailAddress(const char *s);
 int byteOrderMark(const uchar *buf, int buflen);
+void textClassify(const uchar *buf, int buflen, bool * bin_p, bool * iso_p, bool * utf8_p);
 bool looksBinary(const unsigned char *buf, int buflen);
 void looks_8859_utf8(const uchar *buf, int buflen, bool * iso_p, bool * utf8_p);
+int iso2utfChunk(const uchar *inbuf, int inbuflen, uchar *outbuf);
 void iso2utf(const uchar *inbuf, int inbuflen, uchar **outbuf_p, int *outbuflen_p);
+int utf2isoChunk(const uchar *inbuf, int inbuflen, uchar *outbuf, int *used, bool last);
 void utf2iso(const uchar *inbuf, int inbuflen, uchar **outbuf_p, int *outbuflen_p);
+int utfHighChunk(const char *inbuf, int inbuflen, char *outbuf_c, int *used, bool last, bool inutf8, bool out32, bool outbig);
 void utfHigh(const char *inbuf, int inbuflen, char **outbuf_p, int *outbuflen_p, bool inutf8, bool out32, bool outbig);
 char *uni2utf8(unsigned int unichar);
+int utfLowChunk(const char *inbuf, int inbuflen, char *outbuf_c, int *used, bool last, int bom);
 void utfLow(const char *inbuf, int inbuflen, char **outbuf_p, int *outbuflen_p, int bom);
+int utfLowFile(const char *filename, char **data, int *len);
 char *force_utf8( char *buf, int buflen);
 char *base64Encode(const char *inbuf, int inlen, bool lines);
 uchar base64Bits(char c);
 int base64Decode(char *start, char **end);
+char *qpDecode(char *start, char *end);
 void iuReformat(const char *inbuf, int inbuflen, char **outbuf_p, int *outbuflen_p);
 bool parseDataURI(const char *uri, char **mediatype, char **data, int *data_l);
 uchar fromHex(char d, char e) ;
@@ -100,6 +108,15 @@ void prepareScript(Tag *t);
 bool isRooted(const Tag *t);
 void runScriptsPending(bool startbrowse);
 void preFormatCheck(int tagno, bool * pretag, bool * slash) ;
+void loadStamp(int stage);
+void loadReport(void);
+void profStart(int phase);
+void profEnd(int phase);
+bool profShow(const char *csvfile);
+void pipelineDrop(void);
+void pipelineStart(void);
+void pipelineChunk(const char *s, int len);
+void pipelineEnd(void);
 char *htmlParse(char *buf, int remote) ;
 bool htmlTest(void) ;
 void infShow(int tagno, const char *search) ;
@@ -125,6 +142,12 @@ const char *findHeading(Tag *t, int colno);
 /* sourcefile=html-tidy.c */
 void html2nodes(const char *htmltext, bool startpage);
 
+/* sourcefile=html-native.c */
+void htmlStreamStart(bool startpage);
+void htmlStreamChunk(const char *s, int len);
+void htmlStreamEnd(void);
+void html2nodesNative(const char *htmltext, bool startpage);
+
 /* sourcefile=decorate.c */
 void traverseAll(int start);
 const char *attribVal(const Tag *t, const char *name);
@@ -183,6 +206,7 @@ bool runEbFunction(const char *line);
 struct DBTABLE *findTableDescriptor(const char *sn);
 struct DBTABLE *newTableDescriptor(const char *name);
 void readConfigFile(void);
+void setupEdbrowse(void);
 const char *fetchReplace(const char *u);
 
 /* sourcefile=plugin.c */
@@ -278,7 +302,14 @@ void setDebugFile(const char *name); //@
 void nl(void) ;
 int perl2c(char *t) ;
 unsigned pstLength(pst s) ;
+unsigned lineLength(struct lineMap *t) ;
 pst clonePstring(pst s) ;
+pst allocLine(unsigned len) ;
+pst reallocLine(pst p, unsigned len) ;
+pst cloneLine(pst s, unsigned len) ;
+pst shareLine(pst p) ;
+void releaseLine(pst p) ;
+pst ownLine(pst p) ;
 void copyPstring(pst s, const pst t) ;
 bool fdIntoMemory(int fd, char **data, int *len) ;
 bool fileIntoMemory(const char *filename, char **data, int *len) ;
@@ -286,11 +317,14 @@ bool memoryOutToFile(const char *filename, const char *data, int len, int msgcre
 void truncate0(const char *filename, int fh);
 void caseShift(char *s, char action) ;
 void camelCase(char *s);
+char fileTypeByStat(const struct FILESTAT *fs, bool showlink);
 char fileTypeByName(const char *name, bool showlink) ;
+void statFileList(const char **names, int count, struct FILESTAT *out);
 char fileTypeByHandle(int fd) ;
 off_t fileSizeByName(const char *name) ;
 off_t fileSizeByHandle(int fd) ;
 time_t fileTimeByName(const char *name) ;
+double secondsNow(void) ;
 char *conciseSize(size_t n); //?
 char *conciseTime(time_t t); //?
 bool lsattrChars(const char *buf, char *dest);
@@ -305,6 +339,7 @@ char getLetter(const char *s) ;
 char *getFileName(int msg, const char *defname, bool isnew, bool ws);
 int shellProtectLength(const char *s);
 void shellProtect(char *t, const char *s);
+int dirNameCompare(const char *s, const char *t);
 const char *nextScanFile(const char *base); //?
 bool sortedDirList(const char *dir, struct lineMap **map_p, int *count_p, int othersort, bool reverse) ; //?
 bool envFile(const char *line, const char **expanded); //?
@@ -349,6 +384,7 @@ bool patternMatchURL(const char *url, const char *pattern);
 bool frameSecurityFile(const char *thisfile);
 bool receiveCookie(const char *url, const char *str) ;
 void cookiesFromJar(void) ;
+void openCookieJar(void);
 bool isInDomain(const char *d, const char *s);
 void sendCookies(char **s, int *l, const char *url, bool issecure) ;
 void mergeCookies(void);
@@ -36,6 +36,9 @@ struct MHINFO {
 	bool atimage;
 	bool pgp;
 	uchar error64;
+	char *body;		/* text of this part, allocated */
+	char *spool;		/* attachment was decoded into this file */
+	off_t atsize;		/* size of the spooled attachment */
 };
 
 static int nattach;		/* number of attachments */
@@ -45,7 +48,6 @@ static bool mailIsHtml;
 static char *fm;		/* formatted mail string */
 static int fm_l;
 static struct MHINFO *lastMailInfo;
-static char *lastMailText;
 
 static void freeMailInfo(struct MHINFO *w)
 {
@@ -57,9 +59,58 @@ static void freeMailInfo(struct MHINFO *w)
 	}
 	nzFree(w->tolist);
 	nzFree(w->cclist);
+	nzFree(w->body);
+	if (w->spool) {
+		unlink(w->spool);
+		nzFree(w->spool);
+	}
 	nzFree(w);
 }				/* freeMailInfo */
 
+/* Move a spooled attachment to its destination.
+ * rename is instant, but the temp directory could be on another file system,
+ * and then we have to copy. */
+static bool moveSpool(struct MHINFO *w, const char *atname)
+{
+	int fh, sh, n;
+	char *buf;
+	bool rc = true;
+
+	if (!rename(w->spool, atname))
+		goto moved;
+	fh = open(atname, O_WRONLY | O_BINARY | O_CREAT | O_TRUNC, MODE_rw);
+	if (fh < 0) {
+		i_printf(MSG_AttNoSave, atname);
+		return false;
+	}
+	sh = open(w->spool, O_RDONLY | O_BINARY);
+	if (sh < 0) {
+		close(fh);
+		i_printf(MSG_AttNoWrite, atname);
+		return false;
+	}
+	buf = allocMem(CHUNKSIZE);
+	while ((n = read(sh, buf, CHUNKSIZE)) > 0)
+		if (write(fh, buf, n) < n) {
+			rc = false;
+			break;
+		}
+	if (n < 0)
+		rc = false;
+	nzFree(buf);
+	close(sh);
+	close(fh);
+	if (!rc) {
+		i_printf(MSG_AttNoWrite, atname);
+		return false;
+	}
+	unlink(w->spool);
+moved:
+	nzFree(w->spool);
+	w->spool = 0;
+	return true;
+}				/* moveSpool */
+
 static bool ignoreImages;
 
 static void writeAttachment(struct MHINFO *w)
@@ -71,7 +122,7 @@ static void writeAttachment(struct MHINFO *w)
 		return;		/* Ignore PGP signatures. */
 	if (w->error64 == BAD_BASE64_DECODE)
 		i_printf(MSG_Abbreviated);
-	if (w->start == w->end) {
+	if (w->spool ? !w->atsize : w->start == w->end) {
 		i_printf(MSG_AttEmpty);
 		if (w->cfn[0])
 			printf(" %s", w->cfn);
@@ -95,16 +146,26 @@ static void writeAttachment(struct MHINFO *w)
 		if (cx == MAXSESSION) {
 			i_printf(MSG_AttNoBuffer);
 		} else {
+			char *data = w->start;
+			int len = w->end - w->start;
+			if (w->spool && !fileIntoMemory(w->spool, &data, &len))
+				data = 0;
 			cxSwitch(cx, false);
 			i_printf(MSG_SessionX, cx);
-			if (!addTextToBuffer
-			    ((pst) w->start, w->end - w->start, 0, false))
+			if (!data
+			    || !addTextToBuffer((pst) data, len, 0, false))
 				i_printf(MSG_AttNoCopy, cx);
 			else if (w->cfn[0])
 				cf->fileName = cloneString(w->cfn);
+			if (w->spool)
+				nzFree(data);
 			cxSwitch(svcx, false);	/* back to where we were */
 		}
-	} else if (!stringEqual(atname, "x")) {
+	} else if (stringEqual(atname, "x")) ;
+	else if (w->spool) {
+		if (!moveSpool(w, atname) && ismc)
+			exit(1);
+	} else {
 		int fh =
 		    open(atname, O_WRONLY | O_BINARY | O_CREAT | O_TRUNC,
 			 MODE_rw);
@@ -179,15 +240,20 @@ static struct FOLDER {
 	bool children;
 	int nmsgs;		/* number of messages in this folder */
 	int nfetch;		/* how many to fetch */
+	int nenv;		/* how many envelopes we have */
 	int unread;		/* how many not yet seen */
 	int start;
 	int uidnext;		/* uid of next message */
+	unsigned uidvalidity;	/* uids are good as long as this doesn't change */
+	unsigned long long modseq;	/* highest modseq, with condstore */
+	bool indexed;		/* keep the envelopes in the local index */
 	struct MIF *mlist;	/* allocated */
 } *topfolders;
 
 static int n_folders;
 static char *tf_cbase;		/* base of strings for folder names and paths */
 static bool move_capable = false;
+static bool condstore_capable = false;
 
 static void examineFolder(CURL * handle, struct FOLDER *f, bool dostats);
 
@@ -324,16 +390,20 @@ static CURLcode getMailData(CURL * handle)
 	CURLcode res;
 	callback_data.buffer = initString(&callback_data.length);
 	callback_data.move_capable = false;
+	callback_data.condstore_capable = false;
 	res = curl_easy_perform(handle);
 	mailstring = callback_data.buffer;
 	mailstring_l = callback_data.length;
 	callback_data.buffer = 0;
 	if (first_call) {
 		move_capable = callback_data.move_capable;
+		condstore_capable = callback_data.condstore_capable;
 		if (debugLevel < 4)
 			curl_easy_setopt(handle, CURLOPT_VERBOSE, 0);
 		debugPrint(3, "imap is %smove capable",
 			   (move_capable ? "" : "not "));
+		debugPrint(3, "imap is %scondstore capable",
+			   (condstore_capable ? "" : "not "));
 		first_call = false;
 	}
 	return res;
@@ -358,27 +428,29 @@ static size_t imap_header_callback(char *i, size_t size,
 	return b;
 }				/* imap_header_callback */
 
-/* after the email has been fetched via pop3 or imap */
-static void undosOneMessage(void)
+/* Remove DOS newlines. */
+static void undos(char *s, int *l)
 {
 	int j, k;
+	for (j = k = 0; j < *l; j++) {
+		if (s[j] == '\r' && j < *l - 1 && s[j + 1] == '\n')
+			continue;
+		s[k++] = s[j];
+	}
+	*l = k;
+	s[k] = 0;
+}				/* undos */
 
+/* after the email has been fetched via pop3 or imap */
+static void undosOneMessage(void)
+{
 	if (mailstring_l >= CHUNKSIZE)
 		nl();		/* We printed dots, so we terminate them with newline */
-
-/* Remove DOS newlines. */
-	for (j = k = 0; j < mailstring_l; j++) {
-		if (mailstring[j] == '\r' && j < mailstring_l - 1
-		    && mailstring[j + 1] == '\n')
-			continue;
-		mailstring[k++] = mailstring[j];
-	}
-	mailstring_l = k;
-	mailstring[k] = 0;
+	undos(mailstring, &mailstring_l);
 }				/* undosOneMessage */
 
 static char presentMail(void);
-static void envelopes(CURL * handle, struct FOLDER *f);
+static void envelopes(CURL * handle, struct FOLDER *f, int upto);
 static void isoDecode(char *vl, char **vrp);
 
 static void cleanFolder(struct FOLDER *f)
@@ -392,7 +464,8 @@ static void cleanFolder(struct FOLDER *f)
 		nzFree(mif->cbase);
 	nzFree(f->mlist);
 	f->mlist = NULL;
-	f->nmsgs = f->nfetch = f->unread = 0;
+	f->nmsgs = f->nfetch = f->nenv = f->unread = 0;
+	f->indexed = false;
 }				/* cleanFolder */
 
 /* search through imap server for a particular string */
@@ -487,7 +560,7 @@ none:
 		skipWhite2(&u);
 	}
 
-	envelopes(handle, f);
+	envelopes(handle, f, 0);
 
 	return true;
 }				/* imapSearch */
@@ -519,10 +592,11 @@ static void printEnvelope(const struct MIF *mif)
 	nzFree(envp);
 }
 
-static void viewAll(struct FOLDER *f)
+static void viewAll(CURL * handle, struct FOLDER *f)
 {
 	int j;
 	struct MIF *mif = f->mlist;
+	envelopes(handle, f, f->nfetch - 1);
 	for (j = 0; j < f->nfetch; ++j, ++mif) {
 		if (!mif->gone)
 			printEnvelope(mif);
@@ -542,6 +616,7 @@ static int bulkMoveDelete(CURL * handle, struct FOLDER *f,
 	char *t, *fromline = 0;
 	bool yesdel = false;
 
+	envelopes(handle, f, f->nfetch - 1);
 	if (key == 'f') {
 		fromline = this_mif->from;
 		if (!fromline[0]) {
@@ -634,6 +709,7 @@ showmessages:
 		if (mif->gone)
 			continue;
 reaction:
+		envelopes(handle, f, j);
 		printEnvelope(mif);
 action:
 		delflag = false;
@@ -736,7 +812,7 @@ imap_done:
 		if (key == 'v') {
 			static const char delim[] = "----------";
 			puts(delim);
-			viewAll(f);
+			viewAll(handle, f);
 			puts(delim);
 			goto reaction;
 		}
@@ -880,182 +956,595 @@ static char *nextRealQuote(char *p)
 	return r;
 }
 
-static void envelopes(CURL * handle, struct FOLDER *f)
+/*********************************************************************
+Find the next untagged FETCH response in the string at *sp,
+return its start and its sequence number, and leave *sp at the end
+of the response, which is the start of the next one, or null.
+*********************************************************************/
+
+static char *nextFetchResponse(char **sp, int *seqno)
+{
+	char *s = *sp, *t, *u;
+
+	while (s) {
+		t = s;
+		if (!strncmp(t, "* ", 2) && isdigit(t[2])) {
+			*seqno = strtol(t + 2, &u, 10);
+			if (!strncmp(u, " FETCH ", 7)) {
+				for (u = t; (u = strchr(u, '\n'));)
+					if (!strncmp(++u, "* ", 2) && isdigit(u[2]))
+						break;
+				*sp = u;
+				return t;
+			}
+		}
+		if ((s = strchr(t, '\n')))
+			++s;
+	}
+
+	*sp = 0;
+	return 0;
+}				/* nextFetchResponse */
+
+/* UID n in a fetch response */
+static int fetchUid(const char *t)
+{
+	const char *u;
+	for (u = t; (u = strstr(u, "UID ")); u += 4)
+		if (u > t && (u[-1] == '(' || u[-1] == ' ') && isdigit(u[4]))
+			return atoi(u + 4);
+	return 0;
+}				/* fetchUid */
+
+/* flags of a fetch response, is it seen */
+static bool fetchSeen(const char *t)
+{
+	const char *u = strstr(t, "FLAGS (");
+	const char *v;
+	if (!u)
+		return false;
+	u += 7;
+	v = strchr(u, ')');
+	u = strstr(u, "\\Seen");
+	return (u && (!v || u < v));
+}				/* fetchSeen */
+
+/*********************************************************************
+Pull subject, from, reply, flags, date, and size out of the response
+to FETCH for one message, held in mif->cbase.
+These are the items of the ALL macro, which we used to fetch.
+Pieces of cbase become the strings in mif, so don't free it.
+*********************************************************************/
+
+static void envelopeParse(struct FOLDER *f, struct MIF *mif)
 {
-	int j;
 	char *t, *u;
-	CURLcode res;
-	char cust_cmd[80];
+	char date[40];
+	int l;
 
-	for (j = 0; j < f->nfetch; ++j) {
-		struct MIF *mif = f->mlist + j;
+	mif->subject = emptyString;
+	mif->from = emptyString;
+	mif->reply = emptyString;
 
-#if 0
-// nobody is using the uid, don't fetch it, save time.
-		sprintf(cust_cmd, "FETCH %d UID", mif->seqno);
-		curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, cust_cmd);
-		res = getMailData(handle);
-		if (res != CURLE_OK)
-			goto abort;
-		t = strstr(mailstring, "FETCH (UID ");
-		if (t) {
-			t += 11;
-			while (*t == ' ')
-				++t;
-			if (isdigit(*t))
-				mif->uid = atoi(t);
-		}
-		nzFree(mailstring);
-#endif
+/* flags, date, and size first, before the envelope is chopped into strings.
+ * The server puts these items in whatever order it likes. */
+/* flags, mostly looking for has this been read */
+	if (strstr(mif->cbase, "FLAGS (")) {
+		if (fetchSeen(mif->cbase))
+			mif->seen = true;
+		else
+			++f->unread;
+	}
 
-		sprintf(cust_cmd, "FETCH %d ALL", mif->seqno);
-		curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, cust_cmd);
-		res = getMailData(handle);
-		if (res != CURLE_OK) {
-//abort:
-			ebcurl_setError(res, mailbox_url, 2, emptyString);
+	u = strstr(mif->cbase, "INTERNALDATE \"");
+	if (u) {
+		u += 14;
+		t = strchr(u, '"');
+		l = (t ? t - u : 0);
+		if (l && l < (int)sizeof(date)) {
+			strncpy(date, u, l);
+			date[l] = 0;
+			mif->sent = parseHeaderDate(date);
 		}
+	}
 
-		mif->cbase = mailstring;
-		mif->subject = emptyString;
-		mif->from = emptyString;
-		mif->reply = emptyString;
+	u = strstr(mif->cbase, "RFC822.SIZE ");
+	if (u && isdigit(u[12]))
+		mif->size = atoi(u + 12);
 
-		t = strstr(mailstring, "ENVELOPE (");
-		if (!t) {
-			nzFree(mailstring);
-			continue;
-		}
+	mif->uid = fetchUid(mif->cbase);
+
+	t = strstr(mif->cbase, "ENVELOPE (");
+	if (!t)
+		return;
 
 /* pull out subject, reply, etc */
-/* Don't free mailstring, we're using pieces of it */
-		t += 10;
-		while (*t == ' ')
-			++t;
+	t += 10;
+	while (*t == ' ')
+		++t;
 // date first, and it must be quoted.
 // We don't use this date because it isn't standardized,
 // it's whatever the sender's email client puts on the Date field.
 // We use INTERNALDATE later.
-		if (*t != '"')
-			continue;
-		t = strchr(++t, '"');
-		if (!t)
-			continue;
-		++t;
+	if (*t != '"')
+		return;
+	t = strchr(++t, '"');
+	if (!t)
+		return;
+	++t;
 
 /* subject next, I'll assume it is always quoted */
-		while (*t == ' ')
-			++t;
-		if (*t != '"')
-			continue;
+	while (*t == ' ')
 		++t;
-		u = nextRealQuote(t);
-		if (!u)
-			continue;
-		*u = 0;
-		if (*t == '[' && u[-1] == ']')
-			++t, u[-1] = 0;
-		mif->subject = t;
-		t = u + 1;
+	if (*t != '"')
+		return;
+	++t;
+	u = nextRealQuote(t);
+	if (!u)
+		return;
+	*u = 0;
+	if (*t == '[' && u[-1] == ']')
+		++t, u[-1] = 0;
+	mif->subject = t;
+	t = u + 1;
 
-		while (*t == ' ')
-			++t;
-		if (strncmp(t, "((\"", 3))
-			goto doref;
-		t += 3;
-		u = nextRealQuote(t);
-		if (!u)
-			goto doref;
-		*u = 0;
-		mif->from = t;
-		t = u + 1;
+	while (*t == ' ')
+		++t;
+	if (strncmp(t, "((\"", 3))
+		goto doref;
+	t += 3;
+	u = nextRealQuote(t);
+	if (!u)
+		goto doref;
+	*u = 0;
+	mif->from = t;
+	t = u + 1;
 
-		while (*t == ' ')
-			++t;
-		if (strncmp(t, "NIL", 3))
-			goto doref;
-		t += 3;
-		while (*t == ' ')
-			++t;
-/* again assuming each field is quoted */
-		if (*t != '"')
-			goto doref;
+	while (*t == ' ')
 		++t;
-		u = strchr(t, '"');
-		if (!u)
-			goto doref;
-		*u = '@';
-		++u;
-		while (*u == ' ')
-			++u;
-		if (*u != '"')
-			goto doref;
+	if (strncmp(t, "NIL", 3))
+		goto doref;
+	t += 3;
+	while (*t == ' ')
+		++t;
+/* again assuming each field is quoted */
+	if (*t != '"')
+		goto doref;
+	++t;
+	u = strchr(t, '"');
+	if (!u)
+		goto doref;
+	*u = '@';
+	++u;
+	while (*u == ' ')
 		++u;
-		strmove(strchr(t, '@') + 1, u);
-		u = strchr(t, '"');
-		if (!u)
-			goto doref;
-		*u = 0;
-		mif->reply = t;
-		t = u + 1;
+	if (*u != '"')
+		goto doref;
+	++u;
+	strmove(strchr(t, '@') + 1, u);
+	u = strchr(t, '"');
+	if (!u)
+		goto doref;
+	*u = 0;
+	mif->reply = t;
+	t = u + 1;
 
 doref:
 /* find the reference string, for replies */
-		u = strstr(t, " \"<");
-		if (!u)
-			goto doflags;
-		t = u + 2;
-		u = strchr(t, '"');
-		if (!u)
-			goto doflags;
-		*u = 0;
-		mif->refer = t;	// not used
-		t = u + 1;
-
-doflags:
-/* flags, mostly looking for has this been read */
-		u = strstr(t, "FLAGS (");
-		if(!u) {
-// sometimes flags and stuff comes at the beginning.
-// It should be somewhere!
-			t = mailstring;
-			u = strstr(t, "FLAGS (");
-		}
-		if (!u)
-			goto dodate;
-		t = u + 7;
-		if (strstr(t, "\\Seen"))
-			mif->seen = true;
-		else
-			++f->unread;
+	u = strstr(t, " \"<");
+	if (!u)
+		return;
+	t = u + 2;
+	u = strchr(t, '"');
+	if (!u)
+		return;
+	*u = 0;
+	mif->refer = t;	// not used
+}				/* envelopeParse */
 
-dodate:
-		u = strstr(t, "INTERNALDATE ");
-		if (!u)
-			goto dosize;
-		t = u + 13;
-		while (*t == ' ')
-			++t;
-		if (*t != '"')
-			goto dosize;
-		++t;
-		u = strchr(t, '"');
-		if (!u)
-			goto dosize;
-		*u = 0;
-		mif->sent = parseHeaderDate(t);
-		t = u + 1;
-
-dosize:
-		u = strstr(t, "SIZE ");
-		if (!u)
+/*********************************************************************
+A local index of envelopes, one file per account and folder,
+so we don't fetch the same envelopes every time we open a folder.
+The files live in mailDir/.ebimap/login@server, and an index is good
+as long as the folder keeps the same UIDVALIDITY.
+The first line holds the version, uidvalidity, uidnext,
+number of messages, and highest modseq, as of the last visit.
+Then a line for each message:
+uid seqno seen size sent tab subject tab from tab reply
+If you change the format of this file, increment the version number.
+*********************************************************************/
+
+#define IMAPINDEXVERSION 1
+
+static char *indexBase;		/* directory of index files for this account */
+
+struct IENTRY {
+	int uid, seqno, size;
+	bool seen;
+	time_t sent;
+	const char *text;	/* subject tab from tab reply */
+};
+
+static struct IENTRY *ix_entries;
+static int ix_n;
+static char *ix_data;		/* the index file */
+static unsigned ix_uidvalidity;
+static int ix_uidnext, ix_exists;
+static unsigned long long ix_modseq;
+
+/* folder names and logins become file names, so encode / and such */
+static void indexEncode(char **s, int *l, const char *t)
+{
+	char c;
+	char hex[4];
+	for (; (c = *t); ++t) {
+		if (isalnum((uchar) c) || c == '.' || c == '-' || c == '_'
+		    || c == '@') {
+			stringAndChar(s, l, c);
+			continue;
+		}
+		sprintf(hex, "%%%02X", (uchar) c);
+		stringAndString(s, l, hex);
+	}
+}				/* indexEncode */
+
+static void indexSetup(const struct MACCOUNT *a)
+{
+	char *s;
+	int l;
+
+	nzFree(indexBase);
+	indexBase = 0;
+	s = initString(&l);
+	stringAndString(&s, &l, mailDir);
+	stringAndString(&s, &l, "/.ebimap");
+	if (fileTypeByName(s, false) != 'd' && mkdir(s, 0700)) {
+		debugPrint(3, "cannot create imap index directory %s", s);
+		nzFree(s);
+		return;
+	}
+	stringAndChar(&s, &l, '/');
+	indexEncode(&s, &l, a->login);
+	stringAndChar(&s, &l, '@');
+	indexEncode(&s, &l, a->inurl);
+	if (fileTypeByName(s, false) != 'd' && mkdir(s, 0700)) {
+		debugPrint(3, "cannot create imap index directory %s", s);
+		nzFree(s);
+		return;
+	}
+	indexBase = s;
+}				/* indexSetup */
+
+static char *indexFile(const struct FOLDER *f)
+{
+	char *s;
+	int l;
+	s = initString(&l);
+	stringAndString(&s, &l, indexBase);
+	stringAndChar(&s, &l, '/');
+	indexEncode(&s, &l, f->path);
+	return s;
+}				/* indexFile */
+
+static int ix_uidcmp(const void *v, const void *w)
+{
+	const struct IENTRY *e1 = v, *e2 = w;
+	return (e1->uid < e2->uid ? -1 : e1->uid > e2->uid);
+}				/* ix_uidcmp */
+
+/* read the index for this folder, return the number of entries */
+static int indexRead(const struct FOLDER *f)
+{
+	char *file = indexFile(f);
+	char *s, *t;
+	int len, version, n;
+	struct IENTRY *e;
+
+	nzFree(ix_data);
+	ix_data = 0;
+	nzFree(ix_entries);
+	ix_entries = 0;
+	ix_n = 0;
+
+	if (access(file, 4) || !fileIntoMemory(file, &ix_data, &len)) {
+		nzFree(file);
+		return 0;
+	}
+	nzFree(file);
+
+	if (sscanf(ix_data, "%d %u %d %d %llu", &version, &ix_uidvalidity,
+		   &ix_uidnext, &ix_exists, &ix_modseq) != 5 ||
+	    version != IMAPINDEXVERSION || ix_uidvalidity != f->uidvalidity)
+		return 0;
+
+	for (n = 0, s = ix_data; (s = strchr(s, '\n')); ++s)
+		++n;
+	ix_entries = allocZeroMem(n * sizeof(struct IENTRY));
+	e = ix_entries;
+	s = strchr(ix_data, '\n') + 1;
+	for (; (t = strchr(s, '\n')); s = t + 1) {
+		long long sent;
+		int seen, used;
+		*t = 0;
+		if (sscanf(s, "%d %d %d %d %lld%n", &e->uid, &e->seqno, &seen,
+			   &e->size, &sent, &used) != 5 || s[used] != '\t')
+			continue;
+		e->seen = seen;
+		e->sent = sent;
+		e->text = s + used + 1;
+		++e;
+	}
+	ix_n = e - ix_entries;
+	debugPrint(4, "imap index %s, %d envelopes", f->path, ix_n);
+	return ix_n;
+}				/* indexRead */
+
+/* this message, by seqno or by uid, from the index */
+static struct IENTRY *indexFind(int seqno, int uid)
+{
+	struct IENTRY *e = ix_entries;
+	int i;
+	if (uid) {
+		struct IENTRY key;
+		key.uid = uid;
+		return bsearch(&key, ix_entries, ix_n, sizeof(struct IENTRY),
+			       ix_uidcmp);
+	}
+	for (i = 0; i < ix_n; ++i, ++e)
+		if (e->seqno == seqno)
+			return e;
+	return 0;
+}				/* indexFind */
+
+static void indexFill(struct MIF *mif, const struct IENTRY *e)
+{
+	char *t;
+	mif->uid = e->uid;
+	mif->size = e->size;
+	mif->sent = e->sent;
+	mif->seen = e->seen;
+	mif->cbase = cloneString(e->text);
+	mif->subject = mif->cbase;
+	mif->from = mif->reply = emptyString;
+	if ((t = strchr(mif->subject, '\t'))) {
+		*t++ = 0;
+		mif->from = t;
+		if ((t = strchr(t, '\t'))) {
+			*t++ = 0;
+			mif->reply = t;
+		}
+	}
+}				/* indexFill */
+
+static void indexWrite(const struct FOLDER *f)
+{
+	char *file, *tmp;
+	FILE *fh;
+	const struct MIF *mif;
+	const char *q;
+	int j, k;
+
+	if (!indexBase || !f->uidvalidity)
+		return;
+	file = indexFile(f);
+	tmp = allocMem(strlen(file) + 5);
+	sprintf(tmp, "%s.tmp", file);
+	fh = fopen(tmp, "w");
+	if (!fh) {
+		debugPrint(3, "cannot write imap index %s", tmp);
+		goto done;
+	}
+
+	fprintf(fh, "%d %u %d %d %llu\n", IMAPINDEXVERSION, f->uidvalidity,
+		f->uidnext, f->nmsgs, f->modseq);
+	for (j = 0, mif = f->mlist; j < f->nfetch; ++j, ++mif) {
+		if (mif->gone || !mif->cbase || !mif->uid)
+			continue;
+		fprintf(fh, "%d %d %d %d %lld\t", mif->uid, mif->seqno,
+			mif->seen, mif->size, (long long)mif->sent);
+// a tab or newline in a subject would throw us off
+		for (k = 0; k < 3; ++k) {
+			q = (k == 0 ? mif->subject : k == 1 ? mif->from :
+			     mif->reply);
+			for (; *q; ++q)
+				fputc((*q == '\t' || *q == '\n'
+				       || *q == '\r' ? ' ' : *q), fh);
+			fputc((k < 2 ? '\t' : '\n'), fh);
+		}
+	}
+	if (fclose(fh) || rename(tmp, file))
+		unlink(tmp);
+
+done:
+	nzFree(tmp);
+	nzFree(file);
+}				/* indexWrite */
+
+/*********************************************************************
+Fill in the envelopes of the folder from its index.
+If nothing was added or expunged, the sequence numbers line up with
+those in the index, and with condstore, an unchanged modseq means
+nothing changed at all; that is the instant case.
+With condstore and a new modseq, ask for the flags that changed since.
+Otherwise one FETCH of uids and flags tells us which messages we have,
+and what has been read.
+Either way, the envelopes not in the index are fetched as usual.
+*********************************************************************/
+
+static void indexSync(CURL * handle, struct FOLDER *f)
+{
+	struct MIF *mif = f->mlist;
+	struct IENTRY *e;
+	bool samemap;
+	char *cmd, *s, *t;
+	int cmd_l, j, seqno, uid, filled = 0;
+	char c = 0;
+	CURLcode res;
+
+	if (!indexBase || !f->uidvalidity || !f->nfetch)
+		return;
+	f->indexed = true;
+	if (!indexRead(f))
+		return;
+
+	samemap = (ix_exists == f->nmsgs && ix_uidnext == f->uidnext);
+	if (samemap) {
+		for (j = 0; j < f->nfetch; ++j)
+			if ((e = indexFind(mif[j].seqno, 0)))
+				indexFill(mif + j, e), ++filled;
+		if (f->modseq && f->modseq == ix_modseq)
+			goto done;
+	} else {
+		qsort(ix_entries, ix_n, sizeof(struct IENTRY), ix_uidcmp);
+	}
+
+	cmd = initString(&cmd_l);
+	stringAndString(&cmd, &cmd_l, "FETCH ");
+	stringAndNum(&cmd, &cmd_l, mif[0].seqno);
+	stringAndChar(&cmd, &cmd_l, ':');
+	stringAndNum(&cmd, &cmd_l, mif[f->nfetch - 1].seqno);
+	stringAndString(&cmd, &cmd_l, " (UID FLAGS)");
+	if (samemap && f->modseq && ix_modseq) {
+		char since[40];
+		sprintf(since, " (CHANGEDSINCE %llu)", ix_modseq);
+		stringAndString(&cmd, &cmd_l, since);
+	}
+	curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, cmd);
+	nzFree(cmd);
+	res = getMailData(handle);
+	if (res != CURLE_OK) {
+		nzFree(mailstring);
+		mailstring = 0;
+		ebcurl_setError(res, mailbox_url, 2, emptyString);
+		goto done;
+	}
+
+	s = mailstring;
+	while ((t = nextFetchResponse(&s, &seqno))) {
+		j = seqno - mif[0].seqno;
+		if (j < 0 || j >= f->nfetch)
 			continue;
-		t = u + 5;
-		if (!isdigit(*t))
+// bound this response, so we don't look at the next one
+		if (s)
+			c = *s, *s = 0;
+		uid = fetchUid(t);
+		if (!samemap && uid && (e = indexFind(0, uid)))
+			indexFill(mif + j, e), ++filled;
+		if (mif[j].cbase && mif[j].uid != uid) {
+// index is wrong about this one, fetch it anew
+			nzFree(mif[j].cbase);
+			mif[j].cbase = 0;
+			--filled;
+		} else if (mif[j].cbase)
+			mif[j].seen = fetchSeen(t);
+		if (s)
+			*s = c;
+	}
+	nzFree(mailstring);
+	mailstring = 0;
+
+done:
+	for (j = 0; j < f->nfetch; ++j)
+		if (mif[j].cbase && !mif[j].seen)
+			++f->unread;
+	debugPrint(3, "%d of %d envelopes from the index", filled, f->nfetch);
+// record the new uidnext and modseq, and any changes in flags
+	indexWrite(f);
+}				/* indexSync */
+
+/*********************************************************************
+Fetch envelopes a batch at a time, using a sequence set,
+so a folder of thousands of messages is not thousands of round trips.
+f->nenv is the number of envelopes we have so far;
+fetch batches until we have envelope number upto.
+examineFolder and imapSearch only get the first batch,
+so scanFolder can start printing; the rest come as they are needed.
+The server answers with one untagged FETCH response per message,
+and we split these apart and give each message its own copy.
+*********************************************************************/
+
+static const int envbatch = 200;
+
+static bool envelopeBatch(CURL * handle, struct FOLDER *f)
+{
+	struct MIF *mif = f->mlist + f->nenv;
+	int n = f->nfetch - f->nenv;
+	int j, k, seqno, run;
+	char *cmd, *s, *t;
+	int cmd_l;
+	CURLcode res;
+
+	if (n > envbatch)
+		n = envbatch;
+	for (j = 0; j < n; ++j) {
+		if (!mif[j].cbase)
+			mif[j].subject = mif[j].from = mif[j].reply =
+			    emptyString;
+	}
+
+// Build the sequence set, like 3,7:12,20.
+// A message that was moved is gone, and its seqno is stale; skip it.
+// Skip messages we already have from the index.
+	cmd = initString(&cmd_l);
+	stringAndString(&cmd, &cmd_l, "FETCH ");
+	run = 0;
+	for (j = 0; j < n; ++j) {
+		if (mif[j].gone || mif[j].cbase)
 			continue;
-		mif->size = atoi(t);
+		seqno = mif[j].seqno;
+		for (k = j + 1; k < n && !mif[k].gone && !mif[k].cbase &&
+		     mif[k].seqno == seqno + k - j; ++k) ;
+		if (run++)
+			stringAndChar(&cmd, &cmd_l, ',');
+		stringAndNum(&cmd, &cmd_l, seqno);
+		if (k > j + 1) {
+			stringAndChar(&cmd, &cmd_l, ':');
+			stringAndNum(&cmd, &cmd_l, mif[k - 1].seqno);
+		}
+		j = k - 1;
+	}
+	f->nenv += n;
+	if (!run) {
+		nzFree(cmd);
+		return true;
+	}
+	stringAndString(&cmd, &cmd_l,
+			" (UID FLAGS INTERNALDATE RFC822.SIZE ENVELOPE)");
+	debugPrint(4, "envelopes %d through %d", f->nenv - n + 1, f->nenv);
+	curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, cmd);
+	nzFree(cmd);
+	res = getMailData(handle);
+	if (res != CURLE_OK) {
+		nzFree(mailstring);
+		mailstring = 0;
+		ebcurl_setError(res, mailbox_url, 2, emptyString);
+		return false;
+	}
 
+	k = 0;
+	s = mailstring;
+	while ((t = nextFetchResponse(&s, &seqno))) {
+// Responses come in order, so this search is usually one step.
+		for (j = 0; j < n; ++j, k = (k + 1) % n)
+			if (!mif[k].gone && mif[k].seqno == seqno)
+				break;
+		if (j == n || mif[k].cbase)
+			continue;
+		mif[k].cbase = (s ? pullString(t, s - t) : cloneString(t));
+		envelopeParse(f, mif + k);
 	}
+	nzFree(mailstring);
+	mailstring = 0;
+	if (f->indexed)
+		indexWrite(f);
+	return true;
+}				/* envelopeBatch */
+
+static void envelopes(CURL * handle, struct FOLDER *f, int upto)
+{
+	while (f->nenv <= upto && f->nenv < f->nfetch)
+		if (!envelopeBatch(handle, f))
+			break;
 }				/* envelopes */
 
 /* examine the specified folder, gather message envelopes */
@@ -1068,7 +1557,10 @@ static void examineFolder(CURL * handle, struct FOLDER *f, bool dostats)
 	cleanFolder(f);
 
 /* interrogate folder */
-	if (asprintf(&t, "EXAMINE \"%s\"", f->path) == -1)
+/* With condstore, ask for the highest modseq, so the index can catch up. */
+	if (asprintf(&t, "EXAMINE \"%s\"%s", f->path,
+		     (condstore_capable && !dostats ? " (CONDSTORE)" : "")) ==
+	    -1)
 		i_printfExit(MSG_MemAllocError, strlen(f->path) + 12);
 	curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, t);
 	free(t);
@@ -1104,6 +1596,26 @@ static void examineFolder(CURL * handle, struct FOLDER *f, bool dostats)
 			f->uidnext = atoi(t);
 	}
 
+	f->uidvalidity = 0;
+	t = strstr(mailstring, "UIDVALIDITY ");
+	if (t) {
+		t += 12;
+		while (*t == ' ')
+			++t;
+		if (isdigit(*t))
+			f->uidvalidity = strtoul(t, 0, 10);
+	}
+
+	f->modseq = 0;
+	t = strstr(mailstring, "HIGHESTMODSEQ ");
+	if (t) {
+		t += 14;
+		while (*t == ' ')
+			++t;
+		if (isdigit(*t))
+			f->modseq = strtoull(t, 0, 10);
+	}
+
 	nzFree(mailstring);
 	if (dostats) {
 		printf("%2lld %s", (unsigned long long)(f - topfolders + 1),
@@ -1127,7 +1639,8 @@ static void examineFolder(CURL * handle, struct FOLDER *f, bool dostats)
 		mif->seqno = f->start + j;
 	}
 
-	envelopes(handle, f);
+	indexSync(handle, f);
+	envelopes(handle, f, 0);
 
 	if (f->nmsgs > f->nfetch)
 		i_printf(MSG_ShowLast + earliest, f->nfetch, f->nmsgs);
@@ -1411,6 +1924,23 @@ refresh:
 	return CURLE_OK;
 }				/* count_messages */
 
+/* into the mail directory, and find the last unread mail */
+static void unreadSetup(void)
+{
+	if (!mailDir)
+		i_printfExit(MSG_NoMailDir);
+	if (chdir(mailDir))
+		i_printfExit(MSG_NoDirChange, mailDir);
+
+	if (!umf) {
+		umf = allocMem(strlen(mailUnread) + 12);
+		sprintf(umf, "%s/", mailUnread);
+		umf_end = umf + strlen(umf);
+	}
+	unreadBase = 0;
+	unreadStats();
+}				/* unreadSetup */
+
 /* Returns number of messages fetched */
 int fetchMail(int account)
 {
@@ -1425,20 +1955,10 @@ int fetchMail(int account)
 
 	get_mailbox_url(a);
 	url_for_error = mailbox_url;
+	unreadSetup();
 
-	if (!mailDir)
-		i_printfExit(MSG_NoMailDir);
-	if (chdir(mailDir))
-		i_printfExit(MSG_NoDirChange, mailDir);
-
-	if (!umf) {
-		umf = allocMem(strlen(mailUnread) + 12);
-		sprintf(umf, "%s/", mailUnread);
-		umf_end = umf + strlen(umf);
-	}
-	unreadBase = 0;
-	unreadStats();
-
+	if (isimap)
+		indexSetup(a);
 	mail_handle = newFetchmailHandle(login, pass);
 	res = count_messages(mail_handle, &message_count);
 	if (res != CURLE_OK)
@@ -1476,13 +1996,127 @@ fetchmail_cleanup:
 	return nfetch;
 }				/* fetchMail */
 
+/*********************************************************************
+Fetch from several pop3 accounts at once.
+Each account is a job, with its own curl handle, and its own buffer;
+all the jobs run together in one curl multi handle.
+A job moves from one step to the next each time a transfer completes:
+list the messages, then retrieve and delete each message in turn.
+pop3 through curl is one command per transfer, so within an account
+retrieve and delete are still two round trips per message,
+but the accounts overlap, and the time is that of the slowest account,
+rather than the sum of them all.
+Errors and timings are held until the end and printed in account order.
+*********************************************************************/
+
+struct FETCHJOB {
+	int account;
+	CURL *h;
+	char *url;		/* mailbox url */
+	char *msgurl;		/* url of the current message */
+	char *buf;		/* data of the current transfer */
+	int buf_l;
+	int count;		/* messages on the server */
+	int n;			/* current message */
+	int nfetch;		/* messages fetched */
+	char step;		/* l list, r retrieve, d delete, 0 done */
+	CURLcode res;
+	double start, end;
+};
+
+static size_t fetchJobCallback(char *incoming, size_t size, size_t nitems,
+			       void *data)
+{
+	struct FETCHJOB *job = data;
+	size_t num_bytes = nitems * size;
+	stringAndBytes(&job->buf, &job->buf_l, incoming, num_bytes);
+	return num_bytes;
+}				/* fetchJobCallback */
+
+/* set the handle up to retrieve the next message */
+static void fetchJobRetrieve(struct FETCHJOB *job)
+{
+	nzFree(job->msgurl);
+	if (asprintf(&job->msgurl, "%s%u", job->url, job->n) == -1)
+		i_printfExit(MSG_MemAllocError, strlen(job->url) + 11);
+	setCurlURL(job->h, job->msgurl);
+	curl_easy_setopt(job->h, CURLOPT_CUSTOMREQUEST, NULL);
+	curl_easy_setopt(job->h, CURLOPT_NOBODY, 0L);
+	job->step = 'r';
+}				/* fetchJobRetrieve */
+
+/* A transfer is done; take the next step, return false if the job is done. */
+static bool fetchJobStep(struct FETCHJOB *job, CURLcode res)
+{
+	int i;
+	bool last_nl = true;
+
+	if (res != CURLE_OK) {
+		job->res = res;
+		goto done;
+	}
+
+	switch (job->step) {
+	case 'l':
+		for (i = 0; i < job->buf_l; i++) {
+			if (job->buf[i] == '\n' || job->buf[i] == '\r') {
+				last_nl = true;
+				continue;
+			}
+			if (last_nl && isdigit(job->buf[i]))
+				++job->count;
+			last_nl = false;
+		}
+		if (!job->count)
+			goto done;
+		job->n = 1;
+		fetchJobRetrieve(job);
+		break;
+
+	case 'r':
+		undos(job->buf, &job->buf_l);
+/* got the file, save it in unread */
+		sprintf(umf_end, "%d", ++unreadMax);
+		umfd = open(umf, O_WRONLY | O_TEXT | O_CREAT, MODE_rw);
+		if (umfd < 0)
+			i_printfExit(MSG_NoCreate, umf);
+		if (write(umfd, job->buf, job->buf_l) < job->buf_l)
+			i_printfExit(MSG_NoWrite, umf);
+		close(umfd);
+		++job->nfetch;
+		curl_easy_setopt(job->h, CURLOPT_CUSTOMREQUEST, "DELE");
+		curl_easy_setopt(job->h, CURLOPT_NOBODY, 1L);
+		job->step = 'd';
+		break;
+
+	case 'd':
+		if (++job->n > job->count)
+			goto done;
+		fetchJobRetrieve(job);
+		break;
+	}
+
+	nzFree(job->buf);
+	job->buf = initString(&job->buf_l);
+	return true;
+
+done:
+	job->step = 0;
+	job->end = secondsNow();
+	return false;
+}				/* fetchJobStep */
+
 /* fetch from all accounts except those with nofetch or imap set */
 int fetchAllMail(void)
 {
-	int i, j;
+	int i, j, njobs = 0, running, left;
 	const struct MACCOUNT *a, *b;
+	struct FETCHJOB *jobs, *job;
+	CURLM *multi;
+	CURLMsg *msg;
 	int nfetch = 0;
 
+	jobs = allocZeroMem(maxAccount * sizeof(struct FETCHJOB));
 	for (i = 1; i <= maxAccount; ++i) {
 		a = accounts + i - 1;
 		if (a->nofetch | a->imap)
@@ -1499,13 +2133,80 @@ int fetchAllMail(void)
 		if (j < i)
 			continue;
 
-		debugPrint(3, "fetch from %d %s", i, a->inurl);
-		nfetch += fetchMail(i);
+		jobs[njobs++].account = i;
+	}
+
+	if (!njobs) {
+		free(jobs);
+		return 0;
+	}
+
+	unreadSetup();
+	multi = curl_multi_init();
+	if (!multi)
+		i_printfExit(MSG_LibcurlNoInit);
+
+	for (i = 0; i < njobs; ++i) {
+		job = jobs + i;
+		a = accounts + job->account - 1;
+		debugPrint(3, "fetch from %d %s", job->account, a->inurl);
+		get_mailbox_url(a);
+		job->url = mailbox_url;
+		mailbox_url = 0;
+		job->h = newFetchmailHandle(a->login, a->password);
+		curl_easy_setopt(job->h, CURLOPT_WRITEFUNCTION,
+				 fetchJobCallback);
+		curl_easy_setopt(job->h, CURLOPT_WRITEDATA, job);
+		curl_easy_setopt(job->h, CURLOPT_PRIVATE, job);
+		curl_easy_setopt(job->h, CURLOPT_VERBOSE, (debugLevel >= 4));
+		job->buf = initString(&job->buf_l);
+		job->start = secondsNow();
+		setCurlURL(job->h, job->url);
+		job->step = 'l';
+		curl_multi_add_handle(multi, job->h);
+	}
+
+	do {
+		curl_multi_perform(multi, &running);
+		while ((msg = curl_multi_info_read(multi, &left))) {
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE,
+					  (char **)&job);
+			curl_multi_remove_handle(multi, job->h);
+			if (fetchJobStep(job, msg->data.result)) {
+				curl_multi_add_handle(multi, job->h);
+				++running;
+			}
+		}
+		if (running)
+			curl_multi_wait(multi, NULL, 0, 1000, NULL);
+	} while (running);
+
+/* now, in order, what happened to each account */
+	for (i = 0; i < njobs; ++i) {
+		job = jobs + i;
+		a = accounts + job->account - 1;
+		debugPrint(3, "account %d %s, %d of %d messages, %.3f seconds",
+			   job->account, a->inurl, job->nfetch, job->count,
+			   job->end - job->start);
+		if (job->res != CURLE_OK)
+			ebcurl_setError(job->res,
+					(job->msgurl ? job->msgurl : job->url),
+					1, emptyString);
+		nfetch += job->nfetch;
+		curl_easy_cleanup(job->h);
+		nzFree(job->url);
+		nzFree(job->msgurl);
+		nzFree(job->buf);
 	}
 
+	curl_multi_cleanup(multi);
+	free(jobs);
 	return nfetch;
 }				/* fetchAllMail */
 
+
 static void readReplyInfo(void);
 static void writeReplyInfo(const char *addstring);
 
@@ -1539,8 +2240,6 @@ void scanMail(void)
 	loadAddressBook();
 
 	for (m = 1; m <= nmsgs; ++m) {
-		nzFree(lastMailText);
-		lastMailText = 0;
 /* Now grab the entire message */
 		unreadStats();
 		sprintf(umf_end, "%d", unreadMin);
@@ -1552,6 +2251,8 @@ void scanMail(void)
 			unlink(umf);
 	}			/* loop over mail messages */
 
+	if (lastMailInfo)
+		freeMailInfo(lastMailInfo);
 	exit(0);
 }				/* scanMail */
 
@@ -1650,6 +2351,8 @@ key_command:
 	switch (key) {
 	case 'q':
 		i_puts(MSG_Quit);
+/* clean up any spooled attachments */
+		freeMailInfo(lastMailInfo);
 		exit(0);
 
 	case 'n':
@@ -1942,30 +2645,8 @@ void mail64Error(int err)
 
 static void unpackQP(struct MHINFO *w)
 {
-	char c, d, *q, *r;
-	for (q = r = w->start; q < w->end; ++q) {
-		c = *q;
-		if (c != '=') {
-			*r++ = c;
-			continue;
-		}
-		c = *++q;
-		if (c == '\n')
-			continue;
-		d = q[1];
-		if (isxdigit(c) && isxdigit(d)) {
-			d = fromHex(c, d);
-			if (d == 0)
-				d = ' ';
-			*r++ = d;
-			++q;
-			continue;
-		}
-		--q;
-		*r++ = '=';
-	}
-	w->end = r;
-	*r = 0;
+	w->end = qpDecode(w->start, w->end);
+	*w->end = 0;
 }				/* unpackQP */
 
 /* Look for the name of the attachment and boundary */
@@ -2157,15 +2838,15 @@ static void extractLessGreater(char *s)
 }				/* extractLessGreater */
 
 /* Now that we know it's mail, see what information we can
- * glean from the headers.
- * Returns a pointer to an allocated MHINFO structure.
- * This routine is recursive. */
-static struct MHINFO *headerGlean(char *start, char *end)
+ * glean from the headers, from start up to the empty line.
+ * Returns a pointer to an allocated MHINFO structure,
+ * with start pointing just past the headers. */
+static struct MHINFO *headerLines(char *start, char *end)
 {
 	char *s, *t, *q;
 	char *vl, *vr;		/* value left and value right */
 	struct MHINFO *w;
-	int j, k, n;
+	int j;
 	char linetype = 0;
 
 /* defaults */
@@ -2417,7 +3098,7 @@ static struct MHINFO *headerGlean(char *start, char *end)
 	extractEmailAddresses(w->tolist);
 	extractEmailAddresses(w->cclist);
 
-	w->start = start = s + 1;
+	w->start = s + 1;
 
 /* Fix up reply and from lines.
  * From should be the name, reply the address. */
@@ -2472,13 +3153,14 @@ static struct MHINFO *headerGlean(char *start, char *end)
 		printf("content %d/%d\n", w->ct, w->ce);
 	}
 
-	if (w->ce == CE_QP)
-		unpackQP(w);
-	if (w->ce == CE_64) {
-		w->error64 = base64Decode(w->start, &w->end);
-		if (w->error64 != GOOD_BASE64_DECODE)
-			mail64Error(w->error64);
-	}
+	return w;
+}				/* headerLines */
+
+/* Is this part an attachment?  The headers tell us. */
+static bool attachCheck(struct MHINFO *w)
+{
+	char *q;
+
 	if ((w->ce == CE_64 && w->ct == CT_OTHER) ||
 	    w->ct == CT_APPLIC || w->cfn[0]) {
 		w->doAttach = true;
@@ -2503,41 +3185,23 @@ static struct MHINFO *headerGlean(char *start, char *end)
 			if (!w->atimage && nattach == nimages + 1)
 				firstAttach = w->cfn;
 		}
-		return w;
+		return true;
 	}
 
-/* loop over the mime components */
-	if (w->ct == CT_MULTI || w->ct == CT_ALT) {
-		char *lastbound = 0;
-		bool endmode = false;
-		struct MHINFO *child;
-/* We really need the -1 here, because sometimes the boundary will
- * be the very first thing in the message body. */
-		s = w->start - 1;
-		while (!endmode && (t = strstr(s, "\n--")) && t < end) {
-			if (memcmp(t + 3, w->boundary, w->boundlen)) {
-				s = t + 3;
-				continue;
-			}
-			q = t + 3 + w->boundlen;
-			while (*q == '-')
-				endmode = true, ++q;
-			if (*q == '\n')
-				++q;
-			debugPrint(5, "boundary found at offset %d",
-				   t - w->start);
-			if (lastbound) {
-				child = headerGlean(lastbound, t);
-				addToListBack(&w->components, child);
-			}
-			s = lastbound = q;
-		}
-		w->start = w->end = 0;
-		return w;
-	}
+	return false;
+}				/* attachCheck */
 
-	/* mime or alt */
-	/* Scan through, we might have a mail message included inline */
+static struct MHINFO *headerGlean(char *start, char *end);
+
+/* The text of a part, from start to end, is in memory and decoded.
+ * Look for a mail message included inline, then trim the front. */
+static void textGlean(struct MHINFO *w)
+{
+	char *start = w->start, *end = w->end;
+	char *s, *t, *q, *vl, *vr;
+	int j, k, n;
+
+/* Scan through, we might have a mail message included inline */
 	vl = 0;			/* first mail header keyword line */
 	for (s = start; s < end; s = t + 1) {
 		char first = *s;
@@ -2611,11 +3275,451 @@ textonly:
 			continue;
 		break;		/* something real */
 	}
-	w->start = start = s;
+	w->start = s;
+}				/* textGlean */
+
+/* Glean the headers and the body of a message or section in memory.
+ * This routine is recursive. */
+static struct MHINFO *headerGlean(char *start, char *end)
+{
+	char *s, *t, *q;
+	struct MHINFO *w;
+
+	w = headerLines(start, end);
+	if (w->ce == CE_QP)
+		unpackQP(w);
+	if (w->ce == CE_64) {
+		w->error64 = base64Decode(w->start, &w->end);
+		if (w->error64 != GOOD_BASE64_DECODE)
+			mail64Error(w->error64);
+	}
+	if (attachCheck(w))
+		return w;
+
+/* loop over the mime components */
+	if (w->ct == CT_MULTI || w->ct == CT_ALT) {
+		char *lastbound = 0;
+		bool endmode = false;
+		struct MHINFO *child;
+/* We really need the -1 here, because sometimes the boundary will
+ * be the very first thing in the message body. */
+		s = w->start - 1;
+		while (!endmode && (t = strstr(s, "\n--")) && t < end) {
+			if (memcmp(t + 3, w->boundary, w->boundlen)) {
+				s = t + 3;
+				continue;
+			}
+			q = t + 3 + w->boundlen;
+			while (*q == '-')
+				endmode = true, ++q;
+			if (*q == '\n')
+				++q;
+			debugPrint(5, "boundary found at offset %d",
+				   t - w->start);
+			if (lastbound) {
+				child = headerGlean(lastbound, t);
+				addToListBack(&w->components, child);
+			}
+			s = lastbound = q;
+		}
+		w->start = w->end = 0;
+		return w;
+	}
 
+	textGlean(w);
 	return w;
 }				/* headerGlean */
 
+/*********************************************************************
+Streaming mime parser.
+The message comes in blocks, from a file or from memory,
+and is cut into lines as it goes by.
+Headers are gleaned one section at a time, text parts are kept in memory
+for formatting, and attachments are decoded on the fly,
+straight into spool files in the temp directory.
+A large message with video attachments is never in memory all at once.
+The multipart sections that enclose the current part are on a stack;
+a boundary line closes everything inside the multipart it belongs to.
+*********************************************************************/
+
+#define MIMEDEPTH 20
+#define MIMEBLOCK 65536
+
+enum {
+	MP_HEAD,		/* reading the headers of a part */
+	MP_SKIP,		/* preamble or epilogue of a multipart */
+	MP_TEXT,		/* text, held in memory */
+	MP_ATTACH,		/* attachment, decoded into a spool file */
+};
+
+struct MIMEPARSE {
+	struct MHINFO *top;
+	struct MHINFO *stack[MIMEDEPTH];
+	bool ended[MIMEDEPTH];	/* closing boundary has been seen */
+	int depth;
+	uchar phase;
+	bool pendnl;		/* newline held back, a boundary could follow */
+	char *line;		/* partial line from the last block */
+	int line_l;
+	char *body;		/* headers or text of the current part */
+	int body_l;
+/* decoder state for the current attachment */
+	int atfd;
+	bool atbad;
+	char qp[2];		/* = or =X waiting for the next character */
+	int qp_l;
+	uchar mod, leftover;
+	bool equals;
+	char *out;		/* decoded bytes not yet written */
+	int out_l;
+};
+
+static int spoolCount;
+
+static void mimeFlush(struct MIMEPARSE *ps)
+{
+	struct MHINFO *w = ps->stack[ps->depth - 1];
+	if (ps->out_l && !ps->atbad) {
+		if (write(ps->atfd, ps->out, ps->out_l) < ps->out_l)
+			ps->atbad = true;
+		w->atsize += ps->out_l;
+	}
+	ps->out_l = 0;
+}				/* mimeFlush */
+
+static void mimeOut(struct MIMEPARSE *ps, char c)
+{
+	if (ps->out_l == MIMEBLOCK)
+		mimeFlush(ps);
+	ps->out[ps->out_l++] = c;
+}				/* mimeOut */
+
+static void mimeRaw(struct MIMEPARSE *ps, const char *s, int len)
+{
+	int n;
+	while (len) {
+		if (ps->out_l == MIMEBLOCK)
+			mimeFlush(ps);
+		n = MIMEBLOCK - ps->out_l;
+		if (n > len)
+			n = len;
+		memcpy(ps->out + ps->out_l, s, n);
+		ps->out_l += n;
+		s += n, len -= n;
+	}
+}				/* mimeRaw */
+
+/* incremental version of unpackQP.
+ * Each block is copied into the output buffer and decoded there by qpDecode,
+ * the same decoder unpackQP uses. An = or =X at the end of a block
+ * is held back, in qp, until the next block says what it is. */
+static void mimeQP(struct MIMEPARSE *ps, const char *s, int len)
+{
+	char *start, *end;
+	int n, h;
+
+	while (len) {
+		n = MIMEBLOCK - ps->out_l - ps->qp_l;
+		if (n < 256) {
+			mimeFlush(ps);
+			n = MIMEBLOCK - ps->qp_l;
+		}
+		if (n > len)
+			n = len;
+		start = ps->out + ps->out_l;
+		memcpy(start, ps->qp, ps->qp_l);
+		memcpy(start + ps->qp_l, s, n);
+		end = start + ps->qp_l + n;
+		s += n, len -= n;
+
+		h = 0;
+		if (end[-1] == '=')
+			h = 1;
+		else if (end - start >= 2 && end[-2] == '=' &&
+			 isxdigit((uchar) end[-1]))
+			h = 2;
+		memcpy(ps->qp, end - h, h);
+		ps->qp_l = h;
+		end -= h;
+
+		ps->out_l = qpDecode(start, end) - ps->out;
+	}
+}				/* mimeQP */
+
+/* incremental version of base64Decode */
+static void mime64(struct MIMEPARSE *ps, const char *s, int len)
+{
+	struct MHINFO *w = ps->stack[ps->depth - 1];
+	int i;
+	char c;
+	uchar val;
+	for (i = 0; i < len && !w->error64; ++i) {
+		c = s[i];
+		if (isspaceByte(c))
+			continue;
+		if (ps->equals) {
+			if (c != '=')
+				w->error64 = EXTRA_CHARS_BASE64_DECODE;
+			continue;
+		}
+		if (c == '=') {
+			ps->equals = true;
+			continue;
+		}
+		val = base64Bits(c);
+		if (val & 64) {
+			w->error64 = BAD_BASE64_DECODE;
+			break;
+		}
+		if (ps->mod == 0) {
+			ps->leftover = val << 2;
+		} else if (ps->mod == 1) {
+			mimeOut(ps, ps->leftover | (val >> 4));
+			ps->leftover = val << 4;
+		} else if (ps->mod == 2) {
+			mimeOut(ps, ps->leftover | (val >> 2));
+			ps->leftover = val << 6;
+		} else {
+			mimeOut(ps, ps->leftover | val);
+		}
+		++ps->mod;
+		ps->mod &= 3;
+	}
+}				/* mime64 */
+
+/* Open a spool file for this attachment.
+ * If we can't, the attachment is held in memory, as in days gone by. */
+static bool mimeSpool(struct MIMEPARSE *ps, struct MHINFO *w)
+{
+	if (!ebUserDir)
+		return false;
+	if (asprintf(&w->spool, "%s/at%d-%d", ebUserDir, getpid(),
+		     ++spoolCount) < 0)
+		i_printfExit(MSG_MemAllocError, strlen(ebUserDir) + 24);
+	ps->atfd =
+	    open(w->spool, O_WRONLY | O_BINARY | O_CREAT | O_TRUNC, MODE_rw);
+	if (ps->atfd < 0) {
+		free(w->spool);
+		w->spool = 0;
+		return false;
+	}
+	debugPrint(4, "attachment spooled to %s", w->spool);
+	ps->atbad = false;
+	ps->qp_l = 0;
+	ps->mod = 0;
+	ps->equals = false;
+	ps->out_l = 0;
+	if (!ps->out)
+		ps->out = allocMem(MIMEBLOCK);
+	return true;
+}				/* mimeSpool */
+
+/* The headers of a part are complete, glean them and decide what comes next */
+static void mimeHeaders(struct MIMEPARSE *ps)
+{
+	struct MHINFO *w;
+
+	stringAndChar(&ps->body, &ps->body_l, '\n');
+	prepareForBrowse(ps->body, ps->body_l);
+	w = headerLines(ps->body, ps->body + strlen(ps->body));
+	w->start = w->end = 0;
+	nzFree(ps->body);
+	ps->body = initString(&ps->body_l);
+	if (ps->depth)
+		addToListBack(&ps->stack[ps->depth - 1]->components, w);
+	else
+		ps->top = w;
+/* Nested too deep, show the rest of it as text */
+	if (ps->depth == MIMEDEPTH - 1 && w->ct >= CT_MULTI)
+		w->ct = CT_TEXT;
+	ps->ended[ps->depth] = false;
+	ps->stack[ps->depth++] = w;
+	ps->pendnl = false;
+
+	if (attachCheck(w)) {
+		ps->phase = (mimeSpool(ps, w) ? MP_ATTACH : MP_TEXT);
+		return;
+	}
+	if (w->ct >= CT_MULTI) {
+		ps->phase = MP_SKIP;
+		return;
+	}
+	ps->phase = MP_TEXT;
+}				/* mimeHeaders */
+
+/* data for the current part */
+static void mimeBody(struct MIMEPARSE *ps, const char *s, int len)
+{
+	struct MHINFO *w;
+
+	if (ps->phase == MP_TEXT) {
+		stringAndBytes(&ps->body, &ps->body_l, s, len);
+		return;
+	}
+
+	w = ps->stack[ps->depth - 1];
+	if (w->ce == CE_QP)
+		mimeQP(ps, s, len);
+	else if (w->ce == CE_64)
+		mime64(ps, s, len);
+	else
+		mimeRaw(ps, s, len);
+}				/* mimeBody */
+
+/* The current part is complete */
+static void mimeEndPart(struct MIMEPARSE *ps)
+{
+	struct MHINFO *w = ps->stack[ps->depth - 1];
+
+	if (ps->phase == MP_ATTACH) {
+		if (ps->qp_l) {	/* = or =X at the very end */
+			mimeOut(ps, '=');
+			if (ps->qp_l == 2)
+				mimeOut(ps, ps->qp[1]);
+		}
+		mimeFlush(ps);
+		close(ps->atfd);
+		if (ps->atbad) {
+			i_printf(MSG_AttNoWrite, w->spool);
+			unlink(w->spool);
+			nzFree(w->spool);
+			w->spool = 0;
+			w->atsize = 0;
+		}
+		if (w->error64 != GOOD_BASE64_DECODE)
+			mail64Error(w->error64);
+		return;
+	}
+
+/* text, or an attachment that could not be spooled */
+	w->start = w->body = ps->body;
+	w->end = w->body + ps->body_l;
+	ps->body = initString(&ps->body_l);
+	if (!w->doAttach) {
+		prepareForBrowse(w->start, w->end - w->start);
+		w->end = w->start + strlen(w->start);
+	}
+	if (w->ce == CE_QP)
+		unpackQP(w);
+	if (w->ce == CE_64) {
+		w->error64 = base64Decode(w->start, &w->end);
+		*w->end = 0;
+		if (w->error64 != GOOD_BASE64_DECODE)
+			mail64Error(w->error64);
+	}
+	if (!w->doAttach)
+		textGlean(w);
+}				/* mimeEndPart */
+
+/* Finish the current part, and close the sections within it,
+ * leaving keep sections on the stack. */
+static void mimeClose(struct MIMEPARSE *ps, int keep)
+{
+	if (ps->phase == MP_HEAD)
+		mimeHeaders(ps);
+	if (ps->phase == MP_TEXT || ps->phase == MP_ATTACH)
+		mimeEndPart(ps);
+	ps->phase = MP_SKIP;
+	ps->pendnl = false;
+	if (ps->depth > keep)
+		ps->depth = keep;
+}				/* mimeClose */
+
+/* Is this line, after the leading --, a boundary?
+ * Outer sections are checked first; inner sections are bounded by them. */
+static bool mimeBoundary(struct MIMEPARSE *ps, const char *s, int len)
+{
+	struct MHINFO *w;
+	int k;
+
+	for (k = 0; k < ps->depth; ++k) {
+		w = ps->stack[k];
+		if (w->ct < CT_MULTI || w->doAttach || ps->ended[k])
+			continue;
+		if (len < w->boundlen || memcmp(s, w->boundary, w->boundlen))
+			continue;
+		debugPrint(5, "boundary found at level %d", k);
+		mimeClose(ps, k + 1);
+		if (len > w->boundlen && s[w->boundlen] == '-')
+			ps->ended[k] = true;
+		else
+			ps->phase = MP_HEAD;
+		return true;
+	}
+	return false;
+}				/* mimeBoundary */
+
+static void mimeLine(struct MIMEPARSE *ps, const char *s, int len, bool nl)
+{
+	if (nl && len && s[len - 1] == '\r')
+		--len;
+	if (len >= 2 && s[0] == '-' && s[1] == '-' &&
+	    mimeBoundary(ps, s + 2, len - 2))
+		return;
+
+	if (ps->phase == MP_SKIP)
+		return;
+	if (ps->phase == MP_HEAD) {
+		if (!len && nl) {
+			mimeHeaders(ps);
+			return;
+		}
+		stringAndBytes(&ps->body, &ps->body_l, s, len);
+		stringAndChar(&ps->body, &ps->body_l, '\n');
+		return;
+	}
+
+/* The newline before a boundary belongs to the boundary */
+	if (ps->pendnl)
+		mimeBody(ps, "\n", 1);
+	mimeBody(ps, s, len);
+	ps->pendnl = nl;
+}				/* mimeLine */
+
+static void mimeFeed(struct MIMEPARSE *ps, const char *s, int len)
+{
+	const char *t;
+	while (len) {
+		t = memchr(s, '\n', len);
+		if (!t) {
+			stringAndBytes(&ps->line, &ps->line_l, s, len);
+			return;
+		}
+		if (ps->line_l) {
+			stringAndBytes(&ps->line, &ps->line_l, s, t - s);
+			mimeLine(ps, ps->line, ps->line_l, true);
+			ps->line_l = 0;
+		} else
+			mimeLine(ps, s, t - s, true);
+		len -= t + 1 - s;
+		s = t + 1;
+	}
+}				/* mimeFeed */
+
+static void mimeStart(struct MIMEPARSE *ps)
+{
+	memset(ps, 0, sizeof(struct MIMEPARSE));
+	ps->phase = MP_HEAD;
+	ps->line = initString(&ps->line_l);
+	ps->body = initString(&ps->body_l);
+	nattach = nimages = 0;
+	firstAttach = 0;
+	mailIsHtml = ignoreImages = false;
+}				/* mimeStart */
+
+static struct MHINFO *mimeEnd(struct MIMEPARSE *ps)
+{
+	if (ps->line_l)
+		mimeLine(ps, ps->line, ps->line_l, false);
+	if (ps->pendnl)
+		mimeBody(ps, "\n", 1);
+	mimeClose(ps, 0);
+	nzFree(ps->line);
+	nzFree(ps->body);
+	nzFree(ps->out);
+	return ps->top;
+}				/* mimeEnd */
+
 static char *headerShow(struct MHINFO *w, bool top)
 {
 	static char buf[(MHLINE + 30) * 4];
@@ -2859,15 +3963,10 @@ static void formatMail(struct MHINFO *w, bool top)
 	}
 }				/* formatMail */
 
-/* Browse the email file. */
-char *emailParse(char *buf)
+/* Format the parsed message, and save or discard the attachments */
+static char *emailFormat(struct MHINFO *w)
 {
-	struct MHINFO *w;
-	nattach = nimages = 0;
-	firstAttach = 0;
-	mailIsHtml = ignoreImages = false;
 	fm = initString(&fm_l);
-	w = headerGlean(buf, buf + strlen(buf));
 	mailIsHtml = (mailTextType(w) == CT_HTML);
 	if (mailIsHtml)
 		stringAndString(&fm, &fm_l, "<html>\n");
@@ -2884,15 +3983,47 @@ char *emailParse(char *buf)
 	if (!ismc) {
 		writeAttachments(w);
 		freeMailInfo(w);
-		nzFree(buf);
 		debugPrint(5, "mailInfo: %s", cw->mailInfo);
 	} else {
 		lastMailInfo = w;
-		lastMailText = buf;
 	}
 	return fm;
+}				/* emailFormat */
+
+/* Browse the email in buf, which is freed. */
+char *emailParse(char *buf)
+{
+	struct MIMEPARSE ps;
+	mimeStart(&ps);
+	mimeFeed(&ps, buf, strlen(buf));
+	nzFree(buf);
+	return emailFormat(mimeEnd(&ps));
 }				/* emailParse */
 
+/* Browse the email in a file, without reading it all into memory.
+ * Returns null if the file cannot be read. */
+char *emailParseFile(const char *filename)
+{
+	struct MIMEPARSE ps;
+	char *buf;
+	int fh, n;
+
+	fh = open(filename, O_RDONLY | O_BINARY);
+	if (fh < 0)
+		return 0;
+	buf = allocMem(MIMEBLOCK);
+	mimeStart(&ps);
+	while ((n = read(fh, buf, MIMEBLOCK)) > 0)
+		mimeFeed(&ps, buf, n);
+	close(fh);
+	nzFree(buf);
+	if (n < 0) {
+		freeMailInfo(mimeEnd(&ps));
+		return 0;
+	}
+	return emailFormat(mimeEnd(&ps));
+}				/* emailParseFile */
+
 /*********************************************************************
 Set up for a reply.
 This looks at the first 5 lines, which could contain
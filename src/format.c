@@ -5,6 +5,14 @@
 
 #include "eb.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /*********************************************************************
 Prepare html for text processing.
 Change nulls to spaces.
@@ -796,6 +804,7 @@ char *htmlReformat(char *buf)
 	int l, tagno, extra;
 	char *fmark;		/* mark the start of a frame */
 
+	profStart(PROF_REFORMAT);
 	cellDelimiters(buf);
 
 	anchorSwap(buf);
@@ -896,6 +905,7 @@ char *htmlReformat(char *buf)
 			strmove(fmark + 5, fmark + 6);
 	}
 
+	profEnd(PROF_REFORMAT);
 	return new;
 }				/* htmlReformat */
 
@@ -1077,92 +1087,141 @@ int byteOrderMark(const uchar * buf, int buflen)
 }				/* byteOrderMark */
 
 /*********************************************************************
-We got some data from a file or from the internet.
-Count the binary characters and decide if this is, on the whole,
-binary or text.  I allow some nonascii chars,
-like you might see in Spanish or German, and still call it text,
-but if there's too many such chars, I call it binary.
-It's not an exact science.
-utf8 sequences are considered text characters.
-If there is a leading byte order mark as per the previous routine, it's text.
+Skip past a run of ascii, counting the nulls along the way,
+if nulls is not null, and return the length of the run.
+Most text is ascii, so this is where the time goes when we look at a file.
+With sse2 we check 16 bytes at a time, with avx2, 32.
+sse2 is always there on x86_64; build with -mavx2 or -march=native for avx2.
 *********************************************************************/
 
-bool looksBinary(const uchar * buf, int buflen)
+static int asciiRun(const uchar * buf, int buflen, int *nulls)
 {
-	int i, j, bincount = 0, charcount = 0, nullcount = 0;
-	uchar c;
-	uchar seed;
+	int i = 0, n, discard;
+	unsigned high, z;
 
-	if (byteOrderMark(buf, buflen))
-		return false;
+	if (!nulls)
+		nulls = &discard;
 
-	for (i = 0; i < buflen; ++i, ++charcount) {
-		c = buf[i];
-// 0 is ascii, but not really text, and very common in binary files.
-		if (c == 0) {
-			if (++nullcount >= 10)
-				return true;
+/* binary data, nonascii right away, don't bother with the vectors */
+	if (buflen && buf[0] >= 0x80)
+		return 0;
+
+#if defined(__AVX2__)
+	const __m256i zero32 = _mm256_setzero_si256();
+	for (; i + 32 <= buflen; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+		high = _mm256_movemask_epi8(v);
+		z = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero32));
+		if (high) {
+			n = __builtin_ctz(high);
+			*nulls += __builtin_popcount(z & ((1U << n) - 1));
+			return i + n;
 		}
-		if (c < 0x80)
-			continue;
-// could represent a utf8 character
-		seed = c;
-		if ((seed & 0xfe) == 0xfe || (seed & 0xc0) == 0x80) {
-binchar:
-			++bincount;
-			continue;
+		*nulls += __builtin_popcount(z);
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i zero16 = _mm_setzero_si128();
+	for (; i + 16 <= buflen; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+		high = _mm_movemask_epi8(v);
+		z = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero16));
+		if (high) {
+			n = __builtin_ctz(high);
+			*nulls += __builtin_popcount(z & ((1U << n) - 1));
+			return i + n;
 		}
-		seed <<= 1;
-		j = 1;
-		while (seed & 0x80 && i + j < buflen
-		       && (buf[i + j] & 0xc0) == 0x80)
-			seed <<= 1, ++j;
-		if (seed & 0x80)
-			goto binchar;
-// this is valid utf8 char, don't treat it as binary.
-		i += j - 1;
-	}
-
-	return (bincount * 8 - 16 >= charcount);
-}				/* looksBinary */
+		*nulls += __builtin_popcount(z);
+	}
+#endif
 
-void looks_8859_utf8(const uchar * buf, int buflen, bool * iso_p, bool * utf8_p)
+	for (; i < buflen; ++i) {
+		if (buf[i] >= 0x80)
+			break;
+		if (!buf[i])
+			++*nulls;
+	}
+	return i;
+}				/* asciiRun */
+
+/* Length of the utf8 sequence at the start of buf, 0 if it isn't one. */
+static int utf8Seq(const uchar * buf, int buflen)
 {
-	int utfcount = 0, isocount = 0;
-	int i, j, bothcount;
+	uchar seed = buf[0];
+	int j;
 
-	for (i = 0; i < buflen; ++i) {
-		uchar c = buf[i];
-		if (c < 0x80)
-			continue;
-/* This is the start of the nonascii sequence. */
-/* No second bit, it has to be iso. */
-		if (!(c & 0x40)) {
-isogo:
-			++isocount;
-			continue;
-		}
-/* Next byte has to start with 10 to be utf8, else it's iso */
-		if ((buf[i + 1] & 0xc0) != 0x80)
-			goto isogo;
-		c <<= 2;
-		for (j = i + 2; c < 0; ++j, c <<= 1)
-			if ((buf[j] & 0xc0) != 0x80)
-				goto isogo;
-		++utfcount;
-		i = j - 1;
+	if ((seed & 0xfe) == 0xfe || (seed & 0xc0) != 0xc0)
+		return 0;
+	seed <<= 1;
+	for (j = 1; seed & 0x80; ++j, seed <<= 1)
+		if (j >= buflen || (buf[j] & 0xc0) != 0x80)
+			return 0;
+	return j;
+}				/* utf8Seq */
+
+/*********************************************************************
+We got some data from a file or from the internet.
+Is it binary, or text, and if text, is it iso8859 or utf8?
+This makes one pass over the data, and answers all three questions;
+pass null for the answers you don't need.
+Each nonascii byte either starts a valid utf8 sequence,
+which is one utf8 character, or it doesn't, and is iso8859,
+or binary, depending on how you look at it.
+*********************************************************************/
+
+void textClassify(const uchar * buf, int buflen, bool * bin_p, bool * iso_p,
+		  bool * utf8_p)
+{
+	int i = 0, n, nulls = 0;
+	int charcount = 0, isocount = 0, utfcount = 0, bothcount;
+
+	while (i < buflen) {
+		n = asciiRun(buf + i, buflen - i, &nulls);
+		i += n, charcount += n;
+		if (i == buflen)
+			break;
+// 0 is ascii, but not really text, and very common in binary files.
+		if (nulls >= 10 && !iso_p && !utf8_p)
+			break;
+		++charcount;
+		n = utf8Seq(buf + i, buflen - i);
+		if (n)
+			++utfcount, i += n;
+		else
+			++isocount, ++i;
 	}
 
-	*iso_p = *utf8_p = false;
+/*********************************************************************
+Binary: I allow some nonascii chars,
+like you might see in Spanish or German, and still call it text,
+but if there's too many such chars, I call it binary.
+It's not an exact science.
+utf8 sequences are considered text characters.
+If there is a leading byte order mark, it's text.
+*********************************************************************/
+	if (bin_p)
+		*bin_p = (!byteOrderMark(buf, buflen) &&
+			  (nulls >= 10 || isocount * 8 - 16 >= charcount));
 
 	bothcount = isocount + utfcount;
-	if (!bothcount)
-		return;		/* ascii */
 	bothcount *= 6;
-	if (utfcount * 7 >= bothcount)
-		*utf8_p = true;
-	if (isocount * 7 >= bothcount)
-		*iso_p = true;
+	if (utf8_p)
+		*utf8_p = (bothcount && utfcount * 7 >= bothcount);
+	if (iso_p)
+		*iso_p = (bothcount && isocount * 7 >= bothcount);
+}				/* textClassify */
+
+bool looksBinary(const uchar * buf, int buflen)
+{
+	bool bin;
+	textClassify(buf, buflen, &bin, 0, 0);
+	return bin;
+}				/* looksBinary */
+
+void looks_8859_utf8(const uchar * buf, int buflen, bool * iso_p, bool * utf8_p)
+{
+	textClassify(buf, buflen, 0, iso_p, utf8_p);
 }				/* looks_8859_utf8 */
 
 /*********************************************************************
@@ -1222,16 +1281,81 @@ I'm gonna go with those, and hope I'm right more often than wrong.
 	 0xfa, 0x171, 0xfc, 0xfd, 0x163, 0x2d9},
 };
 
+/*********************************************************************
+Tables for the conversions, built from iso_unicodes[] the first time
+they are needed.  type8859 is set by selectLanguage() at startup and
+doesn't change after that.  Background threads convert too,
+through force_utf8(), hence pthread_once.
+isoUtf8[c] is the utf8 for nonascii iso character c | 0x80,
+and isoReverse[u] is the iso character for unicode u, or 0 if there isn't one.
+*********************************************************************/
+
+static uchar isoUtf8[128][4];
+static uchar isoUtf8_l[128];
+static uchar *isoReverse;
+static pthread_once_t isoOnce = PTHREAD_ONCE_INIT;
+
+static int utf8Put(unsigned int unichar, uchar * outbuf);
+
+static void isoBuild(void)
+{
+	const int *isoarray;
+	int k;
+
+// We only have tables for 8859-1 and 8859-2.
+	isoarray = iso_unicodes[type8859 == 2 ? 1 : 0];
+	isoReverse = allocZeroMem(0x10000);
+	for (k = 0; k < 128; ++k) {
+		isoUtf8_l[k] = utf8Put(isoarray[k], isoUtf8[k]);
+		if (isoarray[k] < 0x10000 && !isoReverse[isoarray[k]])
+			isoReverse[isoarray[k]] = k | 0x80;
+	}
+}				/* isoBuild */
+
+static void isoTables(void)
+{
+	pthread_once(&isoOnce, isoBuild);
+}				/* isoTables */
+
+/*********************************************************************
+Each converter comes in two forms.
+The chunk form converts into a buffer that the caller provides,
+big enough for the worst case, as described for each function,
+so a large file can be converted a piece at a time.
+A character can be split across pieces; so the chunk form stops before
+an incomplete character at the end, and reports how much input it used,
+unless last is set, whence the input is converted to the end.
+It returns the length of the output.
+The other form converts a whole string into a new allocated string.
+Runs of ascii are found by asciiRun() and copied or widened
+16 bytes at a time, when we have sse2.
+*********************************************************************/
+
+/* output can be 3 times the length of the input */
+int iso2utfChunk(const uchar * inbuf, int inbuflen, uchar * outbuf)
+{
+	int i = 0, j = 0, n;
+	uchar c;
+
+	isoTables();
+	while (i < inbuflen) {
+		n = asciiRun(inbuf + i, inbuflen - i, 0);
+		memcpy(outbuf + j, inbuf + i, n);
+		i += n, j += n;
+		if (i == inbuflen)
+			break;
+		c = inbuf[i++] & 0x7f;
+		memcpy(outbuf + j, isoUtf8[c], isoUtf8_l[c]);
+		j += isoUtf8_l[c];
+	}
+	return j;
+}				/* iso2utfChunk */
+
 void iso2utf(const uchar * inbuf, int inbuflen, uchar ** outbuf_p,
 	     int *outbuflen_p)
 {
-	int i, j;
-	int nacount = 0;
-	uchar c;
+	int i, n, outlen;
 	uchar *outbuf;
-	const int *isoarray = iso_unicodes[type8859 - 1];
-	int ucode;
-	char *s;
 
 	if (!inbuflen) {
 		*outbuf_p = (uchar *) emptyString;
@@ -1240,42 +1364,82 @@ void iso2utf(const uchar * inbuf, int inbuflen, uchar ** outbuf_p,
 	}
 
 /* count chars, so we can allocate */
-	for (i = 0; i < inbuflen; ++i) {
-		c = inbuf[i];
-		if (c >= 0x80) {
-			ucode = isoarray[c & 0x7f];
-			s = uni2utf8(ucode);
-			nacount += strlen(s) - 1;
-		}
+	isoTables();
+	for (i = outlen = 0; i < inbuflen;) {
+		n = asciiRun(inbuf + i, inbuflen - i, 0);
+		i += n, outlen += n;
+		if (i == inbuflen)
+			break;
+		outlen += isoUtf8_l[inbuf[i++] & 0x7f];
 	}
 
-	outbuf = allocMem(inbuflen + nacount + 1);
+	outbuf = allocMem(outlen + 1);
+	outlen = iso2utfChunk(inbuf, inbuflen, outbuf);
+	outbuf[outlen] = 0;
+	*outbuf_p = outbuf;
+	*outbuflen_p = outlen;
+}				/* iso2utf */
+
+/* output is never longer than the input */
+int utf2isoChunk(const uchar * inbuf, int inbuflen, uchar * outbuf,
+		 int *used, bool last)
+{
+	int i = 0, j = 0, n, m;
+	uchar c, seed;
+	unsigned int ucode;
 
-	for (i = j = 0; i < inbuflen; ++i) {
+	isoTables();
+	while (i < inbuflen) {
+		n = asciiRun(inbuf + i, inbuflen - i, 0);
+		memcpy(outbuf + j, inbuf + i, n);
+		i += n, j += n;
+		if (i == inbuflen)
+			break;
 		c = inbuf[i];
-		if (c < 0x80) {
+
+/* regular chars and nonascii chars that aren't utf8 pass through. */
+/* There shouldn't be any of the latter */
+		if ((c & 0xc0) != 0xc0) {
 			outbuf[j++] = c;
+			++i;
 			continue;
 		}
-		ucode = isoarray[c & 0x7f];
-		s = uni2utf8(ucode);
-		strcpy((char *)outbuf + j, s);
-		j += strlen(s);
+
+/* n is the length of the sequence, m the continuation bytes we have */
+		for (n = 1, seed = c << 1; seed & 0x80; ++n, seed <<= 1) ;
+		if (i + n > inbuflen && !last)
+			break;
+		for (m = 1; m < n && i + m < inbuflen; ++m)
+			if ((inbuf[i + m] & 0xc0) != 0x80)
+				break;
+
+/* Convertable into 11 or 16 bit */
+		if (m == n && (n == 2 || n == 3)) {
+			ucode = c & (n == 2 ? 0x1f : 0xf);
+			ucode = (ucode << 6) | (inbuf[i + 1] & 0x3f);
+			if (n == 3)
+				ucode = (ucode << 6) | (inbuf[i + 2] & 0x3f);
+			if (isoReverse[ucode]) {
+				outbuf[j++] = isoReverse[ucode];
+				i += n;
+				continue;
+			}
+		}
+
+/* unicodes not found in our iso class are converted into stars */
+		outbuf[j++] = '*';
+		i += m;
 	}
-	outbuf[j] = 0;
 
-	*outbuf_p = outbuf;
-	*outbuflen_p = j;
-}				/* iso2utf */
+	*used = i;
+	return j;
+}				/* utf2isoChunk */
 
 void utf2iso(const uchar * inbuf, int inbuflen, uchar ** outbuf_p,
 	     int *outbuflen_p)
 {
-	int i, j, k;
-	uchar c;
 	uchar *outbuf;
-	const int *isoarray = iso_unicodes[type8859 - 1];
-	int ucode;
+	int outlen, used;
 
 	if (!inbuflen) {
 		*outbuf_p = (uchar *) emptyString;
@@ -1284,105 +1448,130 @@ void utf2iso(const uchar * inbuf, int inbuflen, uchar ** outbuf_p,
 	}
 
 	outbuf = allocMem(inbuflen + 1);
-	for (i = j = 0; i < inbuflen; ++i) {
-		c = inbuf[i];
+	outlen = utf2isoChunk(inbuf, inbuflen, outbuf, &used, true);
+	outbuf[outlen] = 0;
+	*outbuf_p = outbuf;
+	*outbuflen_p = outlen;
+}				/* utf2iso */
 
-/* regular chars and nonascii chars that aren't utf8 pass through. */
-/* There shouldn't be any of the latter */
-		if ((c & 0xc0) != 0xc0) {
-			outbuf[j++] = c;
-			continue;
-		}
+/*********************************************************************
+Widen n bytes, each a unicode below 256, into utf16 or utf32,
+big or little endian.
+With sse2, interleave 16 bytes at a time with zeros.
+*********************************************************************/
 
-/* Convertable into 11 bit */
-		if ((c & 0xe0) == 0xc0 && (inbuf[i + 1] & 0xc0) == 0x80) {
-			ucode = c & 0x1f;
-			ucode <<= 6;
-			ucode |= (inbuf[i + 1] & 0x3f);
-			for (k = 0; k < 128; ++k)
-				if (isoarray[k] == ucode)
-					break;
-			if (k < 128) {
-				outbuf[j++] = k | 0x80;
-				++i;
-				continue;
-			}
-		}
+static void widen(const uchar * in, int n, uchar * out, bool out32,
+		  bool outbig)
+{
+	int i = 0;
+	uchar c;
 
-/* Convertable into 16 bit */
-		if ((c & 0xf0) == 0xe0 &&
-		    (inbuf[i + 1] & 0xc0) == 0x80 &&
-		    (inbuf[i + 2] & 0xc0) == 0x80) {
-			ucode = c & 0xf;
-			ucode <<= 6;
-			ucode |= (inbuf[i + 1] & 0x3f);
-			ucode <<= 6;
-			ucode |= (inbuf[i + 2] & 0x3f);
-			for (k = 0; k < 128; ++k)
-				if (isoarray[k] == ucode)
-					break;
-			if (k < 128) {
-				outbuf[j++] = k | 0x80;
-				i += 2;
-				continue;
-			}
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v, lo, hi;
+	for (; i + 16 <= n; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(in + i));
+		if (outbig) {
+			lo = _mm_unpacklo_epi8(zero, v);
+			hi = _mm_unpackhi_epi8(zero, v);
+		} else {
+			lo = _mm_unpacklo_epi8(v, zero);
+			hi = _mm_unpackhi_epi8(v, zero);
 		}
-
-/* unicodes not found in our iso class are converted into stars */
-		c <<= 1;
-		++i;
-		for (++i; c < 0; ++i, c <<= 1) {
-			if ((outbuf[i] & 0xc0) != 0x80)
-				break;
+		if (!out32) {
+			_mm_storeu_si128((__m128i *) out, lo);
+			_mm_storeu_si128((__m128i *) (out + 16), hi);
+			out += 32;
+			continue;
 		}
-		outbuf[j++] = '*';
-		--i;
+		if (outbig) {
+			_mm_storeu_si128((__m128i *) out,
+					 _mm_unpacklo_epi16(zero, lo));
+			_mm_storeu_si128((__m128i *) (out + 16),
+					 _mm_unpackhi_epi16(zero, lo));
+			_mm_storeu_si128((__m128i *) (out + 32),
+					 _mm_unpacklo_epi16(zero, hi));
+			_mm_storeu_si128((__m128i *) (out + 48),
+					 _mm_unpackhi_epi16(zero, hi));
+		} else {
+			_mm_storeu_si128((__m128i *) out,
+					 _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128((__m128i *) (out + 16),
+					 _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128((__m128i *) (out + 32),
+					 _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128((__m128i *) (out + 48),
+					 _mm_unpackhi_epi16(hi, zero));
+		}
+		out += 64;
 	}
-	outbuf[j] = 0;
+#endif
 
-	*outbuf_p = outbuf;
-	*outbuflen_p = j;
-}				/* utf2iso */
+	for (; i < n; ++i) {
+		c = in[i];
+		if (out32) {
+			if (outbig)
+				*out++ = 0, *out++ = 0, *out++ = 0, *out++ = c;
+			else
+				*out++ = c, *out++ = 0, *out++ = 0, *out++ = 0;
+		} else {
+			if (outbig)
+				*out++ = 0, *out++ = c;
+			else
+				*out++ = c, *out++ = 0;
+		}
+	}
+}				/* widen */
 
 /*********************************************************************
 Convert the current line in buffer, which is either iso8859-1 or utf8,
 into utf16 or utf32, big or little endian.
 The returned string is allocated, though not really a string,
 since it will contain nulls, plenty of them in the case of utf32.
+The chunk form needs 4 bytes of output for each byte of input.
 *********************************************************************/
 
-void utfHigh(const char *inbuf, int inbuflen, char **outbuf_p, int *outbuflen_p,
-	     bool inutf8, bool out32, bool outbig)
+int utfHighChunk(const char *inbuf, int inbuflen, char *outbuf_c,
+		 int *used, bool last, bool inutf8, bool out32, bool outbig)
 {
-	uchar *outbuf;
+	uchar *outbuf = (uchar *) outbuf_c;
+	const uchar *in = (const uchar *)inbuf;
 	unsigned int unicode;
-	uchar c;
-	int i, j;
-
-	if (!inbuflen) {
-		*outbuf_p = emptyString;
-		*outbuflen_p = 0;
-		return;
+	uchar c, mask;
+	int i, j, k, n;
+	int width = (out32 ? 4 : 2);
+
+	if (!inutf8) {
+// every byte is its own unicode, that was easy
+		widen(in, inbuflen, outbuf, out32, outbig);
+		*used = inbuflen;
+		return inbuflen * width;
 	}
 
-	outbuf = allocMem(inbuflen * 4);	// worst case
-
 	i = j = 0;
 	while (i < inbuflen) {
-		c = (uchar) inbuf[i];
-		if (!inutf8 || ((c & 0xc0) != 0xc0 && (c & 0xfe) != 0xfe)) {
-			unicode = c;	// that was easy
+		n = asciiRun(in + i, inbuflen - i, 0);
+		widen(in + i, n, outbuf + j, out32, outbig);
+		i += n, j += n * width;
+		if (i == inbuflen)
+			break;
+
+		c = in[i];
+		if ((c & 0xc0) != 0xc0) {
+			unicode = c;
 			++i;
 		} else {
-			uchar mask = 0x20;
-			int k = 1;
-			++i;
+			mask = 0x20;
+			k = 1;
 			while (c & mask)
 				++k, mask >>= 1;
+			if (i + 1 + k > inbuflen && !last)
+				break;
+			++i;
 			c &= (mask - 1);
 			unicode = ((unsigned int)c) << (6 * k);
 			while (i < inbuflen && k) {
-				c = (uchar) inbuf[i];
+				c = in[i];
 				if ((c & 0xc0) != 0x80)
 					break;
 				++i, --k;
@@ -1440,14 +1629,31 @@ void utfHigh(const char *inbuf, int inbuflen, char **outbuf_p, int *outbuflen_p,
 
 	}
 
-	*outbuf_p = (char *)outbuf;
-	*outbuflen_p = j;
+	*used = i;
+	return j;
+}				/* utfHighChunk */
+
+void utfHigh(const char *inbuf, int inbuflen, char **outbuf_p, int *outbuflen_p,
+	     bool inutf8, bool out32, bool outbig)
+{
+	char *outbuf;
+	int used;
+
+	if (!inbuflen) {
+		*outbuf_p = emptyString;
+		*outbuflen_p = 0;
+		return;
+	}
+
+	outbuf = allocMem(inbuflen * 4);	// worst case
+	*outbuflen_p = utfHighChunk(inbuf, inbuflen, outbuf, &used, true,
+				    inutf8, out32, outbig);
+	*outbuf_p = outbuf;
 }				/* utfHigh */
 
-/* convert a 32 bit unicode character into utf8 */
-char *uni2utf8(unsigned int unichar)
+/* convert a 32 bit unicode character into utf8, return the length */
+static int utf8Put(unsigned int unichar, uchar * outbuf)
 {
-	static uchar outbuf[12];
 	int n = 0;
 
 	if (unichar <= 0x7f) {
@@ -1479,123 +1685,250 @@ char *uni2utf8(unsigned int unichar)
 		outbuf[n++] = 0x80 | (unichar & 0x3f);
 	}
 
-	outbuf[n] = 0;
+	return n;
+}				/* utf8Put */
+
+char *uni2utf8(unsigned int unichar)
+{
+	static uchar outbuf[12];
+	outbuf[utf8Put(unichar, outbuf)] = 0;
 	return (char *)outbuf;
 }				/* uni2utf8 */
 
-void utfLow(const char *inbuf, int inbuflen, char **outbuf_p, int *outbuflen_p,
-	    int bom)
+/*********************************************************************
+The leading run of ascii characters in utf16 or utf32, width 2 or 4,
+copied to out as bytes; return the number of characters.
+With sse2, check and narrow 16 bytes at a time.
+*********************************************************************/
+
+static int narrowAscii(const uchar * in, int inlen, uchar * out, int width,
+		       bool big)
 {
-	char *obuf;
-	int obuf_l;
-	unsigned int unicode;
-	int isbig;
-	int k, l;
-	const int *isoarray = iso_unicodes[type8859 - 1];
+	int i = 0, n = 0;
+	unsigned int u;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v, m;
+	int x;
+	if (width == 2)
+		m = _mm_set1_epi16(big ? 0x80ff : 0xff80);
+	else
+		m = _mm_set1_epi32(big ? 0x80ffffff : 0xffffff80);
+	for (; i + 16 <= inlen; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(in + i));
+		if (_mm_movemask_epi8
+		    (_mm_cmpeq_epi8(_mm_and_si128(v, m), zero)) != 0xffff)
+			break;
+		if (width == 2) {
+			if (big)
+				v = _mm_srli_epi16(v, 8);
+			v = _mm_packus_epi16(v, v);
+			_mm_storel_epi64((__m128i *) (out + n), v);
+			n += 8;
+		} else {
+			if (big)
+				v = _mm_srli_epi32(v, 24);
+			v = _mm_packs_epi32(v, v);
+			v = _mm_packus_epi16(v, v);
+			x = _mm_cvtsi128_si32(v);
+			memcpy(out + n, &x, 4);
+			n += 4;
+		}
+	}
+#endif
 
-	if (!inbuflen) {
-		*outbuf_p = emptyString;
-		*outbuflen_p = 0;
-		return;
+	for (; i + width <= inlen; i += width) {
+		if (width == 2)
+			u = (big ? (in[i] << 8) | in[i + 1] :
+			     (in[i + 1] << 8) | in[i]);
+		else
+			u = (big ?
+			     (in[i] << 24) | (in[i + 1] << 16) |
+			     (in[i + 2] << 8) | in[i + 3] :
+			     (in[i + 3] << 24) | (in[i + 2] << 16) |
+			     (in[i + 1] << 8) | in[i]);
+		if (u >= 0x80)
+			break;
+		out[n++] = u;
 	}
+	return n;
+}				/* narrowAscii */
 
-	obuf = initString(&obuf_l);
+/*********************************************************************
+Convert utf16 or utf32 into utf8 or iso8859, according to cons_utf8.
+bom is as returned by byteOrderMark().
+The chunk form does not skip past the byte order mark,
+and needs 2 bytes of output for each byte of input.
+*********************************************************************/
+
+int utfLowChunk(const char *inbuf, int inbuflen, char *outbuf_c,
+		int *used, bool last, int bom)
+{
+	const uchar *in = (const uchar *)inbuf;
+	uchar *outbuf = (uchar *) outbuf_c;
+	unsigned int unicode;
+	int isbig, width;
+	int j, l, n;
+
+	isoTables();
 	isbig = (bom & 4);
-	bom &= 3;
-	l = bom * 2;		// skip past byte order mark
+	width = ((bom & 3) == 2 ? 4 : 2);
+	l = j = 0;
 
 	while (l < inbuflen) {
-		if (bom == 2) {
-			if (l + 4 > inbuflen) {
-				unicode = '?';
-				l = inbuflen;
-			} else if (isbig) {
-				unicode = (uchar) inbuf[l];
-				unicode <<= 8;
-				unicode |= (uchar) inbuf[l + 1];
-				unicode <<= 8;
-				unicode |= (uchar) inbuf[l + 2];
-				unicode <<= 8;
-				unicode |= (uchar) inbuf[l + 3];
-				l += 4;
-			} else {
-				unicode = (uchar) inbuf[l + 3];
-				unicode <<= 8;
-				unicode |= (uchar) inbuf[l + 2];
-				unicode <<= 8;
-				unicode |= (uchar) inbuf[l + 1];
-				unicode <<= 8;
-				unicode |= (uchar) inbuf[l];
-				l += 4;
-			}
+		n = narrowAscii(in + l, inbuflen - l, outbuf + j, width, isbig);
+		l += n * width, j += n;
+		if (l >= inbuflen)
+			break;
+
+		if (l + width > inbuflen) {
+			if (!last)
+				break;
+			unicode = '?';
+			l = inbuflen;
+		} else if (width == 4) {
+			if (isbig)
+				unicode = (in[l] << 24) | (in[l + 1] << 16) |
+				    (in[l + 2] << 8) | in[l + 3];
+			else
+				unicode = (in[l + 3] << 24) | (in[l + 2] << 16) |
+				    (in[l + 1] << 8) | in[l];
+			l += 4;
 		} else {
-			if (l + 2 > inbuflen) {
-				unicode = '?';
-				l = inbuflen;
-			} else if (isbig) {
-				unicode = (uchar) inbuf[l];
-				unicode <<= 8;
-				unicode |= (uchar) inbuf[l + 1];
-				l += 2;
-			} else {
-				unicode = (uchar) inbuf[l + 1];
-				unicode <<= 8;
-				unicode |= (uchar) inbuf[l];
-				l += 2;
-			}
-			if (unicode >= 0xd800 && unicode <= 0xdbff
-			    && l + 2 <= inbuflen) {
+			unicode = (isbig ? (in[l] << 8) | in[l + 1] :
+				   (in[l + 1] << 8) | in[l]);
+			if (unicode >= 0xd800 && unicode <= 0xdbff) {
 				unsigned int pair1, pair2;
-				pair1 = unicode - 0xd800;
-				if (isbig) {
-					pair2 = (uchar) inbuf[l];
-					pair2 <<= 8;
-					pair2 |= (uchar) inbuf[l + 1];
-				} else {
-					pair2 = (uchar) inbuf[l + 1];
-					pair2 <<= 8;
-					pair2 |= (uchar) inbuf[l];
-				}
-				if (pair2 >= 0xdc00 && pair2 <= 0xdfff) {
-					pair2 -= 0xdc00;
-					l += 2;
-					unicode = pair1;
-					unicode <<= 10;
-					unicode |= pair2;
+				if (l + 4 > inbuflen && !last)
+					break;
+				if (l + 4 <= inbuflen) {
+					pair1 = unicode - 0xd800;
+					pair2 = (isbig ?
+						 (in[l + 2] << 8) | in[l + 3] :
+						 (in[l + 3] << 8) | in[l + 2]);
+					if (pair2 >= 0xdc00 && pair2 <= 0xdfff) {
+						pair2 -= 0xdc00;
+						l += 2;
+						unicode = pair1;
+						unicode <<= 10;
+						unicode |= pair2;
+					}
 				}
 			}
+			l += 2;
 		}
 
 // ok we got the unicode.
 // It now becomes utf8 or iso8859-x
 		if (cons_utf8) {
-			stringAndString(&obuf, &obuf_l, uni2utf8(unicode));
+			j += utf8Put(unicode, outbuf + j);
 			continue;
 		}
 // iso8859-x here, practically deprecated
-		if (unicode <= 127) {	// ascii
-			stringAndChar(&obuf, &obuf_l, (char)unicode);
-			continue;
-		}
-
-		for (k = 0; k < 128; ++k)
-			if (isoarray[k] == unicode)
-				break;
-		if (k < 128)
-			unicode = k | 0x80;
+		if (unicode <= 127)	// ascii
+			outbuf[j++] = unicode;
+		else if (unicode < 0x10000 && isoReverse[unicode])
+			outbuf[j++] = isoReverse[unicode];
 		else
-			unicode = '?';
-		stringAndChar(&obuf, &obuf_l, (char)unicode);
+			outbuf[j++] = '?';
 	}
 
+	*used = l;
+	return j;
+}				/* utfLowChunk */
+
+void utfLow(const char *inbuf, int inbuflen, char **outbuf_p, int *outbuflen_p,
+	    int bom)
+{
+	char *obuf;
+	int obuf_l, skip, used;
+
+	if (!inbuflen) {
+		*outbuf_p = emptyString;
+		*outbuflen_p = 0;
+		return;
+	}
+
+	skip = (bom & 3) * 2;	// skip past byte order mark
+	if (skip > inbuflen)
+		skip = inbuflen;
+	obuf = allocMem((inbuflen - skip) * 2 + 3);
+	obuf_l = utfLowChunk(inbuf + skip, inbuflen - skip, obuf, &used,
+			     true, bom);
+
 // The input string is a file or url and has 2 extra bytes after it.
 // After reformatting it should still have two extra bytes after it.
-	stringAndString(&obuf, &obuf_l, "  ");
+	obuf = reallocMem(obuf, obuf_l + 3);
+	strcpy(obuf + obuf_l, "  ");
 
 	*outbuf_p = obuf;
-	*outbuflen_p = obuf_l - 2;
+	*outbuflen_p = obuf_l;
 }				/* utfLow */
 
+/*********************************************************************
+Read a utf16 or utf32 file and convert it a block at a time,
+so we never hold the raw file and the converted text at once.
+Return the byte order mark, as per byteOrderMark(), with the text in
+data and len; or 0 if this is not such a file, or it can't be read,
+and the caller should read it the usual way.
+*********************************************************************/
+
+int utfLowFile(const char *filename, char **data, int *len)
+{
+	const int blocksize = 65536;
+	uchar head[4];
+	char *in, *out;
+	int fh, n, have, used, skip, bom, out_l, out_max;
+
+	fh = open(filename, O_RDONLY | O_BINARY);
+	if (fh < 0)
+		return 0;
+	n = read(fh, head, 4);
+	bom = (n > 0 ? byteOrderMark(head, n) : 0);
+	if (!bom) {
+		close(fh);
+		return 0;
+	}
+
+	in = allocMem(blocksize + 4);
+	skip = (bom & 3) * 2;
+	have = n - skip;
+	memcpy(in, head + skip, have);
+	out_max = blocksize * 2 + 3;
+	out = allocMem(out_max);
+	out_l = 0;
+
+	while (true) {
+		n = read(fh, in + have, blocksize);
+		if (n < 0) {
+			close(fh);
+			free(in);
+			free(out);
+			return 0;
+		}
+		have += n;
+		if (out_l + have * 2 + 3 > out_max) {
+			out_max = (out_l + have * 2 + 3) * 3 / 2;
+			out = reallocMem(out, out_max);
+		}
+		out_l += utfLowChunk(in, have, out + out_l, &used, !n, bom);
+		have -= used;
+		memmove(in, in + used, have);
+		if (!n)
+			break;
+	}
+
+	close(fh);
+	free(in);
+// two extra bytes after it, as in fdIntoMemory and utfLow
+	out = reallocMem(out, out_l + 3);
+	strcpy(out + out_l, "  ");
+	*data = out;
+	*len = out_l;
+	return bom;
+}				/* utfLowFile */
+
 // Convert from whatever it is to utf8, for javascript and css.
 // Result parameter is the new string, or null if no conversion.
 // But, if the original string is utf8, I remove the bom.
@@ -1612,10 +1945,9 @@ char *force_utf8(char *buf, int buflen)
 			i_puts(MSG_ConvUtf8);
 		utfLow(buf, buflen, &tbuf, &buflen, bom);
 // get rid of \0
-		for (s = tbuf; s < tbuf + buflen; ++s)
-			if (!*s)
-				*s = ' ';
-		*s = 0;
+		for (s = tbuf; (s = memchr(s, 0, tbuf + buflen - s)); ++s)
+			*s = ' ';
+		tbuf[buflen] = 0;
 		return tbuf;
 	}
 // Strip off the leading bom, if any, and no we're not going to put it back.
@@ -1624,15 +1956,166 @@ char *force_utf8(char *buf, int buflen)
 		memmove(buf, buf + 3, buflen);
 		buf[buflen] = 0;
 	}
-	for (s = buf; s < buf + buflen; ++s)
-		if (!*s)
-			*s = ' ';
+	for (s = buf; (s = memchr(s, 0, buf + buflen - s)); ++s)
+		*s = ' ';
 	return NULL;
 }
 
 static const char base64_chars[] =
     "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
+/* value of each base64 character, 64 if it isn't one */
+static const uchar base64_vals[256] = {
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 62, 64, 64, 64, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64, 64,
+	64, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 64,
+	64, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+};
+
+/*********************************************************************
+Vector base64, after the pshufb methods of Wojciech Mula and Daniel Lemire.
+Encoding spreads each 3 bytes into 4 sextets, then maps the sextets
+onto the alphabet with one table lookup.
+Decoding checks 16 or 32 characters at once against the alphabet,
+by their high and low nibbles, then packs the sextets back into bytes.
+This needs ssse3, or avx2 for 32 at a time;
+build with -mavx2 or -march=native.
+Otherwise it's the scalar code, which is table driven.
+*********************************************************************/
+
+#if defined(__SSSE3__)
+static inline __m128i enc64_sextets(__m128i in)
+{
+	__m128i t0, t1, t2, t3;
+	in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+						7, 6, 8, 7, 10, 9, 11, 10));
+	t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(t1, t3);
+}				/* enc64_sextets */
+
+static inline __m128i enc64_chars(__m128i x)
+{
+	__m128i shift, less;
+	shift = _mm_subs_epu8(x, _mm_set1_epi8(51));
+	less = _mm_cmpgt_epi8(_mm_set1_epi8(26), x);
+	shift = _mm_or_si128(shift, _mm_and_si128(less, _mm_set1_epi8(13)));
+	shift = _mm_shuffle_epi8(_mm_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+					       '0' - 52, '0' - 52, '0' - 52,
+					       '0' - 52, '0' - 52, '0' - 52,
+					       '0' - 52, '0' - 52, '+' - 62,
+					       '/' - 63, 'A', 0, 0), shift);
+	return _mm_add_epi8(shift, x);
+}				/* enc64_chars */
+#endif
+
+#if defined(__AVX2__)
+static inline __m256i enc64_sextets32(__m256i in)
+{
+	__m256i t0, t1, t2, t3;
+	in = _mm256_shuffle_epi8(in,
+				 _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+						  7, 6, 8, 7, 10, 9, 11, 10,
+						  1, 0, 2, 1, 4, 3, 5, 4,
+						  7, 6, 8, 7, 10, 9, 11, 10));
+	t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+	t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+	t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+	t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+	return _mm256_or_si256(t1, t3);
+}				/* enc64_sextets32 */
+
+static inline __m256i enc64_chars32(__m256i x)
+{
+	__m256i shift, less;
+	shift = _mm256_subs_epu8(x, _mm256_set1_epi8(51));
+	less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), x);
+	shift =
+	    _mm256_or_si256(shift,
+			    _mm256_and_si256(less, _mm256_set1_epi8(13)));
+	shift =
+	    _mm256_shuffle_epi8(_mm256_setr_epi8
+				('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+				 '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+				 '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+				 '/' - 63, 'A', 0, 0, 'a' - 26, '0' - 52,
+				 '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+				 '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+				 '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0),
+				shift);
+	return _mm256_add_epi8(shift, x);
+}				/* enc64_chars32 */
+#endif
+
+/* Encode n bytes, n a multiple of 3, or the tail of the data.
+ * The vector loads look ahead, but never past avail bytes.
+ * Returns the number of characters written. */
+static int enc64(const uchar * in, int n, int avail, char *out)
+{
+	int i = 0, o = 0;
+	unsigned v;
+
+#if !defined(__AVX2__) && !defined(__SSSE3__)
+	(void)avail;		/* only the vector loads need it */
+#endif
+
+#if defined(__AVX2__)
+	for (; i + 24 <= n && i + 28 <= avail; i += 24, o += 32) {
+		__m256i x =
+		    _mm256_inserti128_si256(_mm256_castsi128_si256
+					    (_mm_loadu_si128
+					     ((const __m128i *)(in + i))),
+					    _mm_loadu_si128((const __m128i *)
+							    (in + i + 12)), 1);
+		_mm256_storeu_si256((__m256i *) (out + o),
+				    enc64_chars32(enc64_sextets32(x)));
+	}
+#endif
+
+#if defined(__SSSE3__)
+	for (; i + 12 <= n && i + 16 <= avail; i += 12, o += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *) (out + o),
+				 enc64_chars(enc64_sextets(x)));
+	}
+#endif
+
+	for (; i + 3 <= n; i += 3) {
+		v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+		out[o++] = base64_chars[v >> 18];
+		out[o++] = base64_chars[(v >> 12) & 63];
+		out[o++] = base64_chars[(v >> 6) & 63];
+		out[o++] = base64_chars[v & 63];
+	}
+	if (i + 1 == n) {
+		out[o++] = base64_chars[in[i] >> 2];
+		out[o++] = base64_chars[in[i] << 4 & 63];
+		out[o++] = '=';
+		out[o++] = '=';
+	}
+	if (i + 2 == n) {
+		out[o++] = base64_chars[in[i] >> 2];
+		out[o++] = base64_chars[(in[i] << 4 | in[i + 1] >> 4) & 63];
+		out[o++] = base64_chars[(in[i + 1] << 2) & 63];
+		out[o++] = '=';
+	}
+	return o;
+}				/* enc64 */
+
 /*
  * Encode some data in base64.
  * inbuf points to the data
@@ -1644,66 +2127,138 @@ static const char base64_chars[] =
 char *base64Encode(const char *inbuf, int inlen, bool lines)
 {
 	char *out, *outstr;
-	uchar *in = (uchar *) inbuf;
-	int colno;
+	const uchar *in = (const uchar *)inbuf;
+	int n, i;
 	int outlen = ((inlen / 3) + 1) * 4;
 	++outlen;		/* zero on the end */
 	if (lines)
 		outlen += (inlen / 54) + 1;
 	outstr = out = allocMem(outlen);
-	colno = 0;
-	while (inlen >= 3) {
-		*out++ = base64_chars[(int)(*in >> 2)];
-		*out++ = base64_chars[(int)((*in << 4 | *(in + 1) >> 4) & 63)];
-		*out++ =
-		    base64_chars[(int)((*(in + 1) << 2 | *(in + 2) >> 6) & 63)];
-		*out++ = base64_chars[(int)(*(in + 2) & 63)];
-		inlen -= 3;
-		in += 3;
-		if (!lines)
-			continue;
-		colno += 4;
-		if (colno < 72)
-			continue;
-		*out++ = '\n';
-		colno = 0;
-	}
-	if (inlen == 1) {
-		*out++ = base64_chars[(int)(*in >> 2)];
-		*out++ = base64_chars[(int)(*in << 4 & 63)];
-		*out++ = '=';
-		*out++ = '=';
-		colno += 4;
-	}
-	if (inlen == 2) {
-		*out++ = base64_chars[(int)(*in >> 2)];
-		*out++ = base64_chars[(int)((*in << 4 | *(in + 1) >> 4) & 63)];
-		*out++ = base64_chars[(int)((*(in + 1) << 2) & 63)];
-		*out++ = '=';
-		colno += 4;
-	}
-/* finish the last line */
-	if (lines && colno)
+	if (!lines) {
+		out += enc64(in, inlen, inlen, out);
+		*out = 0;
+		return outstr;
+	}
+/* 54 bytes make a line of 72 characters */
+	for (i = 0; i < inlen; i += 54) {
+		n = inlen - i;
+		if (n > 54)
+			n = 54;
+		out += enc64(in + i, n, inlen - i, out);
 		*out++ = '\n';
+	}
 	*out = 0;
 	return outstr;
 }				/* base64Encode */
 
 uchar base64Bits(char c)
 {
-	if (isupperByte(c))
-		return c - 'A';
-	if (islowerByte(c))
-		return c - ('a' - 26);
-	if (isdigitByte(c))
-		return c - ('0' - 52);
-	if (c == '+')
-		return 62;
-	if (c == '/')
-		return 63;
-	return 64;		/* error */
+	return base64_vals[(uchar) c];
 }				/* base64Bits */
 
+#if defined(__SSSE3__)
+/* Check 16 characters against the alphabet, and decode them into 12 bytes.
+ * Returns false if any of them is not a base64 character. */
+static inline bool dec64_16(const char *in, char *out)
+{
+	const __m128i mask2f = _mm_set1_epi8(0x2f);
+	__m128i x, hi_nib, lo_nib, hi, lo, roll;
+	x = _mm_loadu_si128((const __m128i *)in);
+	hi_nib = _mm_and_si128(_mm_srli_epi32(x, 4), mask2f);
+	lo_nib = _mm_and_si128(x, mask2f);
+	hi = _mm_shuffle_epi8(_mm_setr_epi8(0x10, 0x10, 0x01, 0x02,
+					    0x04, 0x08, 0x04, 0x08,
+					    0x10, 0x10, 0x10, 0x10,
+					    0x10, 0x10, 0x10, 0x10), hi_nib);
+	lo = _mm_shuffle_epi8(_mm_setr_epi8(0x15, 0x11, 0x11, 0x11,
+					    0x11, 0x11, 0x11, 0x11,
+					    0x11, 0x11, 0x13, 0x1a,
+					    0x1b, 0x1b, 0x1b, 0x1a), lo_nib);
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi),
+					     _mm_setzero_si128())) != 0xffff)
+		return false;
+	roll = _mm_shuffle_epi8(_mm_setr_epi8(0, 16, 19, 4, -65, -65, -71,
+					      -71, 0, 0, 0, 0, 0, 0, 0, 0),
+				_mm_add_epi8(_mm_cmpeq_epi8(x, mask2f), hi_nib));
+	x = _mm_add_epi8(x, roll);
+/* now sextets, pack them */
+	x = _mm_maddubs_epi16(x, _mm_set1_epi32(0x01400140));
+	x = _mm_madd_epi16(x, _mm_set1_epi32(0x00011000));
+	x = _mm_shuffle_epi8(x, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9,
+					      8, 14, 13, 12, -1, -1, -1, -1));
+/* 16 bytes written, 12 of them meaningful */
+	_mm_storeu_si128((__m128i *) out, x);
+	return true;
+}				/* dec64_16 */
+#endif
+
+#if defined(__AVX2__)
+static inline bool dec64_32(const char *in, char *out)
+{
+	const __m256i mask2f = _mm256_set1_epi8(0x2f);
+	__m256i x, hi_nib, lo_nib, hi, lo, roll;
+	x = _mm256_loadu_si256((const __m256i *)in);
+	hi_nib = _mm256_and_si256(_mm256_srli_epi32(x, 4), mask2f);
+	lo_nib = _mm256_and_si256(x, mask2f);
+	hi = _mm256_shuffle_epi8(_mm256_setr_epi8
+				 (0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04,
+				  0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+				  0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04,
+				  0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+				  0x10, 0x10, 0x10, 0x10), hi_nib);
+	lo = _mm256_shuffle_epi8(_mm256_setr_epi8
+				 (0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+				  0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b,
+				  0x1b, 0x1a, 0x15, 0x11, 0x11, 0x11, 0x11,
+				  0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a,
+				  0x1b, 0x1b, 0x1b, 0x1a), lo_nib);
+	if (!_mm256_testz_si256(lo, hi))
+		return false;
+	roll = _mm256_shuffle_epi8(_mm256_setr_epi8
+				   (0, 16, 19, 4, -65, -65, -71, -71, 0, 0,
+				    0, 0, 0, 0, 0, 0, 0, 16, 19, 4, -65, -65,
+				    -71, -71, 0, 0, 0, 0, 0, 0, 0, 0),
+				   _mm256_add_epi8(_mm256_cmpeq_epi8
+						   (x, mask2f), hi_nib));
+	x = _mm256_add_epi8(x, roll);
+	x = _mm256_maddubs_epi16(x, _mm256_set1_epi32(0x01400140));
+	x = _mm256_madd_epi16(x, _mm256_set1_epi32(0x00011000));
+	x = _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9,
+						    8, 14, 13, 12, -1, -1,
+						    -1, -1, 2, 1, 0, 6, 5, 4,
+						    10, 9, 8, 14, 13, 12, -1,
+						    -1, -1, -1));
+	x = _mm256_permutevar8x32_epi32(x,
+					_mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7,
+							  7));
+/* 32 bytes written, 24 of them meaningful */
+	_mm256_storeu_si256((__m256i *) out, x);
+	return true;
+}				/* dec64_32 */
+#endif
+
+/* Decode whole blocks of base64 characters, with no whitespace or =,
+ * from in to out, which can be the same buffer, since out never passes in.
+ * Returns the number of characters consumed. */
+static int dec64(const char *in, int n, char *out)
+{
+	int i = 0;
+#if !defined(__AVX2__) && !defined(__SSSE3__)
+	(void)in, (void)n, (void)out;	/* nothing to do without vectors */
+#endif
+#if defined(__AVX2__)
+	for (; i + 32 <= n; i += 32, out += 24)
+		if (!dec64_32(in + i, out))
+			break;
+#endif
+#if defined(__SSSE3__)
+	for (; i + 16 <= n; i += 16, out += 12)
+		if (!dec64_16(in + i, out))
+			break;
+#endif
+	return i;
+}				/* dec64 */
+
 /*********************************************************************
 Decode some data in base64.
 This function operates on the data in-line.  It does not allocate a fresh
@@ -1724,11 +2279,18 @@ int base64Decode(char *start, char **end)
 	char *b64_end = *end;
 	uchar val, leftover, mod;
 	bool equals;
-	int ret = GOOD_BASE64_DECODE;
+	int ret = GOOD_BASE64_DECODE, n;
 	char c, *q, *r;
 	mod = 0;
 	equals = false;
 	for (q = r = start; q < b64_end; ++q) {
+/* on a quad boundary, take whole blocks at vector speed */
+		if (!mod && !equals) {
+			n = dec64(q, b64_end - q, r);
+			q += n, r += n / 4 * 3;
+			if (q == b64_end)
+				break;
+		}
 		c = *q;
 		if (isspaceByte(c))
 			continue;
@@ -1742,7 +2304,7 @@ int base64Decode(char *start, char **end)
 			equals = true;
 			continue;
 		}
-		val = base64Bits(c);
+		val = base64_vals[(uchar) c];
 		if (val & 64) {
 			ret = BAD_BASE64_DECODE;
 			break;
@@ -1765,6 +2327,67 @@ int base64Decode(char *start, char **end)
 	return ret;
 }				/* base64Decode */
 
+/*********************************************************************
+Decode quoted printable, in place, from start to end.
+Returns the new end.
+=\n is a soft line break, =XX is a hex byte, and a null byte becomes a space.
+An = that doesn't start either of these stays as it is.
+Runs of plain text are found with memchr and moved as a block.
+*********************************************************************/
+
+static const uchar hex_vals[256] = {
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 16, 16, 16, 16, 16, 16,
+	16, 10, 11, 12, 13, 14, 15, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 10, 11, 12, 13, 14, 15, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+};
+
+char *qpDecode(char *start, char *end)
+{
+	char *q = start, *r = start, *e;
+	uchar d, x;
+	int n;
+
+	while (q < end) {
+		e = memchr(q, '=', end - q);
+		if (!e)
+			e = end;
+		n = e - q;
+		if (r != q)
+			memmove(r, q, n);
+		r += n, q = e;
+		if (q == end)
+			break;
+/* q is on = */
+		if (q + 1 < end && q[1] == '\n') {
+			q += 2;
+			continue;
+		}
+		if (q + 2 < end &&
+		    (d = hex_vals[(uchar) q[1]]) < 16 &&
+		    (x = hex_vals[(uchar) q[2]]) < 16) {
+			d = (d << 4) | x;
+			*r++ = (d ? d : ' ');
+			q += 3;
+			continue;
+		}
+		*r++ = *q++;
+	}
+	return r;
+}				/* qpDecode */
+
 void
 iuReformat(const char *inbuf, int inbuflen, char **outbuf_p, int *outbuflen_p)
 {
@@ -0,0 +1,1209 @@
+/*********************************************************************
+html-native.c: parse html ourselves, without tidy.
+This is the other parser described at the top of html-tidy.c.
+It follows the tokenizer of html5, more or less,
+and builds edbrowse tags as it goes, open and close,
+in the same order that convertNode() would produce them from the tidy tree.
+So htmlNodesIntoTree() and everything after it can't tell the difference.
+There is no intermediate tree; each tag is created as soon as
+its token is complete, and the input can arrive in pieces,
+as it does from the internet, through htmlStreamChunk().
+The tree construction rules are a practical subset of html5:
+implied html head and body, p li dd dt option and table cells
+closed by their successors, void elements, end tags matched in scope.
+Select this parser with htmlparser = native in the config file.
+*********************************************************************/
+
+#include "eb.h"
+
+/* tokenizer states */
+enum {
+	HS_DATA, HS_RCDATA, HS_RAWTEXT, HS_PLAINTEXT,
+	HS_TAG_OPEN, HS_END_TAG_OPEN, HS_TAG_NAME,
+	HS_BEFORE_ATTR_NAME, HS_ATTR_NAME, HS_AFTER_ATTR_NAME,
+	HS_BEFORE_ATTR_VALUE, HS_ATTR_VALUE_DQ, HS_ATTR_VALUE_SQ,
+	HS_ATTR_VALUE_UQ, HS_SELF_CLOSING,
+	HS_RAW_LT, HS_RAW_END,
+	HS_MARKUP, HS_COMMENT, HS_BOGUS, HS_DOCTYPE, HS_CDATA,
+	HS_CHARREF,
+};
+
+static uchar state, refReturn;
+static int lineno;
+
+/* character data waiting to become a text node */
+static char *text;
+static int text_l;
+
+/* a character reference in progress, &amp; or &#38; */
+static char refbuf[40];
+static int ref_l;
+
+/* <!-- or <!doctype or whatever, and the end of comment, --> */
+static char decl[10];
+static int decl_l, dashes;
+
+/* the end tag that leaves rawtext or rcdata, e.g. script */
+static char rawname[12];
+static char rawbuf[12];
+static int raw_l;
+
+/* the tag being built */
+static struct {
+	char *name;
+	int name_l;
+	char *attr, *val;
+	int attr_l, val_l;
+	char **attrs, **vals;
+	int nattr, maxattr;
+	bool endtag, selfclose;
+	int line;
+	int capstart;		/* offset of < in the capture buffer */
+} tok;
+
+/*********************************************************************
+The raw html of everything below a tag that supports innerHTML
+is copied here, as it streams by.
+capDepth is the number of such tags that are open;
+when it drops to 0 the buffer empties.
+*********************************************************************/
+
+static char *cap;
+static int cap_l, capDepth;
+/* Where an implied tag, like <body>, starts in cap.
+ * That is the text or the tag that implied it.
+ * We capture everything ahead of the body, so this can be found. */
+static int textStart, impliedAt;
+#define capturing() (capDepth || (fullpage && mode < HM_IN_BODY))
+
+/* the open elements */
+struct openElt {
+	Tag *t;
+	int inner;		/* innerHTML starts here in cap */
+};
+static struct openElt *stack;
+static int nopen, maxopen;
+
+/* insertion modes, only for the start page */
+enum { HM_INITIAL, HM_IN_HEAD, HM_AFTER_HEAD, HM_IN_BODY, HM_FRAMESET };
+static uchar mode;
+static bool fullpage, htmlOpen;
+
+static const char *const voidTags[] = {
+	"area", "base", "basefont", "bgsound", "br", "col", "embed",
+	"frame", "hr", "img", "image", "input", "keygen", "link", "meta",
+	"param", "source", "track", "wbr", 0
+};
+
+static const char *const closesP[] = {
+	"address", "article", "aside", "blockquote", "center", "dd",
+	"details", "dialog", "dir", "div", "dl", "dt", "fieldset",
+	"figcaption", "figure", "footer", "form", "h1", "h2", "h3", "h4",
+	"h5", "h6", "header", "hgroup", "hr", "li", "listing", "main",
+	"menu", "nav", "ol", "p", "plaintext", "pre", "section", "summary",
+	"table", "ul", "xmp", 0
+};
+
+static const char *const headTags[] = {
+	"base", "basefont", "bgsound", "link", "meta", "noframes",
+	"noscript", "script", "style", "template", "title", 0
+};
+
+/* tags that start rawtext or rcdata, where < is not markup */
+static const char *const rawTags[] = {
+	"iframe", "noembed", "noframes", "script", "style", "xmp", 0
+};
+static const char *const rcdataTags[] = {
+	"textarea", "title", 0
+};
+
+/* whitespace is not text in these containers */
+static const char *const noWhite[] = {
+	"colgroup", "dl", "frameset", "head", "html", "ol", "select",
+	"table", "tbody", "tfoot", "thead", "tr", "ul", 0
+};
+
+/* boundaries when looking for an open tag */
+static const char *const scopeStops[] = {
+	"applet", "caption", "html", "marquee", "object", "table",
+	"td", "template", "th", 0
+};
+static const char *const buttonStops[] = {
+	"applet", "button", "caption", "html", "marquee", "object",
+	"table", "td", "template", "th", 0
+};
+static const char *const listStops[] = {
+	"applet", "caption", "dir", "html", "marquee", "menu", "object",
+	"ol", "table", "td", "template", "th", "ul", 0
+};
+static const char *const defStops[] = {
+	"caption", "dl", "html", "table", "td", "template", "th", 0
+};
+static const char *const rowStops[] = {
+	"html", "table", "tbody", "template", "tfoot", "thead", 0
+};
+static const char *const cellStops[] = {
+	"html", "table", "tbody", "template", "tfoot", "thead", "tr", 0
+};
+static const char *const tableStops[] = {
+	"html", "table", "template", 0
+};
+static const char *const selectStops[] = {
+	"html", "table", "template", 0
+};
+
+static const char *const listItem[] = { "li", 0 };
+static const char *const defItem[] = { "dd", "dt", 0 };
+static const char *const cellItem[] = { "td", "th", 0 };
+static const char *const sectionItem[] = { "tbody", "tfoot", "thead", 0 };
+static const char *const headings[] = {
+	"h1", "h2", "h3", "h4", "h5", "h6", 0
+};
+
+/*********************************************************************
+Named character references.
+This is the html 4 set, plus &apos;
+Html5 has more than two thousand, but these cover nearly all the pages
+you will ever see, and it's all tidy knew about anyways.
+The names are in strcmp order, for bsearch.
+*********************************************************************/
+
+struct entity {
+	const char *name;
+	unsigned int u;
+};
+
+static const struct entity entities[] = {
+	{"AElig", 0xc6}, {"Aacute", 0xc1}, {"Acirc", 0xc2}, {"Agrave", 0xc0},
+	{"Alpha", 0x391}, {"Aring", 0xc5}, {"Atilde", 0xc3}, {"Auml", 0xc4},
+	{"Beta", 0x392}, {"Ccedil", 0xc7}, {"Chi", 0x3a7}, {"Dagger", 0x2021},
+	{"Delta", 0x394}, {"ETH", 0xd0}, {"Eacute", 0xc9}, {"Ecirc", 0xca},
+	{"Egrave", 0xc8}, {"Epsilon", 0x395}, {"Eta", 0x397}, {"Euml", 0xcb},
+	{"Gamma", 0x393}, {"Iacute", 0xcd}, {"Icirc", 0xce}, {"Igrave", 0xcc},
+	{"Iota", 0x399}, {"Iuml", 0xcf}, {"Kappa", 0x39a}, {"Lambda", 0x39b},
+	{"Mu", 0x39c}, {"Ntilde", 0xd1}, {"Nu", 0x39d}, {"OElig", 0x152},
+	{"Oacute", 0xd3}, {"Ocirc", 0xd4}, {"Ograve", 0xd2}, {"Omega", 0x3a9},
+	{"Omicron", 0x39f}, {"Oslash", 0xd8}, {"Otilde", 0xd5}, {"Ouml", 0xd6},
+	{"Phi", 0x3a6}, {"Pi", 0x3a0}, {"Prime", 0x2033}, {"Psi", 0x3a8},
+	{"Rho", 0x3a1}, {"Scaron", 0x160}, {"Sigma", 0x3a3}, {"THORN", 0xde},
+	{"Tau", 0x3a4}, {"Theta", 0x398}, {"Uacute", 0xda}, {"Ucirc", 0xdb},
+	{"Ugrave", 0xd9}, {"Upsilon", 0x3a5}, {"Uuml", 0xdc}, {"Xi", 0x39e},
+	{"Yacute", 0xdd}, {"Yuml", 0x178}, {"Zeta", 0x396}, {"aacute", 0xe1},
+	{"acirc", 0xe2}, {"acute", 0xb4}, {"aelig", 0xe6}, {"agrave", 0xe0},
+	{"alefsym", 0x2135}, {"alpha", 0x3b1}, {"amp", 0x26}, {"and", 0x2227},
+	{"ang", 0x2220}, {"apos", 0x27}, {"aring", 0xe5}, {"asymp", 0x2248},
+	{"atilde", 0xe3}, {"auml", 0xe4}, {"bdquo", 0x201e}, {"beta", 0x3b2},
+	{"brvbar", 0xa6}, {"bull", 0x2022}, {"cap", 0x2229}, {"ccedil", 0xe7},
+	{"cedil", 0xb8}, {"cent", 0xa2}, {"chi", 0x3c7}, {"circ", 0x2c6},
+	{"clubs", 0x2663}, {"cong", 0x2245}, {"copy", 0xa9}, {"crarr", 0x21b5},
+	{"cup", 0x222a}, {"curren", 0xa4}, {"dArr", 0x21d3}, {"dagger", 0x2020},
+	{"darr", 0x2193}, {"deg", 0xb0}, {"delta", 0x3b4}, {"diams", 0x2666},
+	{"divide", 0xf7}, {"eacute", 0xe9}, {"ecirc", 0xea}, {"egrave", 0xe8},
+	{"empty", 0x2205}, {"emsp", 0x2003}, {"ensp", 0x2002},
+	{"epsilon", 0x3b5}, {"equiv", 0x2261}, {"eta", 0x3b7}, {"eth", 0xf0},
+	{"euml", 0xeb}, {"euro", 0x20ac}, {"exist", 0x2203}, {"fnof", 0x192},
+	{"forall", 0x2200}, {"frac12", 0xbd}, {"frac14", 0xbc},
+	{"frac34", 0xbe}, {"frasl", 0x2044}, {"gamma", 0x3b3}, {"ge", 0x2265},
+	{"gt", 0x3e}, {"hArr", 0x21d4}, {"harr", 0x2194}, {"hearts", 0x2665},
+	{"hellip", 0x2026}, {"iacute", 0xed}, {"icirc", 0xee}, {"iexcl", 0xa1},
+	{"igrave", 0xec}, {"image", 0x2111}, {"infin", 0x221e}, {"int", 0x222b},
+	{"iota", 0x3b9}, {"iquest", 0xbf}, {"isin", 0x2208}, {"iuml", 0xef},
+	{"kappa", 0x3ba}, {"lArr", 0x21d0}, {"lambda", 0x3bb}, {"lang", 0x2329},
+	{"laquo", 0xab}, {"larr", 0x2190}, {"lceil", 0x2308}, {"ldquo", 0x201c},
+	{"le", 0x2264}, {"lfloor", 0x230a}, {"lowast", 0x2217}, {"loz", 0x25ca},
+	{"lrm", 0x200e}, {"lsaquo", 0x2039}, {"lsquo", 0x2018}, {"lt", 0x3c},
+	{"macr", 0xaf}, {"mdash", 0x2014}, {"micro", 0xb5}, {"middot", 0xb7},
+	{"minus", 0x2212}, {"mu", 0x3bc}, {"nabla", 0x2207}, {"nbsp", 0xa0},
+	{"ndash", 0x2013}, {"ne", 0x2260}, {"ni", 0x220b}, {"not", 0xac},
+	{"notin", 0x2209}, {"nsub", 0x2284}, {"ntilde", 0xf1}, {"nu", 0x3bd},
+	{"oacute", 0xf3}, {"ocirc", 0xf4}, {"oelig", 0x153}, {"ograve", 0xf2},
+	{"oline", 0x203e}, {"omega", 0x3c9}, {"omicron", 0x3bf},
+	{"oplus", 0x2295}, {"or", 0x2228}, {"ordf", 0xaa}, {"ordm", 0xba},
+	{"oslash", 0xf8}, {"otilde", 0xf5}, {"otimes", 0x2297}, {"ouml", 0xf6},
+	{"para", 0xb6}, {"part", 0x2202}, {"permil", 0x2030}, {"perp", 0x22a5},
+	{"phi", 0x3c6}, {"pi", 0x3c0}, {"piv", 0x3d6}, {"plusmn", 0xb1},
+	{"pound", 0xa3}, {"prime", 0x2032}, {"prod", 0x220f}, {"prop", 0x221d},
+	{"psi", 0x3c8}, {"quot", 0x22}, {"rArr", 0x21d2}, {"radic", 0x221a},
+	{"rang", 0x232a}, {"raquo", 0xbb}, {"rarr", 0x2192}, {"rceil", 0x2309},
+	{"rdquo", 0x201d}, {"real", 0x211c}, {"reg", 0xae}, {"rfloor", 0x230b},
+	{"rho", 0x3c1}, {"rlm", 0x200f}, {"rsaquo", 0x203a}, {"rsquo", 0x2019},
+	{"sbquo", 0x201a}, {"scaron", 0x161}, {"sdot", 0x22c5}, {"sect", 0xa7},
+	{"shy", 0xad}, {"sigma", 0x3c3}, {"sigmaf", 0x3c2}, {"sim", 0x223c},
+	{"spades", 0x2660}, {"sub", 0x2282}, {"sube", 0x2286}, {"sum", 0x2211},
+	{"sup", 0x2283}, {"sup1", 0xb9}, {"sup2", 0xb2}, {"sup3", 0xb3},
+	{"supe", 0x2287}, {"szlig", 0xdf}, {"tau", 0x3c4}, {"there4", 0x2234},
+	{"theta", 0x3b8}, {"thetasym", 0x3d1}, {"thinsp", 0x2009},
+	{"thorn", 0xfe}, {"tilde", 0x2dc}, {"times", 0xd7}, {"trade", 0x2122},
+	{"uArr", 0x21d1}, {"uacute", 0xfa}, {"uarr", 0x2191}, {"ucirc", 0xfb},
+	{"ugrave", 0xf9}, {"uml", 0xa8}, {"upsih", 0x3d2}, {"upsilon", 0x3c5},
+	{"uuml", 0xfc}, {"weierp", 0x2118}, {"xi", 0x3be}, {"yacute", 0xfd},
+	{"yen", 0xa5}, {"yuml", 0xff}, {"zeta", 0x3b6}, {"zwj", 0x200d},
+	{"zwnj", 0x200c},
+};
+
+static int entcmp(const void *s, const void *t)
+{
+	return strcmp((const char *)s, ((const struct entity *)t)->name);
+}
+
+static const struct entity *findEntity(const char *name)
+{
+	return bsearch(name, entities, sizeof(entities) / sizeof(entities[0]),
+		       sizeof(struct entity), entcmp);
+}
+
+/* The old entities, latin1 and the four markup characters,
+ * are recognized without the trailing semicolon. */
+static bool legacyEntity(const struct entity *e)
+{
+	return (e->u <= 0xff && e->u != 0x27);
+}
+
+/* &#128; through &#159; are taken as windows 1252, like everyone else does */
+static const unsigned short cp1252[32] = {
+	0x20AC, 0x81, 0x201A, 0x192, 0x201E, 0x2026, 0x2020, 0x2021,
+	0x2C6, 0x2030, 0x160, 0x2039, 0x152, 0x8d, 0x17D, 0x8f,
+	0x90, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+	0x2DC, 0x2122, 0x161, 0x203A, 0x153, 0x9d, 0x17E, 0x178,
+};
+
+static char **refDest;
+static int *refDest_l;
+
+/* Put a unicode character into the text or the attribute value,
+ * in the console encoding, which is the encoding of the page by now.
+ * Returns false if it can't be represented. */
+static bool appendUnicode(unsigned int u)
+{
+	if (u == 0)
+		u = InternalCodeCharAlternate;
+	if (u == InternalCodeChar)
+		u = InternalCodeCharAlternate;
+	if (cons_utf8) {
+		stringAndString(refDest, refDest_l, uni2utf8(u));
+		return true;
+	}
+	if (u > 0xff)
+		return false;
+	stringAndChar(refDest, refDest_l, (char)u);
+	return true;
+}
+
+/*********************************************************************
+Resolve the character reference in refbuf, which starts with &.
+semi is true if it was terminated by a semicolon, which is in the buffer.
+next is the character after the reference, needed for a subtle rule
+in attributes, &copy= is not a copyright sign.
+*********************************************************************/
+
+static void resolveRef(bool semi, char next)
+{
+	const struct entity *e = 0;
+	unsigned int u;
+	int n, len;
+	char *d, *s;
+	bool inattr = (refReturn != HS_DATA && refReturn != HS_RCDATA);
+
+	refbuf[ref_l] = 0;
+	if (semi)
+		refbuf[--ref_l] = 0;
+
+	if (refbuf[1] == '#') {
+		bool hex = (refbuf[2] == 'x' || refbuf[2] == 'X');
+		d = refbuf + (hex ? 3 : 2);
+		u = strtoul(d, &s, (hex ? 16 : 10));
+		if (s == d)
+			goto literal;
+		if (s - d > 8)
+			u = 0xfffd;
+		if (u >= 0x80 && u < 0xa0)
+			u = cp1252[u - 0x80];
+		if (u > 0x10ffff || (u >= 0xd800 && u <= 0xdfff))
+			u = 0xfffd;
+		if (!appendUnicode(u))
+			goto literal;
+/* &#123abc, the number ends where the digits end */
+		n = s - refbuf;
+		goto rest;
+	}
+
+	if (semi) {
+		e = findEntity(refbuf + 1);
+		if (e && appendUnicode(e->u))
+			return;
+	}
+
+/* look for the longest legacy entity that is a prefix, as in &copy2020 */
+	for (len = ref_l - 1; len >= 2; --len) {
+		char c = refbuf[len + 1];
+		refbuf[len + 1] = 0;
+		e = findEntity(refbuf + 1);
+		refbuf[len + 1] = c;
+		if (e && legacyEntity(e))
+			break;
+	}
+	if (len < 2)
+		goto literal;
+	n = len + 1;
+	if (inattr && (n < ref_l || (!semi && next == '=')))
+		goto literal;
+	if (!appendUnicode(e->u))
+		goto literal;
+
+rest:
+	if (!refbuf[n])
+		return;
+	stringAndString(refDest, refDest_l, refbuf + n);
+	if (semi)
+		stringAndChar(refDest, refDest_l, ';');
+	return;
+
+literal:
+	stringAndString(refDest, refDest_l, refbuf);
+	if (semi)
+		stringAndChar(refDest, refDest_l, ';');
+}				/* resolveRef */
+
+/* Tree construction */
+
+static bool nameInList(const char *name, const char *const *list)
+{
+	for (; *list; ++list)
+		if (stringEqual(name, *list))
+			return true;
+	return false;
+}
+
+static const char *topName(void)
+{
+	return (nopen ? stack[nopen - 1].t->nodeName : emptyString);
+}
+
+/* find an open tag in the list, but don't look past the stops */
+static int findOpen(const char *const *names, const char *const *stops)
+{
+	int i;
+	const char *name;
+	for (i = nopen - 1; i >= 0; --i) {
+		name = stack[i].t->nodeName;
+		if (nameInList(name, names))
+			return i;
+		if (stops && nameInList(name, stops))
+			break;
+	}
+	return -1;
+}
+
+static int findOpen1(const char *name, const char *const *stops)
+{
+	const char *names[2];
+	names[0] = name, names[1] = 0;
+	return findOpen(names, stops);
+}
+
+static void popElement(void)
+{
+	Tag *t = stack[--nopen].t;
+	Tag *u = newTag(cf, t->nodeName);
+	if (u)
+		u->slash = true;
+	if (t->info->bits & TAG_INNERHTML) {
+		int end = (tok.capstart >= 0 ? tok.capstart : cap_l);
+		int start = stack[nopen].inner;
+		if (end > start) {
+			t->innerHTML = pullString(cap + start, end - start);
+			stripWhite(t->innerHTML);
+		}
+		if (!--capDepth && !capturing())
+			cap_l = 0;
+	}
+}
+
+static void closeThrough(int i)
+{
+	while (nopen > i)
+		popElement();
+}
+
+/* A new tag, with the attributes of the current token,
+ * or without, if the tag is implied. */
+static Tag *pushElement(const char *name, bool withattr, bool isvoid)
+{
+	Tag *t = newTag(cf, name);
+	int i, n = (withattr ? tok.nattr : 0);
+
+	if (!t)
+		return 0;
+	t->attributes = allocMem(sizeof(char *) * (n + 1));
+	t->atvals = allocMem(sizeof(char *) * (n + 1));
+	for (i = 0; i < n; ++i) {
+		t->attributes[i] = tok.attrs[i];
+		t->atvals[i] = tok.vals[i];
+	}
+	t->attributes[n] = 0;
+	t->atvals[n] = 0;
+	if (withattr)
+		tok.nattr = 0;
+
+	if (t->action == TAGACT_SCRIPT)
+		t->js_ln = tok.line;
+
+	if (isvoid) {
+		Tag *u = newTag(cf, name);
+		if (u)
+			u->slash = true;
+		return t;
+	}
+
+	if (nopen == maxopen) {
+		if (maxopen) {
+			maxopen *= 2;
+			stack =
+			    reallocMem(stack, maxopen * sizeof(struct openElt));
+		} else {
+			maxopen = 64;
+			stack = allocMem(maxopen * sizeof(struct openElt));
+		}
+	}
+	stack[nopen].t = t;
+	stack[nopen].inner = cap_l;
+	if (!withattr && impliedAt >= 0 && impliedAt < cap_l)
+		stack[nopen].inner = impliedAt;
+	++nopen;
+	if (t->info->bits & TAG_INNERHTML) {
+		t->innerHTML = emptyString;
+		++capDepth;
+	}
+	return t;
+}
+
+static void textNode(const char *s)
+{
+	Tag *t = newTag(cf, "text");
+	if (!t)
+		return;
+	t->textval = cloneString(s);
+	t->attributes = allocZeroMem(sizeof(char *));
+	t->atvals = allocZeroMem(sizeof(char *));
+	t = newTag(cf, "text");
+	if (t)
+		t->slash = true;
+}
+
+static void impliedHead(void)
+{
+	if (!htmlOpen) {
+		pushElement("html", false, false);
+		htmlOpen = true;
+	}
+	if (mode == HM_INITIAL) {
+		pushElement("head", false, false);
+		mode = HM_IN_HEAD;
+	}
+}
+
+static void closeHead(void)
+{
+	int i;
+	impliedHead();
+	if (mode == HM_IN_HEAD) {
+		i = findOpen1("head", 0);
+		if (i >= 0)
+			closeThrough(i);
+		mode = HM_AFTER_HEAD;
+	}
+}
+
+static void impliedBody(void)
+{
+	closeHead();
+	if (mode == HM_AFTER_HEAD) {
+		pushElement("body", false, false);
+		mode = HM_IN_BODY;
+	}
+}
+
+static void flushText(void)
+{
+	const char *s;
+	if (!text_l)
+		return;
+	for (s = text; *s; ++s)
+		if (!isspaceByte(*s))
+			break;
+	if (!*s) {
+/* whitespace, keep it only where it could be part of the text */
+		if (fullpage && mode < HM_IN_BODY)
+			goto done;
+		if (nameInList(topName(), noWhite))
+			goto done;
+	} else if (fullpage && mode < HM_IN_BODY &&
+		   (!nopen || nameInList(topName(), noWhite))) {
+/* text directly under html or head starts the body */
+		impliedAt = textStart;
+		impliedBody();
+	}
+	textNode(text);
+done:
+	text_l = 0;
+	text[0] = 0;
+}
+
+/* a start tag is complete, put it in the tree */
+static void startTag(void)
+{
+	const char *name = tok.name;
+	bool isvoid = nameInList(name, voidTags);
+	int i;
+
+	if (fullpage) {
+		if (stringEqual(name, "html")) {
+			if (!htmlOpen) {
+				pushElement(name, true, false);
+				htmlOpen = true;
+			}
+			return;
+		}
+		if (mode < HM_IN_BODY) {
+			if (stringEqual(name, "head")) {
+				if (htmlOpen && mode == HM_INITIAL) {
+					pushElement(name, true, false);
+					mode = HM_IN_HEAD;
+				} else
+					impliedHead();
+				return;
+			}
+			if (nameInList(name, headTags)) {
+				impliedHead();
+				goto insert;
+			}
+			if (stringEqual(name, "body")) {
+				closeHead();
+				pushElement(name, true, false);
+				mode = HM_IN_BODY;
+				return;
+			}
+			if (stringEqual(name, "frameset")) {
+				closeHead();
+				pushElement(name, true, false);
+				mode = HM_FRAMESET;
+				return;
+			}
+			impliedBody();
+		}
+		if (stringEqual(name, "head") || stringEqual(name, "body") ||
+		    stringEqual(name, "frameset"))
+			return;
+	}
+
+	if (nameInList(name, closesP) && (i = findOpen1("p", buttonStops)) >= 0)
+		closeThrough(i);
+
+	if (stringEqual(name, "li")) {
+		if ((i = findOpen(listItem, listStops)) >= 0)
+			closeThrough(i);
+	} else if (stringEqual(name, "dd") || stringEqual(name, "dt")) {
+		if ((i = findOpen(defItem, defStops)) >= 0)
+			closeThrough(i);
+	} else if (nameInList(name, headings)) {
+		if (nameInList(topName(), headings))
+			closeThrough(nopen - 1);
+	} else if (stringEqual(name, "option")) {
+		if (stringEqual(topName(), "option"))
+			closeThrough(nopen - 1);
+	} else if (stringEqual(name, "optgroup")) {
+		if (stringEqual(topName(), "option"))
+			closeThrough(nopen - 1);
+		if (stringEqual(topName(), "optgroup"))
+			closeThrough(nopen - 1);
+	} else if (stringEqual(name, "tr")) {
+		if ((i = findOpen1("tr", rowStops)) >= 0)
+			closeThrough(i);
+	} else if (stringEqual(name, "td") || stringEqual(name, "th")) {
+		if ((i = findOpen(cellItem, cellStops)) >= 0)
+			closeThrough(i);
+	} else if (nameInList(name, sectionItem)) {
+		if ((i = findOpen(sectionItem, tableStops)) >= 0)
+			closeThrough(i);
+	} else if (stringEqual(name, "a")) {
+/* anchors don't nest, the new one closes the old one */
+		if ((i = findOpen1("a", scopeStops)) >= 0)
+			closeThrough(i);
+	} else if (stringEqual(name, "button")) {
+		if ((i = findOpen1("button", scopeStops)) >= 0)
+			closeThrough(i);
+	} else if (stringEqual(name, "form")) {
+/* forms don't nest, the inner form is ignored */
+		if (findOpen1("form", 0) >= 0)
+			return;
+	} else if (stringEqual(name, "body")) {
+		if ((i = findOpen1("head", 0)) >= 0)
+			closeThrough(i);
+	} else if (stringEqual(name, "select") || stringEqual(name, "input") ||
+		   stringEqual(name, "textarea")) {
+		if ((i = findOpen1("select", selectStops)) >= 0) {
+			closeThrough(i);
+/* <select> inside <select> just closes the first one */
+			if (stringEqual(name, "select"))
+				return;
+		}
+	}
+
+insert:
+/* <foo/> is only self closing in svg and mathml */
+	if (tok.selfclose && !isvoid &&
+	    (stringEqual(name, "svg") || stringEqual(name, "math") ||
+	     findOpen1("svg", 0) >= 0 || findOpen1("math", 0) >= 0))
+		isvoid = true;
+	pushElement(name, true, isvoid);
+}				/* startTag */
+
+static void endTag(void)
+{
+	const char *name = tok.name;
+	int i;
+
+	if (stringEqual(name, "br")) {
+		pushElement(name, false, true);
+		return;
+	}
+/* everything after </body> still goes in the body, so wait for the end */
+	if (stringEqual(name, "body") || stringEqual(name, "html"))
+		return;
+	if (stringEqual(name, "head") && fullpage) {
+		if (mode == HM_IN_HEAD)
+			closeHead();
+		return;
+	}
+	if (stringEqual(name, "p"))
+		i = findOpen1(name, buttonStops);
+	else if (stringEqual(name, "li"))
+		i = findOpen1(name, listStops);
+	else if (stringEqual(name, "dd") || stringEqual(name, "dt"))
+		i = findOpen1(name, defStops);
+	else if (nameInList(name, cellItem))
+		i = findOpen1(name, cellStops);
+	else if (stringEqual(name, "tr"))
+		i = findOpen1(name, rowStops);
+	else if (nameInList(name, sectionItem) || stringEqual(name, "table")
+		 || stringEqual(name, "caption"))
+		i = findOpen1(name, tableStops);
+	else if (nameInList(name, headings))
+		i = findOpen(headings, scopeStops);
+	else
+		i = findOpen1(name, scopeStops);
+	if (i < 0) {
+		debugPrint(5, "html stray </%s> at line %d", name, tok.line);
+		return;
+	}
+	closeThrough(i);
+}				/* endTag */
+
+static void dropTag(void);
+
+/* The token is complete. Hand it to the tree and reset it. */
+static void emitTag(void)
+{
+	flushText();
+	impliedAt = tok.capstart;
+	state = HS_DATA;
+
+	if (tok.endtag)
+		endTag();
+	else {
+		startTag();
+		if (nameInList(tok.name, rawTags)) {
+			state = HS_RAWTEXT;
+			strcpy(rawname, tok.name);
+		} else if (nameInList(tok.name, rcdataTags)) {
+			state = HS_RCDATA;
+			strcpy(rawname, tok.name);
+		} else if (stringEqual(tok.name, "plaintext"))
+			state = HS_PLAINTEXT;
+	}
+
+	dropTag();
+}				/* emitTag */
+
+/* attribute name is complete, start on the value */
+static void pushAttr(void)
+{
+	if (tok.nattr + 1 >= tok.maxattr) {
+		if (tok.maxattr) {
+			tok.maxattr *= 2;
+			tok.attrs =
+			    reallocMem(tok.attrs, tok.maxattr * sizeof(char *));
+			tok.vals =
+			    reallocMem(tok.vals, tok.maxattr * sizeof(char *));
+		} else {
+/* reallocMem won't start from nothing */
+			tok.maxattr = 16;
+			tok.attrs = allocMem(tok.maxattr * sizeof(char *));
+			tok.vals = allocMem(tok.maxattr * sizeof(char *));
+		}
+	}
+	tok.attrs[tok.nattr] = tok.attr;
+	tok.attr = initString(&tok.attr_l);
+	tok.val = initString(&tok.val_l);
+}
+
+/* attribute value is complete */
+static void endAttr(void)
+{
+	int i;
+	char *name = tok.attrs[tok.nattr];
+
+	if (!tok.val_l) {
+		nzFree(tok.val);
+		tok.val = emptyString;
+	}
+	for (i = 0; i < tok.nattr; ++i)
+		if (stringEqual(tok.attrs[i], name))
+			break;
+	if (i < tok.nattr) {
+/* duplicate attribute, the first one wins */
+		nzFree(name);
+		nzFree(tok.val);
+	} else
+		tok.vals[tok.nattr++] = tok.val;
+	tok.val = 0;
+}
+
+/* Free whatever the tree didn't take, and reset for the next tag.
+ * Also used to abandon a tag that is cut off at the end of the page. */
+static void dropTag(void)
+{
+	int i;
+	if (tok.val) {
+/* in the middle of an attribute */
+		nzFree(tok.attrs[tok.nattr]);
+		nzFree(tok.val);
+		tok.val = 0;
+	}
+	for (i = 0; i < tok.nattr; ++i) {
+		nzFree(tok.attrs[i]);
+		nzFree(tok.vals[i]);
+	}
+	tok.nattr = 0;
+	tok.attr_l = 0;
+	tok.attr[0] = 0;
+	tok.name_l = 0;
+	tok.name[0] = 0;
+	tok.endtag = tok.selfclose = false;
+	tok.capstart = -1;
+}
+
+static void startRef(uchar from, char **dest, int *dest_l)
+{
+	refReturn = from;
+	refDest = dest, refDest_l = dest_l;
+	refbuf[0] = '&';
+	ref_l = 1;
+	state = HS_CHARREF;
+}
+
+static void textChar(char c)
+{
+	if (c == 0 || c == InternalCodeChar)
+		c = InternalCodeCharAlternate;
+	stringAndChar(&text, &text_l, c);
+}
+
+static void newToken(bool endtag)
+{
+	tok.endtag = endtag;
+	tok.selfclose = false;
+	tok.name_l = 0;
+	tok.name[0] = 0;
+	tok.nattr = 0;
+}
+
+/*********************************************************************
+One step of the tokenizer.
+Returns false if the character was not consumed,
+and should be given to the new state.
+*********************************************************************/
+
+static bool step(char c)
+{
+	switch (state) {
+	case HS_DATA:
+		if (c == '<') {
+			tok.capstart = (capturing() ? cap_l - 1 : -1);
+			tok.line = lineno;
+			state = HS_TAG_OPEN;
+		} else if (c == '&')
+			startRef(HS_DATA, &text, &text_l);
+		else
+			textChar(c);
+		return true;
+
+	case HS_RCDATA:
+	case HS_RAWTEXT:
+		if (c == '<') {
+			tok.capstart = (capturing() ? cap_l - 1 : -1);
+			tok.line = lineno;
+			refReturn = state;
+			state = HS_RAW_LT;
+		} else if (c == '&' && state == HS_RCDATA)
+			startRef(HS_RCDATA, &text, &text_l);
+		else
+			textChar(c);
+		return true;
+
+	case HS_PLAINTEXT:
+		textChar(c);
+		return true;
+
+	case HS_RAW_LT:
+		if (c == '/') {
+			raw_l = 0;
+			state = HS_RAW_END;
+			return true;
+		}
+		stringAndChar(&text, &text_l, '<');
+		state = refReturn;
+		return false;
+
+	case HS_RAW_END:
+		if (isalphaByte(c) && raw_l < (int)sizeof(rawbuf) - 1) {
+			rawbuf[raw_l++] = tolower((uchar) c);
+			return true;
+		}
+		rawbuf[raw_l] = 0;
+		if (stringEqual(rawbuf, rawname) &&
+		    (isspaceByte(c) || c == '/' || c == '>')) {
+			newToken(true);
+			stringAndString(&tok.name, &tok.name_l, rawbuf);
+			state = HS_TAG_NAME;
+			return false;
+		}
+		stringAndString(&text, &text_l, "</");
+		stringAndString(&text, &text_l, rawbuf);
+		state = refReturn;
+		return false;
+
+	case HS_TAG_OPEN:
+		if (isalphaByte(c)) {
+			newToken(false);
+			state = HS_TAG_NAME;
+			return false;
+		}
+		if (c == '/') {
+			state = HS_END_TAG_OPEN;
+			return true;
+		}
+		if (c == '!') {
+			decl_l = 0;
+			state = HS_MARKUP;
+			return true;
+		}
+		if (c == '?') {
+			state = HS_BOGUS;
+			return true;
+		}
+/* < followed by anything else is just a less than sign */
+		textChar('<');
+		state = HS_DATA;
+		return false;
+
+	case HS_END_TAG_OPEN:
+		if (isalphaByte(c)) {
+			newToken(true);
+			state = HS_TAG_NAME;
+			return false;
+		}
+		state = (c == '>' ? HS_DATA : HS_BOGUS);
+		return true;
+
+	case HS_TAG_NAME:
+		if (isspaceByte(c)) {
+			state = HS_BEFORE_ATTR_NAME;
+		} else if (c == '/') {
+			state = HS_SELF_CLOSING;
+		} else if (c == '>') {
+			emitTag();
+		} else
+			stringAndChar(&tok.name, &tok.name_l,
+				      tolower((uchar) (c ? c : '?')));
+		return true;
+
+	case HS_BEFORE_ATTR_NAME:
+		if (isspaceByte(c))
+			return true;
+		if (c == '/') {
+			state = HS_SELF_CLOSING;
+			return true;
+		}
+		if (c == '>') {
+			emitTag();
+			return true;
+		}
+		state = HS_ATTR_NAME;
+		stringAndChar(&tok.attr, &tok.attr_l, tolower((uchar) c));
+		return true;
+
+	case HS_ATTR_NAME:
+		if (isspaceByte(c)) {
+			state = HS_AFTER_ATTR_NAME;
+		} else if (c == '=') {
+			pushAttr();
+			state = HS_BEFORE_ATTR_VALUE;
+		} else if (c == '/' || c == '>') {
+			state = HS_AFTER_ATTR_NAME;
+			return false;
+		} else
+			stringAndChar(&tok.attr, &tok.attr_l, tolower((uchar) c));
+		return true;
+
+	case HS_AFTER_ATTR_NAME:
+		if (isspaceByte(c))
+			return true;
+		if (c == '=') {
+			pushAttr();
+			state = HS_BEFORE_ATTR_VALUE;
+			return true;
+		}
+/* attribute with no value */
+		pushAttr();
+		endAttr();
+		if (c == '/') {
+			state = HS_SELF_CLOSING;
+			return true;
+		}
+		if (c == '>') {
+			emitTag();
+			return true;
+		}
+		state = HS_ATTR_NAME;
+		stringAndChar(&tok.attr, &tok.attr_l, tolower((uchar) c));
+		return true;
+
+	case HS_BEFORE_ATTR_VALUE:
+		if (isspaceByte(c))
+			return true;
+		if (c == '"')
+			state = HS_ATTR_VALUE_DQ;
+		else if (c == '\'')
+			state = HS_ATTR_VALUE_SQ;
+		else if (c == '>') {
+			endAttr();
+			emitTag();
+		} else {
+			state = HS_ATTR_VALUE_UQ;
+			return false;
+		}
+		return true;
+
+	case HS_ATTR_VALUE_DQ:
+	case HS_ATTR_VALUE_SQ:
+		if (c == (state == HS_ATTR_VALUE_DQ ? '"' : '\'')) {
+			endAttr();
+			state = HS_BEFORE_ATTR_NAME;
+		} else if (c == '&')
+			startRef(state, &tok.val, &tok.val_l);
+		else
+			stringAndChar(&tok.val, &tok.val_l, (c ? c : '?'));
+		return true;
+
+	case HS_ATTR_VALUE_UQ:
+		if (isspaceByte(c)) {
+			endAttr();
+			state = HS_BEFORE_ATTR_NAME;
+		} else if (c == '&')
+			startRef(state, &tok.val, &tok.val_l);
+		else if (c == '>') {
+			endAttr();
+			emitTag();
+		} else
+			stringAndChar(&tok.val, &tok.val_l, (c ? c : '?'));
+		return true;
+
+	case HS_SELF_CLOSING:
+		if (c == '>') {
+			tok.selfclose = true;
+			emitTag();
+			return true;
+		}
+		state = HS_BEFORE_ATTR_NAME;
+		return false;
+
+	case HS_MARKUP:
+		decl[decl_l++] = c;
+		decl[decl_l] = 0;
+		if (stringEqual(decl, "--")) {
+			dashes = 0;
+			state = HS_COMMENT;
+		} else if (stringEqualCI(decl, "doctype")) {
+			state = HS_DOCTYPE;
+		} else if (stringEqual(decl, "[CDATA[")) {
+			dashes = 0;
+			state = HS_CDATA;
+		} else if (!memEqualCI(decl, "doctype", decl_l) &&
+			   strncmp(decl, "--", decl_l) &&
+			   strncmp(decl, "[CDATA[", decl_l)) {
+			state = (c == '>' ? HS_DATA : HS_BOGUS);
+		}
+		return true;
+
+	case HS_COMMENT:
+		if (c == '-')
+			++dashes;
+		else if (c == '>' && dashes >= 2)
+			state = HS_DATA;
+		else if (c != '!' || dashes < 2)
+			dashes = 0;
+		return true;
+
+	case HS_CDATA:
+		if (c == ']') {
+			++dashes;
+			return true;
+		}
+		if (c == '>' && dashes >= 2) {
+			for (; dashes > 2; --dashes)
+				textChar(']');
+			state = HS_DATA;
+			return true;
+		}
+		for (; dashes; --dashes)
+			textChar(']');
+		textChar(c);
+		return true;
+
+	case HS_BOGUS:
+		if (c == '>')
+			state = HS_DATA;
+		return true;
+
+	case HS_DOCTYPE:
+		if (c == '>') {
+			flushText();
+			if (fullpage && !htmlOpen && !nopen) {
+				tok.nattr = 0;
+				pushElement("doctype", false, true);
+			}
+			state = HS_DATA;
+		}
+		return true;
+
+	case HS_CHARREF:
+		if (ref_l < (int)sizeof(refbuf) - 2 &&
+		    (isalnumByte(c) || (c == '#' && ref_l == 1))) {
+			refbuf[ref_l++] = c;
+			return true;
+		}
+		state = refReturn;
+		if (c == ';' && ref_l > 1) {
+			refbuf[ref_l++] = c;
+			resolveRef(true, c);
+			return true;
+		}
+		resolveRef(false, c);
+		return false;
+	}
+
+	return true;
+}				/* step */
+
+/* the entry points */
+
+void htmlStreamStart(bool startpage)
+{
+	state = HS_DATA;
+	lineno = 1;
+	fullpage = startpage;
+	mode = (startpage ? HM_INITIAL : HM_IN_BODY);
+	htmlOpen = false;
+	nopen = 0;
+	capDepth = 0;
+	impliedAt = -1;
+	if (!cap)
+		cap = initString(&cap_l);
+	cap_l = 0;
+	if (!text)
+		text = initString(&text_l);
+	text_l = 0, text[0] = 0;
+	if (!tok.name) {
+		tok.name = initString(&tok.name_l);
+		tok.attr = initString(&tok.attr_l);
+	}
+	dropTag();
+}				/* htmlStreamStart */
+
+void htmlStreamChunk(const char *s, int len)
+{
+	int i, j;
+	char c;
+
+	for (i = 0; i < len; ++i) {
+		if (state == HS_DATA) {
+/* fast path, a run of ordinary text */
+			for (j = i; j < len; ++j) {
+				c = s[j];
+				if (c == '<' || c == '&' || c == '\n' || c == 0
+				    || c == InternalCodeChar)
+					break;
+			}
+			if (j > i) {
+				if (!text_l)
+					textStart = cap_l;
+				stringAndBytes(&text, &text_l, s + i, j - i);
+				if (capturing())
+					stringAndBytes(&cap, &cap_l, s + i, j - i);
+				i = j;
+				if (i == len)
+					break;
+			}
+		}
+		c = s[i];
+		if (!text_l)
+			textStart = cap_l;
+		if (capturing())
+			stringAndChar(&cap, &cap_l, c);
+		if (c == '\n')
+			++lineno;
+		while (!step(c)) ;
+	}
+}				/* htmlStreamChunk */
+
+void htmlStreamEnd(void)
+{
+	switch (state) {
+	case HS_CHARREF:
+		state = refReturn;
+		resolveRef(false, 0);
+		break;
+	case HS_RAW_LT:
+		stringAndChar(&text, &text_l, '<');
+		break;
+	case HS_RAW_END:
+		rawbuf[raw_l] = 0;
+		stringAndString(&text, &text_l, "</");
+		stringAndString(&text, &text_l, rawbuf);
+		break;
+	case HS_TAG_OPEN:
+		textChar('<');
+		break;
+	case HS_CDATA:
+		for (; dashes; --dashes)
+			textChar(']');
+		break;
+	}
+/* a tag cut off by the end of the page is dropped */
+	dropTag();
+	flushText();
+
+	if (fullpage && mode < HM_IN_BODY)
+		impliedBody();
+	closeThrough(0);
+	cap_l = 0;
+	capDepth = 0;
+}				/* htmlStreamEnd */
+
+void html2nodesNative(const char *htmltext, bool startpage)
+{
+	htmlStreamStart(startpage);
+	htmlStreamChunk(htmltext, strlen(htmltext));
+	htmlStreamEnd();
+}				/* html2nodesNative */
@@ -4,6 +4,8 @@ This is the only file that includes tidy.h, or accesses the tidy library.
 If you prefer a different parser in the future,
 write another file, html-foo.c, having the same connection to edbrowse,
 and change the makefile accordingly.
+html-native.c is such a parser, built in, selected by htmlparser = native
+in the config file; html2nodes hands the text over to it when asked.
 If tidy5 changes its API, you only need edit this file.
 Note that tidy has Bool yes and no, which, fortunately, do not collide with
 edbrowse bool true false.
@@ -114,6 +116,13 @@ void html2nodes(const char *htmltext, bool startpage)
 {
 	char *htmlfix = 0;
 
+	profStart(PROF_PARSE);
+	if (nativeParser) {
+		html2nodesNative(htmltext, startpage);
+		profEnd(PROF_PARSE);
+		return;
+	}
+
 	tdoc = tidyCreate();
 	if (!startpage)
 		tidyOptSetInt(tdoc, TidyBodyOnly, yes);
@@ -149,6 +158,7 @@ void html2nodes(const char *htmltext, bool startpage)
 	traverseTidy();
 
 	tidyRelease(tdoc);
+	profEnd(PROF_PARSE);
 }				/* html2nodes */
 
 /* this is strictly for debugging, level >= 5 */
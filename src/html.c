@@ -575,9 +575,9 @@ void prepareScript(Tag *t)
 // this has to happen before threads spin off
 			if (!curlActive) {
 				eb_curl_global_init();
-				cookiesFromJar();
 				setupEdbrowseCache();
 			}
+			openCookieJar();
 
 			if (down_jsbg && !demin && !uvw
 			    && !pthread_create(&t->loadthread, NULL,
@@ -770,6 +770,7 @@ void runScriptsPending(bool startbrowse)
 
 	if (newlocation && newloc_r)
 		return;
+	profStart(PROF_SCRIPTS);
 
 // Not sure where document.write objects belong.
 // For now I'm putting them under body.
@@ -900,6 +901,7 @@ I will disconnect here, and also check for inxhr in runOnload().
 afterscript:
 		if (newlocation && newloc_r) {
 			cf = save_cf;
+			profEnd(PROF_SCRIPTS);
 			return;
 		}
 
@@ -967,6 +969,7 @@ t->lic = 0;
 	}
 
 	cf = save_cf;
+	profEnd(PROF_SCRIPTS);
 }				/* runScriptsPending */
 
 void preFormatCheck(int tagno, bool * pretag, bool * slash)
@@ -994,24 +997,493 @@ static bool jsDoorway(void)
 	return false;
 }				/* jsDoorway */
 
+/*********************************************************************
+Timestamps along the way of loading a page, so we can see where the time goes,
+and in particular, how long it takes to get the first line of text.
+The stages are in eb.h, LOAD_START through LOAD_FIRSTLINE.
+A stage is stamped once; LOAD_START clears the others.
+loadReport() prints them, in milliseconds from the start, at debug level 4,
+and resets for the next page.
+*********************************************************************/
+
+static double loadTimes[LOAD_STAGES];
+static bool pipelined;		/* tags were built as the page came in */
+
+static void profReset(void);
+
+void loadStamp(int stage)
+{
+	if (stage == LOAD_START) {
+		memset(loadTimes, 0, sizeof(loadTimes));
+		profReset();
+	} else if (loadTimes[stage])
+		return;
+	loadTimes[stage] = secondsNow();
+}				/* loadStamp */
+
+void loadReport(void)
+{
+	static const char *const stageNames[] = { 0,
+		"first byte", "body", "parse", "tree", "scripts",
+		"render", "first line"
+	};
+	char buf[200];
+	int i, l;
+	long ms;
+
+	if (debugLevel >= 4 && loadTimes[LOAD_START]) {
+		l = sprintf(buf, "load%s:", (pipelined ? " pipelined" : ""));
+		for (i = LOAD_FIRSTBYTE; i < LOAD_STAGES; ++i) {
+			if (!loadTimes[i])
+				continue;
+			ms = (loadTimes[i] - loadTimes[LOAD_START]) * 1000;
+			l += sprintf(buf + l, " %s %ld", stageNames[i], ms);
+		}
+		debugPrint(4, "%s ms", buf);
+	}
+	if (cw->prof && loadTimes[LOAD_START] && loadTimes[LOAD_FIRSTLINE])
+		cw->prof->load =
+		    (loadTimes[LOAD_FIRSTLINE] - loadTimes[LOAD_START]) * 1000.0;
+	memset(loadTimes, 0, sizeof(loadTimes));
+	pipelined = false;
+}				/* loadReport */
+
+/*********************************************************************
+Time spent in each phase of a web page, summed over the calls,
+for the prof command.
+The phases are in eb.h, PROF_HTTP through PROF_RERENDER,
+and profStart() profEnd() go around the function that does the work.
+A phase that calls itself, like htmlNodesIntoTree, is timed at the outer call.
+A phase inside another, like fetching a script from within runScriptsPending,
+counts in both, so the phases can add up to more than the load time.
+Only the thread that loads the page is timed, not the background fetches.
+The times go to the current window, starting with the b command that loads it,
+and keep accumulating as timers and rerender run, until the next page.
+*********************************************************************/
+
+const char *const profNames[] = {
+	"http", "parse", "tree", "prerender", "decorate",
+	"scripts", "css", "render", "reformat", "rerender"
+};
+static pthread_t profThread;
+static bool profOn;
+static int profDepth[PROF_PHASES];
+static double profBegin[PROF_PHASES];
+
+static void profReset(void)
+{
+	profThread = pthread_self();
+	profOn = true;
+	if (!cw->prof)
+		cw->prof = allocMem(sizeof(struct PROFILE));
+	memset(cw->prof, 0, sizeof(struct PROFILE));
+}				/* profReset */
+
+void profStart(int phase)
+{
+	if (!profOn || !pthread_equal(profThread, pthread_self()))
+		return;
+	if (profDepth[phase]++)
+		return;
+	profBegin[phase] = secondsNow();
+}				/* profStart */
+
+void profEnd(int phase)
+{
+	struct PROFILE *p = cw->prof;
+
+	if (!profOn || !pthread_equal(profThread, pthread_self()))
+		return;
+	if (!profDepth[phase] || --profDepth[phase])
+		return;
+	if (!p)
+		return;
+	p->ms[phase] += (secondsNow() - profBegin[phase]) * 1000.0;
+	++p->calls[phase];
+}				/* profEnd */
+
+/*********************************************************************
+The prof command, print the times for the current buffer,
+or, with prof>file, append them to file as a line of csv,
+with a header line if the file is new.
+*********************************************************************/
+
+bool profShow(const char *csvfile)
+{
+	const struct PROFILE *p = cw->prof;
+	const char *u = cf->fileName;
+	FILE *f;
+	bool newfile;
+	int i;
+
+	if (!p) {
+		setError(MSG_ProfNone);
+		return false;
+	}
+	if (!u)
+		u = emptyString;
+
+	if (!csvfile) {
+		if (p->load)
+			i_printf(MSG_ProfLoad, p->load);
+		for (i = 0; i < PROF_PHASES; ++i)
+			if (p->calls[i])
+				i_printf(MSG_ProfPhase, profNames[i],
+					 p->ms[i], p->calls[i]);
+		return true;
+	}
+
+	skipWhite(&csvfile);
+	if (!*csvfile) {
+		setError(MSG_NoFileSpecified);
+		return false;
+	}
+	newfile = (fileSizeByName(csvfile) <= 0);
+	f = fopen(csvfile, "a");
+	if (!f) {
+		setError(MSG_NoOpen, csvfile);
+		return false;
+	}
+	if (newfile) {
+		fprintf(f, "url,load");
+		for (i = 0; i < PROF_PHASES; ++i)
+			fprintf(f, ",%s,%s_calls", profNames[i], profNames[i]);
+		fprintf(f, "\n");
+	}
+/* quote the url, and double any quotes within */
+	fputc('"', f);
+	for (; *u; ++u) {
+		if (*u == '"')
+			fputc('"', f);
+		fputc(*u, f);
+	}
+	fprintf(f, "\",%.3f", p->load);
+	for (i = 0; i < PROF_PHASES; ++i)
+		fprintf(f, ",%.3f,%d", p->ms[i], p->calls[i]);
+	fprintf(f, "\n");
+	if (fclose(f)) {
+		setError(MSG_NoWrite2, csvfile);
+		return false;
+	}
+	return true;
+}				/* profShow */
+
+/*********************************************************************
+Pipelined page load.
+With the native parser, a web page can be tokenized as it comes in
+from the internet, rather than waiting for the last byte.
+eb_curl_callback() hands each block of a browsable html page
+to pipelineChunk(), which does, on the fly, what readFile()
+and prepareForBrowse() would do to the whole page:
+convert between iso8859 and utf8, change nulls to spaces,
+replace InternalCodeChar, and drop the \r from \r\n.
+The result goes to htmlStreamChunk(), which builds the tags.
+When the page is complete the tags are set aside, off the window,
+because we don't know yet that the page will be browsed,
+or that readFile will make the same choices about the character set.
+So we keep the length and a hash of the text that went into the parser.
+htmlParse() compares them with the text it is asked to parse,
+and uses the tags if they match, or throws them away and starts over.
+If the command ends without calling htmlParse, runCommand() throws them away.
+The tags belong to the window that was current when the download began,
+and that is always the new window, see readFile().
+*********************************************************************/
+
+static struct {
+	bool active;		/* download in progress */
+	bool ready;		/* download complete, tags set aside */
+	uchar conv;		/* 0 ascii so far, 'u' as is, 'i' iso2utf, 'o' utf2iso */
+	bool start;		/* at the start, watch for the byte order mark */
+	char *carry;		/* held back for the next block */
+	int carry_l;
+	int length;
+	unsigned hash;
+	struct ebWindow held;	/* tags of the page, set aside */
+} pipeline;
+
+#define PIPE_HASH_INIT 2166136261U
+
+void pipelineDrop(void)
+{
+	if (pipeline.active) {
+// the tags are still on the window, and the window is still current.
+		freeTags(cw);
+	}
+	if (pipeline.ready)
+		freeTags(&pipeline.held);
+	pipeline.active = pipeline.ready = false;
+	nzFree(pipeline.carry);
+	pipeline.carry = 0, pipeline.carry_l = 0;
+}				/* pipelineDrop */
+
+void pipelineStart(void)
+{
+	pipelineDrop();
+	if (tagList)		/* should never happen */
+		return;
+	pipeline.active = true;
+	pipeline.conv = 0;
+	pipeline.start = true;
+	pipeline.length = 0;
+	pipeline.hash = PIPE_HASH_INIT;
+	debugPrint(3, "pipelined load");
+	initTagArray();
+	htmlStreamStart(true);
+}				/* pipelineStart */
+
+static unsigned pipeHash(unsigned h, const char *s, int len)
+{
+	int i;
+	for (i = 0; i < len; ++i) {
+		h ^= (uchar) s[i];
+		h *= 16777619;
+	}
+	return h;
+}				/* pipeHash */
+
+/* length of an incomplete utf8 sequence at the end of the block */
+static int utf8Tail(const uchar * s, int len)
+{
+	int i, need;
+	for (i = 1; i <= 3 && i <= len; ++i) {
+		uchar c = s[len - i];
+		if ((c & 0xc0) == 0x80)
+			continue;
+		if ((c & 0xe0) == 0xc0)
+			need = 2;
+		else if ((c & 0xf0) == 0xe0)
+			need = 3;
+		else if ((c & 0xf8) == 0xf0)
+			need = 4;
+		else
+			return 0;
+		return (i < need ? i : 0);
+	}
+	return 0;
+}				/* utf8Tail */
+
+/*********************************************************************
+Convert and prepare a block, and pass it to the parser.
+Some bytes at the end may be held back, to be joined with the next block:
+a \r that might be followed by \n, a partial utf8 sequence,
+or text we can't classify yet, because it is the first nonascii text
+and there isn't enough of it to know whether it is utf8 or iso8859.
+last means there is no more data, so nothing is held back.
+*********************************************************************/
+
+#define PIPE_CLASSIFY 256
+
+static void pipeBlock(const char *s, int len, bool last)
+{
+	char *w, *t, *keep;
+	int w_l, t_l, i, j, hold = 0;
+	uchar c;
+	bool is8859, isutf8, cr = false;
+
+	w = initString(&w_l);
+	stringAndBytes(&w, &w_l, pipeline.carry, pipeline.carry_l);
+	stringAndBytes(&w, &w_l, s, len);
+	nzFree(pipeline.carry);
+	pipeline.carry = 0, pipeline.carry_l = 0;
+
+	if (pipeline.start) {
+		if (w_l < 4 && !last) {
+			pipeline.carry = w, pipeline.carry_l = w_l;
+			return;
+		}
+		pipeline.start = false;
+		if (byteOrderMark((uchar *) w, w_l)) {
+/* utf16 or utf32, readFile converts the whole page; let it. */
+			debugPrint(3, "pipeline stops at the byte order mark");
+			nzFree(w);
+			pipelineDrop();
+			return;
+		}
+	}
+
+/* the first nonascii text decides how to convert, if at all */
+	if (!pipeline.conv && iuConvert) {
+		for (i = 0; i < w_l; ++i)
+			if ((uchar) w[i] >= 0x80)
+				break;
+		if (i < w_l && w_l - i < PIPE_CLASSIFY && !last) {
+			hold = w_l - i;
+		} else if (i < w_l) {
+			looks_8859_utf8((uchar *) w + i, w_l - i, &is8859,
+					&isutf8);
+			pipeline.conv = 'u';
+			if (cons_utf8 && is8859)
+				pipeline.conv = 'i';
+			if (!cons_utf8 && isutf8)
+				pipeline.conv = 'o';
+/* readFile strips the byte order mark from utf8 */
+			if (cons_utf8 && isutf8 && pipeline.length == 0 &&
+			    i == 0 && w_l >= 3 && !memcmp(w, "\xef\xbb\xbf", 3)) {
+				w_l -= 3;
+				memmove(w, w + 3, w_l + 1);
+			}
+		}
+	}
+	if (pipeline.conv == 'o' && !last)
+		hold = utf8Tail((uchar *) w, w_l);
+	keep = pullString(w + w_l - hold, hold);
+	w_l -= hold;
+	w[w_l] = 0;
+
+	if (pipeline.conv == 'i') {
+		iso2utf((uchar *) w, w_l, (uchar **) & t, &t_l);
+		nzFree(w);
+		w = t, w_l = t_l;
+	}
+	if (pipeline.conv == 'o') {
+		utf2iso((uchar *) w, w_l, (uchar **) & t, &t_l);
+		nzFree(w);
+		w = t, w_l = t_l;
+	}
+
+/* This is prepareForBrowse, a block at a time. */
+	for (i = j = 0; i < w_l; ++i) {
+		c = w[i];
+		if (c == 0)
+			c = ' ';
+		if (c == '\b') {
+/* backspace can reach back into the previous block; don't bother */
+			debugPrint(3, "pipeline stops at backspace");
+			nzFree(w);
+			nzFree(keep);
+			pipelineDrop();
+			return;
+		}
+		if (c == InternalCodeChar)
+			c = InternalCodeCharAlternate;
+		if (c == '\r') {
+			if (i == w_l - 1 && !hold && !last) {
+				cr = true;
+				break;
+			}
+			if (w[i + 1] == '\n')
+				continue;
+		}
+		w[j++] = c;
+	}
+	w_l = j;
+
+	pipeline.length += w_l;
+	pipeline.hash = pipeHash(pipeline.hash, w, w_l);
+	htmlStreamChunk(w, w_l);
+	nzFree(w);
+
+	if (cr || hold) {
+		pipeline.carry = initString(&pipeline.carry_l);
+		if (cr)
+			stringAndChar(&pipeline.carry, &pipeline.carry_l, '\r');
+		stringAndBytes(&pipeline.carry, &pipeline.carry_l, keep, hold);
+	}
+	nzFree(keep);
+}				/* pipeBlock */
+
+void pipelineChunk(const char *s, int len)
+{
+	if (pipeline.active) {
+		profStart(PROF_PARSE);
+		pipeBlock(s, len, false);
+		profEnd(PROF_PARSE);
+	}
+}				/* pipelineChunk */
+
+void pipelineEnd(void)
+{
+	struct ebWindow *w = cw;
+
+	if (!pipeline.active)
+		return;
+	profStart(PROF_PARSE);
+	if (pipeline.carry_l) {
+		pipeBlock(emptyString, 0, true);
+		if (!pipeline.active) {
+			profEnd(PROF_PARSE);
+			return;
+		}
+	}
+	htmlStreamEnd();
+	profEnd(PROF_PARSE);
+	loadStamp(LOAD_PARSE);
+
+/* set the tags aside */
+	pipeline.held.tags = w->tags;
+	pipeline.held.numTags = w->numTags;
+	pipeline.held.allocTags = w->allocTags;
+	pipeline.held.deadTags = w->deadTags;
+	pipeline.held.scriptlist = w->scriptlist;
+	pipeline.held.inputlist = w->inputlist;
+	pipeline.held.optlist = w->optlist;
+	pipeline.held.linklist = w->linklist;
+	pipeline.held.framelist = w->framelist;
+	w->tags = 0;
+	w->numTags = w->allocTags = w->deadTags = 0;
+	w->inputlist = w->scriptlist = w->optlist = w->linklist = 0;
+	w->framelist = 0;
+	pipeline.active = false;
+	pipeline.ready = true;
+}				/* pipelineEnd */
+
+/* Does the html text match what went through the pipeline?
+ * If so, put the tags back on the current window. */
+static bool pipelineMatch(const char *buf)
+{
+	struct ebWindow *w = cw;
+	int len;
+
+	if (pipeline.active)
+		pipelineDrop();
+	if (!pipeline.ready)
+		return false;
+	len = strlen(buf);
+	if (tagList || len != pipeline.length ||
+	    pipeHash(PIPE_HASH_INIT, buf, len) != pipeline.hash) {
+		debugPrint(3, "pipelined tags discarded");
+		pipelineDrop();
+		return false;
+	}
+
+	w->tags = pipeline.held.tags;
+	w->numTags = pipeline.held.numTags;
+	w->allocTags = pipeline.held.allocTags;
+	w->deadTags = pipeline.held.deadTags;
+	w->scriptlist = pipeline.held.scriptlist;
+	w->inputlist = pipeline.held.inputlist;
+	w->optlist = pipeline.held.optlist;
+	w->linklist = pipeline.held.linklist;
+	w->framelist = pipeline.held.framelist;
+	pipeline.held.tags = 0;
+	pipeline.ready = false;
+	return true;
+}				/* pipelineMatch */
+
 char *htmlParse(char *buf, int remote)
 {
 	char *a, *newbuf;
 
-	if (tagList)
+	pipelined = pipelineMatch(buf);
+	if (tagList && !pipelined)
 		i_printfExit(MSG_HtmlNotreentrant);
 	if (remote >= 0)
 		browseLocal = !remote;
-	initTagArray();
 	cf->baseset = false;
 	cf->hbase = cloneString(cf->fileName);
 
-/* call the tidy parser to build the html nodes */
-	html2nodes(buf, true);
+/* call the tidy parser to build the html nodes,
+ * unless they were built as the page came in. */
+	if (!pipelined) {
+		initTagArray();
+		html2nodes(buf, true);
+		loadStamp(LOAD_PARSE);
+	}
 	nzFree(buf);
 	htmlGenerated = false;
 	htmlNodesIntoTree(0, NULL);
 	prerender(false);
+	loadStamp(LOAD_TREE);
 
 /* if the html doesn't use javascript, then there's
  * no point in generating it.
@@ -1051,12 +1523,14 @@ jsRunScript is protected.
 
 		runScriptsPending(false);
 		rebuildSelectors();
+		loadStamp(LOAD_SCRIPTS);
 	}
 
 	a = render(0);
 	debugPrint(6, "|%s|\n", a);
 	newbuf = htmlReformat(a);
 	nzFree(a);
+	loadStamp(LOAD_RENDER);
 
 	return newbuf;
 }				/* htmlParse */
@@ -1238,12 +1712,13 @@ updateFieldInBuffer(int tagno, const char *newtext, bool notify, bool fromForm)
 
 	if (locateTagInBuffer(tagno, &ln, &p, &s, &t)) {
 		n = (plen = pstLength((pst) p)) + strlen(newtext) - (t - s);
-		new = allocMem(n);
+		new = (char *)allocLine(n);
 		memcpy(new, p, s - p);
 		strcpy(new + (s - p), newtext);
 		memcpy(new + strlen(new), t, plen - (t - p));
-		free(cw->map[ln].text);
+		releaseLine(cw->map[ln].text);
 		cw->map[ln].text = (pst) new;
+		cw->map[ln].len = n;
 		if (notify)
 			displayLine(ln);
 		return;
@@ -2474,6 +2949,7 @@ void rerender(bool rr_command)
 	void (*say_fn) (int, ...);
 
 	debugPrint(4, "rerender");
+	profStart(PROF_RERENDER);
 	cw->mustrender = false;
 	time(&cw->nextrender);
 	cw->nextrender += rr_interval;
@@ -2490,6 +2966,7 @@ void rerender(bool rr_command)
 	if (!unfoldBufferW(cw, false, &snap, &j)) {
 		snap = 0;
 		puts("no screen snap available");
+		profEnd(PROF_RERENDER);
 		return;
 	}
 
@@ -2526,6 +3003,7 @@ void rerender(bool rr_command)
 			i_puts(MSG_NoChange);
 		nzFree(newbuf);
 		nzFree(snap);
+		profEnd(PROF_RERENDER);
 		return;
 	}
 
@@ -2613,6 +3091,7 @@ and new internal numbers each time, and that use to trip this algorithm.
 done:
 	nzFree(newbuf);
 	nzFree(snap);
+	profEnd(PROF_RERENDER);
 }				/* rerender */
 
 /* mark the tags on the deleted lines as deleted */
@@ -3911,6 +4390,7 @@ unparen:
 char *render(int start)
 {
 	Frame *f;
+	profStart(PROF_RENDER);
 	for (f = &cw->f0; f; f = f->next)
 		if (f->cx)
 			set_property_bool_win(f, "rr$start", true);
@@ -3921,6 +4401,7 @@ char *render(int start)
 	currentForm = currentA = NULL;
 	traverse_callback = renderNode;
 	traverseAll(start);
+	profEnd(PROF_RENDER);
 	return ns;
 }				/* render */
 
@@ -335,6 +335,32 @@ static CURLcode fetch_internet(struct i_get *g)
 	return curlret;
 }				/* fetch_internet */
 
+/*********************************************************************
+A block of the web page we are about to browse, pass it along
+to the html pipeline, see pipelineChunk() in html.c.
+The first block of each transfer starts the pipeline, if this is html;
+a redirect or an error page has its own transfer, and isn't parsed.
+*********************************************************************/
+
+static void pipeBlock(struct i_get *g, const char *incoming, int n)
+{
+	if (g->length) {
+		pipelineChunk(incoming, n);
+		return;
+	}
+
+	loadStamp(LOAD_FIRSTBYTE);
+	if (g->is_http)
+		curl_easy_getinfo(g->h, CURLINFO_RESPONSE_CODE, &(g->code));
+	if ((g->is_http && g->code != 200) ||
+	    !stringEqual(g->content, "text/html")) {
+		pipelineDrop();
+		return;
+	}
+	pipelineStart();
+	pipelineChunk(incoming, n);
+}				/* pipeBlock */
+
 /* Callback used by libcurl. Captures data from http, ftp, pop3, gopher.
  * download states:
  * -1 user aborted the download
@@ -408,6 +434,8 @@ eb_curl_callback(char *incoming, size_t size, size_t nitems, struct i_get * g)
 
 showdots:
 	dots1 = g->length / CHUNKSIZE;
+	if (g->down_state == 0 && g->pipeline)
+		pipeBlock(g, incoming, num_bytes);
 	if (g->down_state == 0)
 		stringAndBytes(&g->buffer, &g->length, incoming, num_bytes);
 	else
@@ -800,7 +828,7 @@ static void urlSanitize(struct i_get *g, const char *post)
 	}
 }				/* urlSanitize */
 
-bool httpConnect(struct i_get *g)
+static bool httpConnect1(struct i_get *g)
 {
 	const char *url = g->url;
 	char *cacheData = NULL;
@@ -874,12 +902,11 @@ mimestream:
 
 	if (!curlActive) {
 		eb_curl_global_init();
-		cookiesFromJar();
 		setupEdbrowseCache();
 	}
 
 	if (stringEqualCI(prot, "http") || stringEqualCI(prot, "https")) {
-		;		/* ok for now */
+		openCookieJar();
 	} else if (stringEqualCI(prot, "gopher")) {
 		return gopherConnect(g);
 	} else if (stringEqualCI(prot, "ftp") ||
@@ -1427,6 +1454,16 @@ curl_fail:
 	i_get_free(g, false);
 	g->referrer = referrer;
 	return transfer_status;
+}				/* httpConnect1 */
+
+/* the work is in httpConnect1, this times it for the prof command */
+bool httpConnect(struct i_get *g)
+{
+	bool rc;
+	profStart(PROF_HTTP);
+	rc = httpConnect1(g);
+	profEnd(PROF_HTTP);
+	return rc;
 }				/* httpConnect */
 
 static int tsn;			// thread sequence number
@@ -2570,16 +2607,19 @@ ebcurl_debug_handler(CURL * handle, curl_infotype info_desc, char *data,
 	FILE *f = debugFile ? debugFile : stdout;
 
 // There's a special case where this function is used
-// by the imap client to see if the server is move capable.
+// by the imap client to see if the server is move capable,
+// and if it has condstore, to tell us what changed since last time.
 	if (ismc & isimap && info_desc == CURLINFO_HEADER_IN &&
 	    size > 17 && !strncmp(data, "* CAPABILITY IMAP", 17)) {
 		char *s;
 // data may not be null terminated; can't use strstr
-		for (s = data; s < data + size - 6; ++s)
-			if (!strncmp(s, " MOVE", 5) && isspace(s[5])) {
+		for (s = data; s < data + size - 6; ++s) {
+			if (!strncmp(s, " MOVE", 5) && isspace(s[5]))
 				g->move_capable = true;
-				break;
-			}
+			if (s < data + size - 11 &&
+			    !strncmp(s, " CONDSTORE", 10) && isspace(s[10]))
+				g->condstore_capable = true;
+		}
 	}
 	if (debugLevel < 4)
 		return 0;
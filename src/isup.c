@@ -1488,6 +1488,7 @@ bool receiveCookie(const char *url, const char *str)
 
 	if (!curlActive)
 		return false;
+	openCookieJar();
 	debugPrint(3, "cookie %s", str);
 
 	server = getHostURL(url);
@@ -1665,6 +1666,21 @@ void cookiesFromJar(void)
 	freeList(&cookies);
 }
 
+/*********************************************************************
+The jar is read on the first http request, or the first cookie
+that comes in some other way, not when curl starts up.
+ftp, gopher, and email have no use for it,
+and editing local files never starts curl at all.
+Background fetches can get here at the same time, hence pthread_once.
+*********************************************************************/
+
+static pthread_once_t jarOnce = PTHREAD_ONCE_INIT;
+
+void openCookieJar(void)
+{
+	pthread_once(&jarOnce, cookiesFromJar);
+}				/* openCookieJar */
+
 bool isInDomain(const char *d, const char *s)
 {
 	int dl = strlen(d);
@@ -18,6 +18,8 @@ int sideBuffer(int cx, const char *text, int textlen, const char *bufname){ retu
 struct MACCOUNT accounts[MAXACCOUNT];
 int maxAccount;		/* how many email accounts specified */
 void preFormatCheck(int tagno, bool * pretag, bool * slash) {}
+void profStart(int phase) {}
+void profEnd(int phase) {}
 bool isDataURI(const char *u){ return false; }
 void unpercentString(char *s) {}
 
@@ -1394,7 +1394,10 @@ Thus js_main is global instead of static,
 so it can be called from main(), the lowest point in the stack.
 If it is called for the first time from a function in .ebrc,
 a higher point in the stack, that triggers the bug.
-Unfortunately this sets up javascript, whether you are going to use it or not.
+The runtime is cheap, it is the stack mark that matters here.
+The master window context, with all its builtin objects, is the expensive part,
+and it waits for the first browse with javascript, see masterContext().
+So editing files, or running scripts, doesn't pay for javascript.
 *********************************************************************/
 
 void js_main(void)
@@ -1411,10 +1414,18 @@ void js_main(void)
 // and it eats up the stack.
 	if(strlen(thirdJS) > 50000)
 		JS_SetMaxStackSize(jsrt, 2048*1024);
-	mwc = JS_NewContext(jsrt);
 	js_running = true;
 }
 
+static JSContext *masterContext(void)
+{
+	if (!mwc) {
+		mwc = JS_NewContext(jsrt);
+		debugPrint(3, "create js master context");
+	}
+	return mwc;
+}
+
 // base64 encode
 static JSValue nat_btoa(JSContext * cx, JSValueConst this, int argc, JSValueConst *argv)
 {
@@ -2858,6 +2869,8 @@ static void createJSContext_0(Frame *f)
 	JSValue g, d;
 	if(!js_running)
 		return;
+	if (!masterContext())
+		return;
 	cx = f->cx = JS_NewContext(jsrt);
 	if (!cx)
 		return;
@@ -3771,7 +3784,8 @@ void jsUnroot(void)
 void jsClose(void)
 {
 	if(js_running) {
-		JS_FreeContext(mwc);
+		if (mwc)
+			JS_FreeContext(mwc);
 		grabover();
 		JS_FreeRuntime(jsrt);
 	}
@@ -26,6 +26,7 @@ char *userAgents[MAXAGENT + 1];
 char *currentAgent;
 bool allowRedirection = true, allowJS = true, sendReferrer = true;
 bool blockJS;
+bool nativeParser;
 bool ftpActive;
 int webTimeout = 20, mailTimeout = 0;
 int displayLength = 500;
@@ -44,6 +45,7 @@ bool inInput, listNA;
 int fileSize;
 char *dbarea, *dblogin, *dbpw;	/* to log into the database */
 bool fetchBlobColumns;
+int sqlFetchRows = 100;
 bool caseInsensitive, searchStringsAll, searchWrap = true;
 bool binaryDetect = true;
 bool inputReadLine;
@@ -212,8 +214,11 @@ static void add_ebhost(char *host, char type)
 	ebhosts[ebhosts_avail++].type = type;
 }				/* add_ebhost */
 
+static void freeEbFunctions(void);
+
 static void delete_ebhosts(void)
 {
+	freeEbFunctions();
 	nzFree(ebhosts);
 	ebhosts = NULL;
 	ebhosts_avail = ebhosts_max = 0;
@@ -456,6 +461,173 @@ static void setupEdbrowseTempDirectory(void)
 	}
 }				/* setupEdbrowseTempDirectory */
 
+/*********************************************************************
+Batch mode, edbrowse -B[#] outdir file1 file2 ...
+Browse each file or url, and write the rendered text to outdir/n.txt,
+where n is the position of the item in the list.
+A list item of - reads more items from stdin, one per line.
+The config file, curl, the cookie jar, and the javascript runtime are set up once,
+in this process, then each item runs in a process forked from it,
+# at a time, default one per cpu.
+Each item is reported as it finishes, with its time,
+followed by a summary line with the overall throughput.
+*********************************************************************/
+
+#ifndef DOSLIKE
+#include <sys/wait.h>
+
+/* Gather the items, expanding - into the lines of stdin */
+static char **batchList(char **argv, int argc, int *count)
+{
+	char **list;
+	int n = 0, max = argc + 16;
+	char line[ABSPATH + 40];
+
+	list = allocMem(max * sizeof(char *));
+	for (; argc; ++argv, --argc) {
+		if (!stringEqual(*argv, "-")) {
+			list[n++] = *argv;
+			continue;
+		}
+		while (fgets(line, sizeof(line), stdin)) {
+			char *s = line;
+			trimWhite(s);
+			if (!*s)
+				continue;
+			if (n + argc >= max) {
+				max *= 2;
+				list = reallocMem(list, max * sizeof(char *));
+			}
+			list[n++] = cloneString(s);
+		}
+	}
+	*count = n;
+	return list;
+}				/* batchList */
+
+/* This runs in the child process. */
+static void batchItem(const char *item, const char *outfile)
+{
+	char *cmd = allocMem(strlen(item) + strlen(outfile) + 16);
+	bool rc;
+
+// Every URL needs a protocol.
+	if (missingProtURL(item))
+		sprintf(cmd, "b http://%s", item);
+	else
+		sprintf(cmd, "b %s", item);
+	rc = runCommand(cmd);
+	if (!rc)
+		showError();
+/* If it isn't html, there may still be text to write */
+	if (cw->dol) {
+		sprintf(cmd, "w %s", outfile);
+		if (!runCommand(cmd)) {
+			showError();
+			rc = false;
+		}
+	}
+	fflush(stdout);
+// Don't run exit handlers, which belong to the parent.
+	_exit(rc ? 0 : 1);
+}				/* batchItem */
+
+struct BATCHJOB {
+	pid_t pid;
+	int idx;
+	double start;
+};
+
+static void batchMode(const char *outdir, int nworkers, char **argv, int argc)
+{
+	char **list;
+	char *outfile;
+	struct BATCHJOB *jobs;
+	int nitems, next = 0, running = 0, nfail = 0;
+	int j, status;
+	pid_t pid;
+	long long bytes = 0;
+	double t0, secs;
+
+	list = batchList(argv, argc, &nitems);
+	if (!nitems)
+		i_printfExit(MSG_Usage);
+	if (fileTypeByName(outdir, false) != 'd' && mkdir(outdir, MODE_rwx))
+		i_printfExit(MSG_NoCreate2, outdir);
+
+	if (nworkers <= 0)
+		nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nworkers <= 0)
+		nworkers = 1;
+	if (nworkers > nitems)
+		nworkers = nitems;
+	jobs = allocZeroMem(nworkers * sizeof(struct BATCHJOB));
+	outfile = allocMem(strlen(outdir) + 20);
+
+/* Get everything ready before the first fork. */
+	eb_curl_global_init();
+	openCookieJar();
+	cxSwitch(1, false);
+	runEbFunction("init");
+	fflush(stdout);
+
+	t0 = secondsNow();
+	while (next < nitems || running) {
+		while (running < nworkers && next < nitems) {
+			struct BATCHJOB *job;
+			for (job = jobs; job->pid; ++job) ;
+			sprintf(outfile, "%s/%d.txt", outdir, next + 1);
+/* don't let the child inherit, and repeat, our pending output */
+			fflush(stdout);
+			pid = fork();
+			if (pid == 0)
+				batchItem(list[next], outfile);
+			if (pid < 0) {
+				if (!running)
+					i_printfExit(MSG_BatchNoFork);
+				break;
+			}
+			job->pid = pid;
+			job->idx = next++;
+			job->start = secondsNow();
+			++running;
+		}
+
+		pid = wait(&status);
+		if (pid < 0)
+			break;
+		for (j = 0; j < nworkers; ++j)
+			if (jobs[j].pid == pid)
+				break;
+		if (j == nworkers)
+			continue;
+		--running;
+		jobs[j].pid = 0;
+		secs = secondsNow() - jobs[j].start;
+		sprintf(outfile, "%s/%d.txt", outdir, jobs[j].idx + 1);
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+			off_t size = fileSizeByName(outfile);
+			if (size < 0)
+				size = 0;
+			bytes += size;
+			i_printf(MSG_BatchItem, jobs[j].idx + 1, list[jobs[j].idx],
+				 (long long)size, secs);
+		} else {
+			++nfail;
+			i_printf(MSG_BatchFail, jobs[j].idx + 1, list[jobs[j].idx],
+				 secs);
+		}
+	}
+
+	secs = secondsNow() - t0;
+	if (secs < 0.001)
+		secs = 0.001;
+	i_printf(MSG_BatchDone, nitems, nfail, nworkers, secs, nitems / secs,
+		 bytes / secs / 1000000.0);
+	exit(nfail ? 1 : 0);
+}				/* batchMode */
+#endif
+
 /*\ MSVC Debug: May need to provide path to 3rdParty DLLs, like
  *  set PATH=F:\Projects\software\bin;%PATH% ...
 \*/
@@ -469,19 +641,17 @@ static void setupEdbrowseTempDirectory(void)
 
 static void loadReplacements(void);
 
-int main(int argc, char **argv)
+/*********************************************************************
+Everything main() does before it looks at the command line:
+the language, the home directory and the files under it,
+the user agent, the temp directory, and the memory routines for pcre.
+make bench calls this too, so it runs under the same setup.
+*********************************************************************/
+
+void setupEdbrowse(void)
 {
-	int cx, account;
-	bool rc, doConfig = true, autobrowse = false;
-	bool dofetch = false, domail = false;
 	static char agent0[64] = "edbrowse/";
 
-#ifndef _MSC_VER		// port setlinebuf(stdout);, if required...
-/* In case this is being piped over to a synthesizer, or whatever. */
-	if (fileTypeByHandle(fileno(stdout)) != 'f')
-		setlinebuf(stdout);
-#endif // !_MSC_VER
-
 	selectLanguage();
 	setHTTPLanguage(eb_language);
 
@@ -568,17 +738,35 @@ int main(int argc, char **argv)
 
 	setupEdbrowseTempDirectory();
 
-	progname = argv[0];
-	++argv, --argc;
-
-	ttySaveSettings();
-	initializeReadline();
-
 /* Let's everybody use my malloc and free routines */
 	pcre_malloc = allocMem;
 	pcre_free = nzFree;
 
 	loadReplacements();
+}				/* setupEdbrowse */
+
+int main(int argc, char **argv)
+{
+	int cx, account;
+	bool rc, doConfig = true, autobrowse = false;
+	bool dofetch = false, domail = false;
+	const char *batchDir = 0;
+	int batchWorkers = 0;
+	double startTime = secondsNow(), configTime = 0, jsTime;
+
+#ifndef _MSC_VER		// port setlinebuf(stdout);, if required...
+/* In case this is being piped over to a synthesizer, or whatever. */
+	if (fileTypeByHandle(fileno(stdout)) != 'f')
+		setlinebuf(stdout);
+#endif // !_MSC_VER
+
+	setupEdbrowse();
+
+	progname = argv[0];
+	++argv, --argc;
+
+	ttySaveSettings();
+	initializeReadline();
 
 	if (argc && stringEqual(argv[0], "-c")) {
 		if (argc == 1) {
@@ -589,8 +777,11 @@ int main(int argc, char **argv)
 			argv += 2, argc -= 2;
 		}
 	}
-	if (doConfig)
+	if (doConfig) {
+		configTime = secondsNow();
 		readConfigFile();
+		configTime = secondsNow() - configTime;
+	}
 	account = localAccount;
 
 	for (; argc && argv[0][0] == '-'; ++argv, --argc) {
@@ -622,6 +813,16 @@ int main(int argc, char **argv)
 			continue;
 		}
 
+#ifndef DOSLIKE
+		if (*s == 'B' && (!s[1] || isdigitByte(s[1])) && argc > 1) {
+			batchWorkers = atoi(s + 1);
+			batchDir = argv[1];
+/* the rest are items, and - among them reads items from stdin */
+			argv += 2, argc -= 2;
+			break;
+		}
+#endif
+
 		if (*s == 'p')
 			++s, passMail = true;
 
@@ -723,7 +924,16 @@ int main(int argc, char **argv)
 
 	signal(SIGINT, catchSig);
 
+/* Just the runtime; see the comments in the js engine.
+ * Contexts, curl, the cache, and the cookie jar are set up as they are needed. */
+	jsTime = secondsNow();
 	js_main();
+	jsTime = secondsNow() - jsTime;
+
+#ifndef DOSLIKE
+	if (batchDir)
+		batchMode(batchDir, batchWorkers, argv, argc);
+#endif
 
 	cx = 0;
 	while (argc) {
@@ -811,6 +1021,11 @@ int main(int argc, char **argv)
 	if (cx > 1)
 		cxSwitch(1, false);
 
+/* from main() to the first command, including any files on the command line */
+	debugPrint(4, "startup %.3f ms, config %.3f ms, js %.3f ms",
+		   (secondsNow() - startTime) * 1000.0, configTime * 1000.0,
+		   jsTime * 1000.0);
+
 	inputForever(NULL);
 	return 0;
 }
@@ -833,61 +1048,234 @@ static void *inputForever(void *ptr)
 	return NULL;
 }
 
-/* Find the balancing brace in an edbrowse function */
-static const char *balance(const char *ip, int direction)
+/*********************************************************************
+Edbrowse functions are compiled when the config file is read,
+into an array of instructions, one per line of the function.
+Braces know where their partners are, so loops and if/else
+jump directly, without scanning for the balancing brace,
+and each command knows where its ~N arguments go.
+Functions are found by name through a small hash table.
+The function text is copied, since a function could run config,
+which frees the config file, and the compiled functions with it.
+*********************************************************************/
+
+#define MAXNEST 20		// nested blocks
+#define FNHASH 64
+
+struct EBSLOT {
+	int offset;		// where ~N appears in the command
+	int argno;		// N
+};
+
+struct EBOP {
+	uchar code;		// 0 for a command, 0x81 open, 0x82 close, 0x83 else
+	char control;		// I i W w U u l for the block
+	bool intoelse;		// an if that jumps into its else
+	int jump;		// where to go, see below
+	int count;		// iterations of a loop
+	const char *text;	// the command
+	int len;
+	int nslots;
+	struct EBSLOT *slots;
+};
+/* jump, for an open brace, is where we go if the block is not entered,
+ * just past the close, or just past the else.
+ * For an else, just past the close.
+ * For a close, the first line of the block, to go around again. */
+
+struct EBFUNC {
+	struct EBFUNC *next;	// in the hash chain, or the retired list
+	const char *name;
+	bool nofail;
+	char *body;
+	int nops;
+	struct EBOP *ops;
+};
+
+static struct EBFUNC *fnHash[FNHASH];
+/* functions freed by config while one of them is running */
+static struct EBFUNC *fnRetired;
+static int fnDepth;
+
+static unsigned fnHashName(const char *name)
 {
-	int nest = 0;
-	uchar code;
+	unsigned h = 0;
+	while (*name)
+		h = h * 31 + tolower((uchar) * name++);
+	return h % FNHASH;
+}				/* fnHashName */
 
-	while (true) {
-		if (direction > 0) {
-			ip = strchr(ip, '\n') + 1;
-		} else {
-			for (ip -= 2; *ip != '\n'; --ip) ;
-			++ip;
+static void freeEbFunction(struct EBFUNC *f)
+{
+	int j;
+	for (j = 0; j < f->nops; ++j)
+		nzFree(f->ops[j].slots);
+	nzFree(f->ops);
+	nzFree(f->body);
+	free(f);
+}				/* freeEbFunction */
+
+static void freeRetiredFunctions(void)
+{
+	struct EBFUNC *f;
+	while ((f = fnRetired)) {
+		fnRetired = f->next;
+		freeEbFunction(f);
+	}
+}				/* freeRetiredFunctions */
+
+static void freeEbFunctions(void)
+{
+	struct EBFUNC *f;
+	int h;
+	for (h = 0; h < FNHASH; ++h) {
+		while ((f = fnHash[h])) {
+			fnHash[h] = f->next;
+			f->next = fnRetired;
+			fnRetired = f;
 		}
-		code = *ip;
-		if (code == 0x83) {
-			if (nest)
-				continue;
-			break;
+	}
+	if (!fnDepth)
+		freeRetiredFunctions();
+}				/* freeEbFunctions */
+
+/* Compile function j from ebhosts, and add it to the hash table. */
+static struct EBFUNC *compileEbFunction(int j)
+{
+	struct EBFUNC *f = allocZeroMem(sizeof(struct EBFUNC));
+	struct EBFUNC **fp;
+	struct EBOP *op;
+	char *s, *t;
+	int n, k, nest = 0;
+	int stack[MAXNEST + 1];
+	unsigned h;
+
+	f->name = ebhosts[j].prot + 1;
+	f->nofail = (ebhosts[j].prot[0] == '+');
+/* skip past the leading \n, and make sure the last line has one */
+	s = ebhosts[j].host + 1;
+	n = strlen(s);
+	f->body = allocMem(n + 2);
+	strcpy(f->body, s);
+	if (n && s[n - 1] != '\n')
+		strcpy(f->body + n, "\n");
+	for (n = 0, s = f->body; *s; ++s)
+		if (*s == '\n')
+			++n;
+	f->ops = op = allocZeroMem((n + 1) * sizeof(struct EBOP));
+
+	for (s = f->body; *s; s = t + 1, ++op) {
+		t = strchr(s, '\n');
+		*t = 0;
+		op->code = *s;
+		if (op->code == 0x81) {
+			op->control = s[1];
+			if (op->control == 'l')
+				op->count = atoi(s + 2);
+			if (nest < MAXNEST)
+				stack[++nest] = op - f->ops;
+			continue;
+		}
+		if (op->code == 0x83) {
+			if (nest) {
+				struct EBOP *open = f->ops + stack[nest];
+				open->jump = op - f->ops + 1;
+				open->intoelse = true;
+				stack[nest] = op - f->ops;
+			}
+			continue;
+		}
+		if (op->code == 0x82) {
+			if (nest) {
+				struct EBOP *open = f->ops + stack[nest--];
+				k = op - f->ops + 1;
+				open->jump = k;
+				if (open->code == 0x83) {
+/* close of the else; the if already points into the else */
+					op->control = 'I';
+					continue;
+				}
+				op->control = open->control;
+				op->jump = open - f->ops + 1;
+			}
+			continue;
+		}
+
+/* a command, find the arguments */
+		op->code = 0;
+		op->text = s;
+		op->len = t - s;
+		for (k = 0; s < t; ++s)
+			if (*s == '~' && isdigitByte(s[1]))
+				++k, ++s;
+		if (!k)
+			continue;
+		op->slots = allocMem(k * sizeof(struct EBSLOT));
+		for (s = (char *)op->text; s < t; ++s) {
+			if (*s == '~' && isdigitByte(s[1])) {
+				op->slots[op->nslots].offset = s - op->text;
+				op->slots[op->nslots++].argno = s[1] - '0';
+				++s;
+			}
 		}
-		if (code == 0x81)
-			nest += direction;
-		if (code == 0x82)
-			nest -= direction;
-		if (nest < 0)
-			break;
 	}
+	f->nops = op - f->ops;
 
-	return ip;
-}				/* balance */
+/* append, so a name defined twice finds the first, as it always has */
+	h = fnHashName(f->name);
+	f->next = 0;
+	for (fp = fnHash + h; *fp; fp = &(*fp)->next) ;
+	*fp = f;
+	return f;
+}				/* compileEbFunction */
+
+static void compileEbFunctions(void)
+{
+	int j;
+	for (j = 0; j < ebhosts_avail; ++j)
+		if (ebhosts[j].type == 'f')
+			compileEbFunction(j);
+}				/* compileEbFunctions */
+
+static struct EBFUNC *findEbFunction(const char *name)
+{
+	struct EBFUNC *f;
+	int j;
+	for (f = fnHash[fnHashName(name)]; f; f = f->next)
+		if (stringEqualCI(name, f->name))
+			return f;
+/* not compiled, perhaps the config file had an error further down */
+	for (j = 0; j < ebhosts_avail; ++j)
+		if (ebhosts[j].type == 'f' &&
+		    stringEqualCI(name, ebhosts[j].prot + 1))
+			return compileEbFunction(j);
+	return 0;
+}				/* findEbFunction */
 
-#define MAXNEST 20		// nested blocks
 /* Run an edbrowse function, as defined in the config file. */
 /* This function must be reentrant. */
 bool runEbFunction(const char *line)
 {
 	char *linecopy = cloneString(line);
-	char *fncopy = 0;
 	char *allargs = 0;
 	const char *args[10];
 	int argl[10];		/* lengths of args */
 	const char *s;
-	char *t, *new;
-	int j, l, nest;
-	const char *ip;		/* think instruction pointer */
-	const char *endl;	/* end of line to be processed */
-	bool nofail, ok;
-	uchar code;
-	char stack[MAXNEST];
-	int loopcnt[MAXNEST];
+	char *t;
+	char *cmdbuf = 0;	/* command with its arguments filled in */
+	int cmdbuf_max = 0;
+	int j, l, nest, pc;
+	struct EBFUNC *f;
+	const struct EBOP *op;
+	bool ok, rc = false;
+	char stack[MAXNEST + 1];
+	int loopcnt[MAXNEST + 1];
 
 /* Separate function name and arguments */
 	spaceCrunch(linecopy, true, false);
 	if (linecopy[0] == 0) {
 		setError(MSG_NoFunction);
-		goto fail;
+		goto done;
 	}
 	memset(args, 0, sizeof(args));
 	memset(argl, 0, sizeof(argl));
@@ -897,22 +1285,17 @@ bool runEbFunction(const char *line)
 	for (s = linecopy; *s; ++s)
 		if (!isalnumByte(*s)) {
 			setError(MSG_BadFunctionName);
-			goto fail;
+			goto done;
 		}
-	for (j = 0; j < ebhosts_avail; ++j)
-		if (ebhosts[j].type == 'f' &&
-		    stringEqualCI(linecopy, ebhosts[j].prot + 1))
-			break;
-	if (j == ebhosts_avail) {
+	f = findEbFunction(linecopy);
+	if (!f) {
 		setError(MSG_NoSuchFunction, linecopy);
-		goto fail;
+		goto done;
 	}
 // This or a downstream function could invoke config.
 // Don't know why anybody would do that!
-	fncopy = cloneString(ebhosts[j].host);
-/* skip past the leading \n */
-	ip = fncopy + 1;
-	nofail = (ebhosts[j].prot[0] == '+');
+// The compiled function is retired, not freed, until we are done.
+	++fnDepth;
 	nest = 0;
 	ok = true;
 
@@ -939,29 +1322,28 @@ bool runEbFunction(const char *line)
 		argl[j] = strlen(s);
 	}
 
-	while ((code = *ip)) {
+	for (pc = 0; pc < f->nops;) {
+		op = f->ops + pc;
 		if (intFlag) {
 			setError(MSG_Interrupted);
 			goto fail;
 		}
-		endl = strchr(ip, '\n');
 
-		if (code == 0x83) {
-			ip = balance(ip, 1) + 2;
+		if (op->code == 0x83) {
+/* end of the if part, skip the else part */
+			pc = op->jump;
 			--nest;
 			continue;
 		}
 
-		if (code == 0x82) {
+		if (op->code == 0x82) {
 			char control = stack[nest];
 			char ucontrol = toupper(control);
-			const char *start = balance(ip, -1);
-			start = strchr(start, '\n') + 1;
 			if (ucontrol == 'L') {	/* loop */
 				if (--loopcnt[nest])
-					ip = start;
+					pc = op->jump;
 				else
-					ip = endl + 1, --nest;
+					++pc, --nest;
 				continue;
 			}
 			if (ucontrol == 'W' || ucontrol == 'U') {
@@ -972,33 +1354,37 @@ bool runEbFunction(const char *line)
 					jump ^= true;
 				ok = true;
 				if (jump)
-					ip = start;
+					pc = op->jump;
 				else
-					ip = endl + 1, --nest;
+					++pc, --nest;
 				continue;
 			}
-/* Apparently it's the close of an if or an else, just fall through */
-			goto nextline;
+/* Apparently it's the close of an if or an else */
+			++pc, --nest;
+			continue;
 		}
 
-		if (code == 0x81) {
-			const char *skip = balance(ip, 1);
+		if (op->code == 0x81) {
 			bool jump;
-			char control = ip[1];
+			char control = op->control;
 			char ucontrol = toupper(control);
 			stack[++nest] = control;
 			if (ucontrol == 'L') {
-				loopcnt[nest] = j = atoi(ip + 2);
-				if (j)
-					goto nextline;
+				loopcnt[nest] = op->count;
+				if (op->count) {
+					++pc;
+					continue;
+				}
 ahead:
-				if (*skip == (char)0x82)
+				if (!op->intoelse)
 					--nest;
-				ip = skip + 2;
+				pc = op->jump;
+				continue;
+			}
+			if (ucontrol == 'U') {
+				++pc;
 				continue;
 			}
-			if (ucontrol == 'U')
-				goto nextline;
 /* if or while, test on ok */
 			jump = ok;
 			if (isupperByte(control))
@@ -1006,57 +1392,62 @@ ahead:
 			ok = true;
 			if (jump)
 				goto ahead;
-			goto nextline;
+			++pc;
+			continue;
 		}
 
-		if (!ok && nofail)
+		if (!ok && f->nofail)
 			goto fail;
 
-/* compute length of line, then build the line */
-		l = endl - ip;
-		for (s = ip; s < endl; ++s)
-			if (*s == '~' && isdigitByte(s[1]))
-				l += argl[s[1] - '0'];
-		t = new = allocMem(l + 1);
-		for (s = ip; s < endl; ++s) {
-			if (*s == '~' && isdigitByte(s[1])) {
-				j = *++s - '0';
-				if (!args[j]) {
-					setError(MSG_NoArgument, j);
-					nzFree(new);
+/* fill in the arguments */
+		s = op->text;
+		if (op->nslots) {
+			const struct EBSLOT *slot = op->slots;
+			l = op->len;
+			for (j = 0; j < op->nslots; ++j, ++slot) {
+				if (!args[slot->argno]) {
+					setError(MSG_NoArgument, slot->argno);
 					goto fail;
 				}
-				strcpy(t, args[j]);
-				t += argl[j];
-				continue;
+				l += argl[slot->argno] - 2;
+			}
+			if (l >= cmdbuf_max) {
+				nzFree(cmdbuf);
+				cmdbuf_max = l + 80;
+				cmdbuf = allocMem(cmdbuf_max);
+			}
+			t = cmdbuf;
+			l = 0;
+			for (j = 0, slot = op->slots; j < op->nslots; ++j, ++slot) {
+				memcpy(t, s + l, slot->offset - l);
+				t += slot->offset - l;
+				memcpy(t, args[slot->argno], argl[slot->argno]);
+				t += argl[slot->argno];
+				l = slot->offset + 2;
 			}
-			*t++ = *s;
+			strcpy(t, s + l);
+			s = cmdbuf;
 		}
-		*t = 0;
 
 /* Here we go! */
-		debugPrint(3, "< %s", new);
+		debugPrint(3, "< %s", s);
 		jClearSync();
-		ok = edbrowseCommand(new, true);
-		free(new);
-
-nextline:
-		ip = endl + 1;
+		ok = edbrowseCommand(s, true);
+		++pc;
 	}
 
-	if (!ok && nofail)
+	if (!ok && f->nofail)
 		goto fail;
-
-	nzFree(linecopy);
-	nzFree(fncopy);
-	nzFree(allargs);
-	return true;
+	rc = true;
 
 fail:
+	if (!--fnDepth && fnRetired)
+		freeRetiredFunctions();
+done:
 	nzFree(linecopy);
-	nzFree(fncopy);
 	nzFree(allargs);
-	return false;
+	nzFree(cmdbuf);
+	return rc;
 }				/* runEbFunction */
 
 struct DBTABLE *findTableDescriptor(const char *sn)
@@ -1113,6 +1504,7 @@ void unreadConfigFile(void)
 	mailReply = NULL;
 
 	webTimeout = mailTimeout = 0;
+	sqlFetchRows = 100;
 	displayLength = 500;
 
 	setDataSource(NULL);
@@ -1136,7 +1528,7 @@ static const char *const keywords[] = {
 	"jar", "nojs", "cachedir",
 	"webtimer", "mailtimer", "certfile", "datasource", "proxy",
 	"agentsite", "localizeweb", "notused33", "novs", "cachesize",
-	"adbook", 0
+	"adbook", "htmlparser", "fetchrows", 0
 };
 
 /* Read the config file and populate the corresponding data structures. */
@@ -1655,6 +2047,23 @@ putc:
 				cfgAbort1(MSG_EBRC_AbNotFile, v);
 			continue;
 
+		case 37:	/* htmlparser */
+			if (stringEqualCI(v, "native"))
+				nativeParser = true;
+			else if (stringEqualCI(v, "tidy"))
+				nativeParser = false;
+			else
+				cfgLine0(MSG_EBRC_HtmlParser);
+			continue;
+
+		case 38:	/* fetchrows */
+			sqlFetchRows = atoi(v);
+			if (sqlFetchRows <= 0)
+				sqlFetchRows = 1;
+			if (sqlFetchRows >= 10000)
+				sqlFetchRows = 10000;
+			continue;
+
 		default:
 			cfgLine1(MSG_EBRC_KeywordNYI, s);
 		}		/* switch */
@@ -1860,6 +2269,8 @@ putback:
 
 	if (maxAccount && !localAccount)
 		localAccount = 1;
+
+	compileEbFunctions();
 }				/* readConfigFile */
 
 // local replacements for javascript and css
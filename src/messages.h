@@ -14,7 +14,7 @@ blank spaces for messages no longer used.
 Each file lang/msg-* must have exactly this many lines.
 *********************************************************************/
 
-#define EdbrowseMessageCount 670
+#define EdbrowseMessageCount 680
 
 // English
 extern const char *msg_en[], ebrc_en[], qrg_en[];
@@ -762,10 +762,20 @@ enum {
 	MSG_ShowFirst,
 	MSG_Previous,
 	MSG_NoPrevMail,
-	MSG_notused665,
-	MSG_notused666,
-	MSG_notused667,
-	MSG_notused668,
-	MSG_notused669,
-	MSG_notused670,
+	MSG_EBRC_HtmlParser,
+	MSG_BatchItem,
+	MSG_BatchFail,
+	MSG_BatchDone,
+	MSG_BatchNoFork,
+	MSG_ProfNone,
+	MSG_ProfLoad,
+	MSG_ProfPhase,
+	MSG_notused673,
+	MSG_notused674,
+	MSG_notused675,
+	MSG_notused676,
+	MSG_notused677,
+	MSG_notused678,
+	MSG_notused679,
+	MSG_notused680,
 };
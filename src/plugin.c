@@ -8,6 +8,10 @@ Run audio players, pdf converters, etc, based on suffix or content-type.
 #ifdef DOSLIKE
 #include <process.h>		// for _getpid(),...
 #define getpid _getpid
+#else
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
 #endif
 
 /* create an input or an output file for edbrowse under /tmp.
@@ -310,6 +314,137 @@ Here we are and we find it by suffix, but it's the same plugin,
 so don't render it again.
 *********************************************************************/
 
+#ifndef DOSLIKE
+/*********************************************************************
+Run a plugin with the data on its stdin, and, if outdata is given,
+its stdout coming back to us, all through pipes, with no temp files.
+We write and read at the same time, in a poll loop,
+else the plugin could block writing to a full pipe
+while we block writing to its stdin, and neither side moves.
+If the plugin stops reading early, that's its business;
+we stop writing and take what output it gives.
+*********************************************************************/
+
+static bool pipePlugin(const char *cmd, const char *indata, int inlength,
+		       char **outdata, int *outlength)
+{
+	int to[2], from[2] = { -1, -1 };
+	struct pollfd pfd[2];
+	int nfd, n, j, pos = 0, status, length;
+	char *buf, *chunk;
+	pid_t pid;
+	void (*oldpipe) (int);
+
+	if (pipe(to)) {
+		setError(MSG_NoSpawn, cmd, errno);
+		return false;
+	}
+	if (outdata && pipe(from)) {
+		setError(MSG_NoSpawn, cmd, errno);
+		close(to[0]);
+		close(to[1]);
+		return false;
+	}
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0) {
+		dup2(to[0], 0);
+		close(to[0]);
+		close(to[1]);
+		if (outdata) {
+			dup2(from[1], 1);
+			close(from[0]);
+			close(from[1]);
+		}
+		execl("/bin/sh", "sh", "-c", cmd, (char *)0);
+		_exit(127);
+	}
+	close(to[0]);
+	if (outdata)
+		close(from[1]);
+	if (pid < 0) {
+		setError(MSG_NoSpawn, cmd, errno);
+		close(to[1]);
+		if (outdata)
+			close(from[0]);
+		return false;
+	}
+
+/* a plugin that quits reading shouldn't take edbrowse down with it */
+	oldpipe = signal(SIGPIPE, SIG_IGN);
+	fcntl(to[1], F_SETFL, fcntl(to[1], F_GETFL) | O_NONBLOCK);
+	if (!inlength) {
+		close(to[1]);
+		to[1] = -1;
+	}
+	chunk = allocMem(CHUNKSIZE);
+	buf = initString(&length);
+
+	while (to[1] >= 0 || from[0] >= 0) {
+		nfd = 0;
+		if (to[1] >= 0) {
+			pfd[nfd].fd = to[1];
+			pfd[nfd].events = POLLOUT;
+			++nfd;
+		}
+		if (from[0] >= 0) {
+			pfd[nfd].fd = from[0];
+			pfd[nfd].events = POLLIN;
+			++nfd;
+		}
+		if (poll(pfd, nfd, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		for (j = 0; j < nfd; ++j) {
+			if (!pfd[j].revents)
+				continue;
+			if (pfd[j].fd == to[1]) {
+				n = write(to[1], indata + pos, inlength - pos);
+				if (n > 0)
+					pos += n;
+				if (pos == inlength ||
+				    (n < 0 && errno != EAGAIN
+				     && errno != EINTR)) {
+					close(to[1]);
+					to[1] = -1;
+				}
+				continue;
+			}
+			n = read(from[0], chunk, CHUNKSIZE);
+			if (n > 0) {
+				stringAndBytes(&buf, &length, chunk, n);
+				continue;
+			}
+			if (n < 0 && (errno == EINTR || errno == EAGAIN))
+				continue;
+			close(from[0]);
+			from[0] = -1;
+		}
+	}
+
+	if (to[1] >= 0)
+		close(to[1]);
+	if (from[0] >= 0)
+		close(from[0]);
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR) ;
+	signal(SIGPIPE, oldpipe);
+	nzFree(chunk);
+	debugPrint(3, "plugin took %d bytes, gave %d", pos, length);
+
+	if (!outdata) {
+		nzFree(buf);
+		return true;
+	}
+	buf = reallocString(buf, length + 2);
+	*outdata = buf;
+	*outlength = length;
+	return true;
+}				/* pipePlugin */
+#endif
+
 bool runPluginCommand(const struct MIMETYPE * m,
 		      const char *inurl, const char *infile, const char *indata,
 		      int inlength, char **outdata, int *outlength)
@@ -320,16 +455,24 @@ bool runPluginCommand(const struct MIMETYPE * m,
 	char *suffix;
 	int len, inlen, outlen;
 	bool has_o = false;
+	bool pipein = false;
 
 	if(outdata)
 		*outdata = 0;
 	if(outlength)
 		*outlength = 0;
 
-	if (indata) {
-// calling function has gathered the data for us,
-// maybe we could pipe it to the program but for now
-// I'm just putting it in a temp file having the same suffix.
+// calling function has gathered the data for us.
+// If the program doesn't name its input, with %i, it reads stdin,
+// and we pipe the data to it.
+#ifndef DOSLIKE
+	if (indata && !strstr(m->program, "%i"))
+		pipein = true;
+#endif
+
+	if (indata && !pipein) {
+// The program insists on a filename,
+// so put the data in a temp file having the same suffix.
 		suffix = NULL;
 		if (infile)
 			suffix = file2suffix(infile);
@@ -346,8 +489,8 @@ bool runPluginCommand(const struct MIMETYPE * m,
 			return false;
 		}
 		infile = tempin;
-	} else if (inurl)
-		infile = inurl;
+	} else if (!infile)
+		infile = (inurl ? inurl : emptyString);
 
 // reserve an output file, whether we need it or not
 	++tempIndex;
@@ -359,7 +502,8 @@ bool runPluginCommand(const struct MIMETYPE * m,
 	if (!makeTempFilename(suffix, tempIndex, true)) {
 		if (indata) {
 			cnzFree(indata);
-			unlink(tempin);
+			if (!pipein)
+				unlink(tempin);
 		}
 		return false;
 	}
@@ -414,6 +558,20 @@ fragment to use popen, which can be more efficient.
 *********************************************************************/
 
 #ifndef DOSLIKE
+	if (pipein) {
+		debugPrint(3, "plugin %s, data on stdin", cmd);
+		if (!pipePlugin(cmd, indata, inlength,
+				(m->outtype && !has_o ? outdata : 0),
+				outlength))
+			goto fail;
+		if (!m->outtype)
+			i_puts(MSG_OK);
+		if (has_o && outdata &&
+		    !fileIntoMemory(outfile, outdata, outlength))
+			goto fail;
+		goto success;
+	}
+
 	if (m->outtype && !has_o) {
 		FILE *p;
 		bool rc;
@@ -451,7 +609,8 @@ fragment to use popen, which can be more efficient.
 success:
 	nzFree(cmd);
 	if (indata) {
-		unlink(tempin);
+		if (!pipein)
+			unlink(tempin);
 		cnzFree(indata);
 	}
 	unlink(tempout);
@@ -460,11 +619,13 @@ success:
 fail:
 	nzFree(cmd);
 	if (indata) {
-		unlink(tempin);
+		if (!pipein)
+			unlink(tempin);
 		cnzFree(indata);
 	}
 	unlink(tempout);
-	*outdata = 0, *outlength = 0;
+	if (outdata)
+		*outdata = 0, *outlength = 0;
 	return false;
 }
 
@@ -167,27 +167,150 @@ const char *reverseAlias(const char *reply)
 	return 0;		/* not found */
 }				/* reverseAlias */
 
+/* Bytes that quoted printable spells out as =XX:
+ * controls other than tab and newline, =, and anything nonascii. */
+static const uchar qp_expand[256] = {
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+};
+
+static const char qp_hex[] = "0123456789ABCDEF";
+
 static char *qpEncode(const char *line)
 {
-	char *newbuf;
-	int l;
-	const char *s;
-	char c;
-
-	newbuf = initString(&l);
-	for (s = line; (c = *s); ++s) {
-		if ((c < '\n' && c != '\t') || c == '=') {
-			char expand[4];
-			sprintf(expand, "=%02X", (uchar) c);
-			stringAndString(&newbuf, &l, expand);
+	char *newbuf, *t;
+	const uchar *s;
+
+	newbuf = t = allocMem(strlen(line) * 3 + 1);
+	for (s = (const uchar *)line; *s; ++s) {
+		if (qp_expand[*s]) {
+			*t++ = '=';
+			*t++ = qp_hex[*s >> 4];
+			*t++ = qp_hex[*s & 15];
 		} else {
-			stringAndChar(&newbuf, &l, c);
+			*t++ = *s;
 		}
 	}
+	*t = 0;
 
 	return newbuf;
 }				/* qpEncode */
 
+/*********************************************************************
+Encode the body of a mail or attachment in quoted printable.
+Besides the characters in qp_expand, a space or tab before newline
+is spelled out, and lines longer than 72 are broken with =\n,
+after the last space if there is one.
+The encoder takes its input a piece at a time, so an attachment
+can be encoded as it is read from disk.
+Each character waits for the next, which decides whether a trailing
+space is spelled out and whether the line is broken.
+Only the output line being built is held; finished lines go to out.
+*********************************************************************/
+
+/* A line never gets past 76 characters before it is broken */
+#define QPLINE 128
+
+struct QPENC {
+	char line[QPLINE];	/* the output line being built */
+	int l;			/* its length, which is the column number */
+	int space;		/* break the line here, 0 for no space seen */
+	int held;		/* input character waiting for the next, -1 for none */
+	char *out;		/* finished lines */
+	int out_l;
+};
+
+static void qpStart(struct QPENC *q)
+{
+	q->l = q->space = 0;
+	q->held = -1;
+	q->out = initString(&q->out_l);
+}				/* qpStart */
+
+/* Encode character c; next is the character that follows, or -1 at the end */
+static void qpPut(struct QPENC *q, uchar c, int next)
+{
+	char *line = q->line;
+
+/* do we have to =expand this character? */
+	if (qp_expand[c] ||
+	    ((c == ' ' || c == '\t') && next == '\n')) {
+		line[q->l++] = '=';
+		line[q->l++] = qp_hex[c >> 4];
+		line[q->l++] = qp_hex[c & 15];
+	} else {
+		line[q->l++] = c;
+	}
+	if (c == '\n') {
+		stringAndBytes(&q->out, &q->out_l, line, q->l);
+		q->l = q->space = 0;
+		return;
+	}
+	if (c == ' ' || c == '\t')
+		q->space = q->l;
+	if (q->l < 72)
+		return;
+	if (next < 0)
+		return;
+/* If newline's coming up anyways, don't force another one. */
+	if (next == '\n')
+		return;
+	if (!q->space || q->space == q->l) {
+		stringAndBytes(&q->out, &q->out_l, line, q->l);
+		stringAndBytes(&q->out, &q->out_l, "=\n", 2);
+		q->l = q->space = 0;
+		return;
+	}
+/* break the line after the space, and keep what follows */
+	stringAndBytes(&q->out, &q->out_l, line, q->space);
+	stringAndBytes(&q->out, &q->out_l, "=\n", 2);
+	q->l -= q->space;
+	memmove(line, line + q->space, q->l);
+	q->space = 0;
+}				/* qpPut */
+
+static void qpFeed(struct QPENC *q, const char *buf, int buflen)
+{
+	const char *s, *v = buf + buflen;
+	for (s = buf; s < v; ++s) {
+		if (q->held >= 0)
+			qpPut(q, q->held, (uchar) * s);
+		q->held = (uchar) * s;
+	}
+}				/* qpFeed */
+
+static void qpFinish(struct QPENC *q)
+{
+	if (q->held >= 0)
+		qpPut(q, q->held, -1);
+	q->held = -1;
+	stringAndBytes(&q->out, &q->out_l, q->line, q->l);
+	q->l = q->space = 0;
+}				/* qpFinish */
+
+static char *qpEncodeBody(const char *buf, int buflen)
+{
+	struct QPENC q;
+	qpStart(&q);
+	qpFeed(&q, buf, buflen);
+	qpFinish(&q);
+	return q.out;
+}				/* qpEncodeBody */
+
 /* Return 0 if there was no need to encode */
 static char *isoEncode(char *start, char *end)
 {
@@ -251,6 +374,124 @@ static char *charsetString(const char *ct, const char *ce)
 	return buf;
 }				/* charsetString */
 
+/* Infer content type from the filename, 0 if we can't tell */
+static const char *typeByName(const char *file)
+{
+	const char *ct = 0;
+	const char *s = strrchr(file, '.');
+	if (s && s[1]) {
+		++s;
+		if (stringEqualCI(s, "ps"))
+			ct = "application/PostScript";
+		if (stringEqualCI(s, "jpeg"))
+			ct = "image/jpeg";
+		if (stringEqualCI(s, "gif"))
+			ct = "image/gif";
+		if (stringEqualCI(s, "wav"))
+			ct = "audio/basic";
+		if (stringEqualCI(s, "mpeg"))
+			ct = "video/mpeg";
+		if (stringEqualCI(s, "rtf"))
+			ct = "text/richtext";
+		if (stringEqualCI(s, "htm") ||
+		    stringEqualCI(s, "html") ||
+		    stringEqualCI(s, "shtm") ||
+		    stringEqualCI(s, "shtml") || stringEqualCI(s, "asp"))
+			ct = "text/html";
+	}
+	return ct;
+}				/* typeByName */
+
+/*********************************************************************
+Count the nonascii characters, nulls, and newlines,
+and look for lines longer than 120, which decide how the data is encoded.
+The data can come in pieces, as it is read from a file;
+a line or a \r\n pair may straddle two pieces.
+*********************************************************************/
+
+struct ATSTATS {
+	off_t nacount, nullcount, nlcount;
+	off_t crlf;		/* \r\n pairs, which become \n */
+	off_t linelen;		/* length of the current line */
+	bool longline, seennl, lastcr;
+};
+
+static void attachStats(struct ATSTATS *st, const char *buf, int buflen)
+{
+	int i;
+	char c;
+	for (i = 0; i < buflen; ++i) {
+		c = buf[i];
+		if (c == '\0')
+			++st->nullcount;
+		if (c < 0)
+			++st->nacount;
+		if (c == '\n') {
+			++st->nlcount;
+			if (st->lastcr)
+				++st->crlf;
+/* the first line is measured without its newline, the others with */
+			if (st->linelen + st->seennl > 120)
+				st->longline = true;
+			st->linelen = 0;
+			st->seennl = true;
+		} else {
+			++st->linelen;
+		}
+		st->lastcr = (c == '\r');
+	}
+}				/* attachStats */
+
+/* Content type and encoding, given the statistics of the data.
+ * buflen is the length of the data. */
+static void attachEncoding(const char *file, struct ATSTATS *st,
+			   off_t buflen, bool webform,
+			   const char **type_p, const char **enc_p)
+{
+	const char *ct = typeByName(file);
+	off_t nacount;
+
+/* the last line, which may not end in newline */
+	if (st->linelen + st->seennl > 120)
+		st->longline = true;
+	debugPrint(6,
+		   "attaching %s length %lld nonascii %lld nulls %lld longline %d",
+		   file, (long long)buflen, (long long)st->nacount,
+		   (long long)st->nullcount, st->longline);
+	nacount = st->nacount + st->nullcount;
+
+/* Set the type of attachment */
+	if (buflen > 20 && nacount * 5 > buflen) {
+		if (!ct)
+			ct = "application/octet-stream";	/* default type for binary */
+	}
+	if (!ct)
+		ct = "text/plain";
+	*type_p = ct;
+
+/* Criteria for base64 encode.
+ * files uploaded from a web form need not be encoded, unless they contain
+ * nulls, which is a quirk of my slapped together software. */
+
+	if ((!webform && buflen > 20 && nacount * 5 > buflen) ||
+	    (webform && st->nullcount)) {
+		*enc_p = "base64";
+		return;
+	}
+
+/* Do we need to use quoted-printable?
+ * This is measured after \r\n becomes \n. */
+/* Perhaps this hshould read (nacount > 0) */
+	if (!webform &&
+	    (nacount * 20 > buflen - st->crlf || st->nullcount
+	     || st->longline)) {
+		*enc_p = "quoted-printable";
+		return;
+	}
+
+	*enc_p = (nacount ? "8bit" : "7bit");
+}				/* attachEncoding */
+
 /* Read a file into memory, mime encode it,
  * and return the type of encoding and the encoded data.
  * Last three parameters are result parameters.
@@ -264,11 +505,10 @@ encodeAttachment(const char *file, int ismail, bool webform,
 {
 	char *buf;
 	char c;
-	bool longline;
 	char *s, *t, *v;
-	char *ct, *ce;		/* content type, content encoding */
+	const char *ct, *ce;	/* content type, content encoding */
 	int buflen, i, cx;
-	int nacount, nullcount, nlcount;
+	struct ATSTATS st;
 
 	if (ismail < 0) {
 		buf = cloneString(file);
@@ -399,73 +639,11 @@ empty:
 		}		/* .signature */
 	}
 
-	/* Infer content type from the filename */
-	ct = 0;
-	s = strrchr(file, '.');
-	if (s && s[1]) {
-		++s;
-		if (stringEqualCI(s, "ps"))
-			ct = "application/PostScript";
-		if (stringEqualCI(s, "jpeg"))
-			ct = "image/jpeg";
-		if (stringEqualCI(s, "gif"))
-			ct = "image/gif";
-		if (stringEqualCI(s, "wav"))
-			ct = "audio/basic";
-		if (stringEqualCI(s, "mpeg"))
-			ct = "video/mpeg";
-		if (stringEqualCI(s, "rtf"))
-			ct = "text/richtext";
-		if (stringEqualCI(s, "htm") ||
-		    stringEqualCI(s, "html") ||
-		    stringEqualCI(s, "shtm") ||
-		    stringEqualCI(s, "shtml") || stringEqualCI(s, "asp"))
-			ct = "text/html";
-	}
-
-/* Count the nonascii characters */
-	nacount = nullcount = nlcount = 0;
-	longline = false;
-	s = 0;
-	for (i = 0; i < buflen; ++i) {
-		c = buf[i];
-		if (c == '\0')
-			++nullcount;
-		if (c < 0)
-			++nacount;
-		if (c != '\n')
-			continue;
-		++nlcount;
-		t = buf + i;
-		if (s && t - s > 120)
-			longline = true;
-		if (!s && i > 120)
-			longline = true;
-		s = t;
-	}
-	t = buf + i;
-	if (s && t - s > 120)
-		longline = true;
-	if (!s && i > 120)
-		longline = true;
-	debugPrint(6, "attaching %s length %d nonascii %d nulls %d longline %d",
-		   file, buflen, nacount, nullcount, longline);
-	nacount += nullcount;
+	memset(&st, 0, sizeof(st));
+	attachStats(&st, buf, buflen);
+	attachEncoding(file, &st, buflen, webform, &ct, &ce);
 
-/* Set the type of attachment */
-	if (buflen > 20 && nacount * 5 > buflen) {
-		if (!ct)
-			ct = "application/octet-stream";	/* default type for binary */
-	}
-	if (!ct)
-		ct = "text/plain";
-
-/* Criteria for base64 encode.
- * files uploaded from a web form need not be encoded, unless they contain
- * nulls, which is a quirk of my slapped together software. */
-
-	if ((!webform && buflen > 20 && nacount * 5 > buflen) ||
-	    (webform && nullcount)) {
+	if (ce[0] == 'b') {
 		if (ismail) {
 			setError(MSG_MailBinary, file);
 			goto freefail;
@@ -473,7 +651,6 @@ empty:
 		s = base64Encode(buf, buflen, true);
 		nzFree(buf);
 		buf = s;
-		ce = "base64";
 		goto success;
 	}
 
@@ -488,69 +665,15 @@ empty:
 		}
 		buflen = t - buf;
 
-/* Do we need to use quoted-printable? */
-/* Perhaps this hshould read (nacount > 0) */
-		if (nacount * 20 > buflen || nullcount || longline) {
-			char *newbuf;
-			int l, colno = 0, space = 0;
-
-			newbuf = initString(&l);
-			v = buf + buflen;
-			for (s = buf; s < v; ++s) {
-				c = *s;
-/* do we have to =expand this character? */
-				if ((c < '\n' && c != '\t') ||
-				    c == '=' ||
-				    c == '\xff' ||
-				    ((c == ' ' || c == '\t') &&
-				     s < v - 1 && s[1] == '\n')) {
-					char expand[4];
-					sprintf(expand, "=%02X", (uchar) c);
-					stringAndString(&newbuf, &l, expand);
-					colno += 3;
-				} else {
-					stringAndChar(&newbuf, &l, c);
-					++colno;
-				}
-				if (c == '\n') {
-					colno = space = 0;
-					continue;
-				}
-				if (c == ' ' || c == '\t')
-					space = l;
-				if (colno < 72)
-					continue;
-				if (s == v - 1)
-					continue;
-/* If newline's coming up anyways, don't force another one. */
-				if (s[1] == '\n')
-					continue;
-				i = l;
-				if (!space || space == i) {
-					stringAndString(&newbuf, &l, "=\n");
-					colno = space = 0;
-					continue;
-				}
-				colno = i - space;
-				stringAndString(&newbuf, &l, "**");	/* make room */
-				while (i > space) {
-					newbuf[i + 1] = newbuf[i - 1];
-					--i;
-				}
-				newbuf[space] = '=';
-				newbuf[space + 1] = '\n';
-				space = 0;
-			}	/* loop over characters */
-
+		if (ce[0] == 'q') {
+			char *newbuf = qpEncodeBody(buf, buflen);
 			nzFree(buf);
 			buf = newbuf;
-			ce = "quoted-printable";
 			goto success;
 		}
 	}
 
 	buf[buflen] = 0;
-	ce = (nacount ? "8bit" : "7bit");
 
 success:
 	debugPrint(6, "encoded %s %s length %d", ct, ce, strlen(buf));
@@ -638,33 +761,304 @@ char *makeBoundary(void)
 	return boundary;
 }				/* makeBoundary */
 
-struct smtp_upload {
-	const char *data;
-/* These really need to be size_t, not int!
- * fixme when edbrowse uses size_t consistently */
-	int length;
-	int pos;
+/*********************************************************************
+The outgoing message is a list of parts, handed to curl in order
+through its read callback.
+Headers, boundaries, the body of the mail, and buffer attachments
+are already encoded in memory, with dos newlines.
+An attachment file is read and encoded a block at a time,
+as curl asks for more, so memory use does not grow with the size
+of the attachment; the file is only scanned beforehand, to choose
+its content type and encoding.
+*********************************************************************/
+
+/* a multiple of 54, the bytes in one line of base64 */
+#define SMTPBLOCK (54 * 1024)
+
+struct SMTPPART {
+	char *text;		/* in memory, ready to send */
+	int text_l;
+	const char *file;	/* or a file to encode on the fly */
+	char ce;		/* b q or 8 for base64, quoted printable, as is */
 };
 
-static size_t smtp_upload_callback(char *buffer_for_curl, size_t size,
-				   size_t nmem, struct smtp_upload *upload)
+struct SMTPSTREAM {
+	struct SMTPPART parts[MAXRECAT * 2 + 2];
+	int nparts, cur;
+	const char *src;	/* bytes waiting for curl */
+	int src_l, src_pos;
+	int fd;			/* the attachment file being sent */
+	char *raw;		/* a block of that file */
+	char *stage;		/* that block encoded */
+	int stage_l, stage_cap;
+	struct QPENC qp;
+	bool heldcr;		/* \r at the end of a block, \n may follow */
+	bool pendcr;		/* \r on its way out, dropped if \n follows */
+	bool endnl;		/* the last character out was \n */
+	bool failed;
+};
+
+static void smtpStart(struct SMTPSTREAM *ss)
 {
-	size_t out_buffer_size = size * nmem;
-	size_t remaining = upload->length - upload->pos;
-	size_t to_send, cur_pos;
+	memset(ss, 0, sizeof(*ss));
+	ss->fd = -1;
+}				/* smtpStart */
 
-	if (upload->pos >= upload->length)
-		return 0;
+/* The text built up so far becomes a part, and a new string is started */
+static void smtpText(struct SMTPSTREAM *ss, char **out, int *l)
+{
+	struct SMTPPART *p = ss->parts + ss->nparts++;
+	p->text = *out;
+	p->text_l = *l;
+	*out = initString(l);
+}				/* smtpText */
 
-	if (out_buffer_size < remaining)
-		to_send = out_buffer_size;
-	else
-		to_send = remaining;
+static void smtpFile(struct SMTPSTREAM *ss, const char *file, const char *ce)
+{
+	struct SMTPPART *p = ss->parts + ss->nparts++;
+	p->file = file;
+	p->ce = ce[0];
+	if (p->ce == '7')
+		p->ce = '8';
+}				/* smtpFile */
+
+static void smtpFree(struct SMTPSTREAM *ss)
+{
+	int i;
+	for (i = 0; i < ss->nparts; ++i)
+		nzFree(ss->parts[i].text);
+	if (ss->fd >= 0)
+		close(ss->fd);
+	nzFree(ss->raw);
+	nzFree(ss->stage);
+	nzFree(ss->qp.out);
+	smtpStart(ss);
+}				/* smtpFree */
 
-	memcpy(buffer_for_curl, upload->data + upload->pos, to_send);
-	cur_pos = upload->pos + to_send;
-	upload->pos = cur_pos;
-	return to_send;
+/*********************************************************************
+Put encoded text on the stage, with dos newlines.
+As in appendAttachment, \r before \n is dropped, and \n becomes \r\n.
+*********************************************************************/
+
+static void stageText(struct SMTPSTREAM *ss, const char *s, int len)
+{
+	char *t;
+	const char *v = s + len;
+	char c;
+
+	if (ss->stage_l + 2 * len + 4 > ss->stage_cap) {
+		ss->stage_cap = ss->stage_l + 2 * len + 4;
+		ss->stage = (ss->stage ? reallocMem(ss->stage, ss->stage_cap) :
+			     allocMem(ss->stage_cap));
+	}
+	t = ss->stage + ss->stage_l;
+	for (; s < v; ++s) {
+		c = *s;
+		if (ss->pendcr) {
+			ss->pendcr = false;
+			if (c != '\n')
+				*t++ = '\r';
+		}
+		if (c == '\r') {
+			ss->pendcr = true;
+			continue;
+		}
+		if (c == '\n')
+			*t++ = '\r';
+		*t++ = c;
+	}
+	ss->stage_l = t - ss->stage;
+	if (len)
+		ss->endnl = (v[-1] == '\n');
+}				/* stageText */
+
+/* read a full block, unless the file runs out */
+static int readBlock(int fd, char *buf, int len)
+{
+	int n, got = 0;
+	while (got < len) {
+		n = read(fd, buf + got, len - got);
+		if (n < 0)
+			return -1;
+		if (!n)
+			break;
+		got += n;
+	}
+	return got;
+}				/* readBlock */
+
+/*********************************************************************
+Read and encode the next block of the attachment file in part p.
+Returns the number of bytes on the stage, or -1 for a read error.
+At end of file, the file is closed and ss->fd becomes -1.
+*********************************************************************/
+
+static int smtpEncodeBlock(struct SMTPSTREAM *ss, struct SMTPPART *p)
+{
+	char *s, *t, *v;
+	int k = 0, n;
+
+	ss->stage_l = 0;
+	if (!ss->raw)
+		ss->raw = allocMem(SMTPBLOCK + 1);
+	if (ss->heldcr)
+		ss->raw[k++] = '\r';
+	ss->heldcr = false;
+	n = readBlock(ss->fd, ss->raw + k, SMTPBLOCK - k);
+	if (n < 0) {
+		setError(MSG_NoRead, p->file);
+		return -1;
+	}
+	n += k;
+
+	if (p->ce == 'b') {
+		if (n) {
+			s = base64Encode(ss->raw, n, true);
+			stageText(ss, s, strlen(s));
+			nzFree(s);
+		}
+	} else {
+/* Switch to unix newlines, as in encodeAttachment */
+		v = ss->raw + n;
+		if (n > k && v[-1] == '\r') {
+			ss->heldcr = true;
+			--v;
+		}
+		for (s = t = ss->raw; s < v; ++s) {
+			if (*s == '\r' && s < v - 1 && s[1] == '\n')
+				continue;
+			*t++ = *s;
+		}
+		if (p->ce == 'q') {
+			qpFeed(&ss->qp, ss->raw, t - ss->raw);
+			if (n == k)
+				qpFinish(&ss->qp);
+			stageText(ss, ss->qp.out, ss->qp.out_l);
+			nzFree(ss->qp.out);
+			ss->qp.out = initString(&ss->qp.out_l);
+		} else {
+			stageText(ss, ss->raw, t - ss->raw);
+		}
+	}
+
+	if (n == k) {		/* end of file */
+/* As with appendAttachment, the last line ends in newline. */
+		if (ss->pendcr || !ss->endnl)
+			stageText(ss, "\n", 1);
+		close(ss->fd);
+		ss->fd = -1;
+		nzFree(ss->qp.out);
+		ss->qp.out = 0;
+	}
+
+	return ss->stage_l;
+}				/* smtpEncodeBlock */
+
+/*********************************************************************
+Scan an attachment file, a block at a time, to decide its content type
+and encoding, as encodeAttachment would, without holding it in memory.
+The file is read again, and encoded, as the mail is sent.
+*********************************************************************/
+
+static bool scanAttachment(const char *file, const char **type_p,
+			   const char **enc_p)
+{
+	struct ATSTATS st;
+	off_t buflen = 0;
+	char *buf;
+	int fd, n;
+
+	fd = open(file, O_RDONLY | O_BINARY);
+	if (fd < 0) {
+		setError(MSG_AttAccess, file);
+		return false;
+	}
+	memset(&st, 0, sizeof(st));
+	buf = allocMem(SMTPBLOCK);
+	while ((n = read(fd, buf, SMTPBLOCK)) > 0) {
+		attachStats(&st, buf, n);
+		buflen += n;
+	}
+	close(fd);
+	nzFree(buf);
+	if (n < 0) {
+		setError(MSG_NoRead, file);
+		return false;
+	}
+	if (!buflen) {
+		setError(MSG_AttEmpty2, file);
+		return false;
+	}
+	attachEncoding(file, &st, buflen, false, type_p, enc_p);
+	return true;
+}				/* scanAttachment */
+
+/* Line up the next bytes for curl; false at the end or on error */
+static bool smtpRefill(struct SMTPSTREAM *ss)
+{
+	struct SMTPPART *p;
+	int n;
+
+	ss->src_l = ss->src_pos = 0;
+	while (ss->cur < ss->nparts) {
+		p = ss->parts + ss->cur;
+		if (!p->file) {
+			++ss->cur;
+			if (!p->text_l)
+				continue;
+			ss->src = p->text;
+			ss->src_l = p->text_l;
+			return true;
+		}
+		if (ss->fd < 0) {
+			ss->fd = open(p->file, O_RDONLY | O_BINARY);
+			if (ss->fd < 0) {
+				setError(MSG_AttAccess, p->file);
+				ss->failed = true;
+				return false;
+			}
+			debugPrint(4, "sending %s", p->file);
+			ss->heldcr = ss->pendcr = false;
+			ss->endnl = true;
+			if (p->ce == 'q')
+				qpStart(&ss->qp);
+		}
+		n = smtpEncodeBlock(ss, p);
+		if (n < 0) {
+			ss->failed = true;
+			return false;
+		}
+		if (ss->fd < 0)
+			++ss->cur;
+		if (n) {
+			ss->src = ss->stage;
+			ss->src_l = n;
+			return true;
+		}
+	}
+	return false;
+}				/* smtpRefill */
+
+static size_t smtp_upload_callback(char *buffer_for_curl, size_t size,
+				   size_t nmem, struct SMTPSTREAM *ss)
+{
+	size_t room = size * nmem, sent = 0, n;
+
+	while (room) {
+		if (ss->src_pos == ss->src_l && !smtpRefill(ss))
+			break;
+		n = ss->src_l - ss->src_pos;
+		if (n > room)
+			n = room;
+		memcpy(buffer_for_curl + sent, ss->src + ss->src_pos, n);
+		ss->src_pos += n;
+		sent += n;
+		room -= n;
+	}
+
+	if (ss->failed)
+		return CURL_READFUNC_ABORT;
+	return sent;
 }				/* smtp_upload_callback */
 
 static char *buildSMTPURL(const struct MACCOUNT *account)
@@ -766,32 +1160,22 @@ new_handle_cleanup:
 	return handle;
 }				/* newSendmailHandle */
 
-typedef struct tagsmtp_upload {
-	const char *data;
-	size_t length;
-	size_t pos;
-} smtp_upload;
-
 static bool
 sendMailSMTP(const struct MACCOUNT *account, const char *reply,
-	     const char **recipients, const char *message)
+	     const char **recipients, struct SMTPSTREAM *ss)
 {
 	CURL *handle = 0;
 	CURLcode res = CURLE_OK;
 	bool smtp_success = false;
 	char *smtp_url = buildSMTPURL(account);
 	struct curl_slist *recipient_slist = buildRecipientSList(recipients);
-	smtp_upload upload;
-	upload.data = message;
-	upload.length = strlen(message);
-	upload.pos = 0;
 	handle = newSendmailHandle(account, smtp_url, reply, recipient_slist);
 
 	if (!handle)
 		goto smtp_cleanup;
 
 	curl_easy_setopt(handle, CURLOPT_READFUNCTION, smtp_upload_callback);
-	curl_easy_setopt(handle, CURLOPT_READDATA, &upload);
+	curl_easy_setopt(handle, CURLOPT_READDATA, ss);
 	curl_easy_setopt(handle, CURLOPT_UPLOAD, 1L);
 
 	res = curl_easy_perform(handle);
@@ -799,7 +1183,8 @@ sendMailSMTP(const struct MACCOUNT *account, const char *reply,
 		smtp_success = true;
 
 smtp_cleanup:
-	if (res != CURLE_OK)
+/* If a file went bad along the way, that error is already set. */
+	if (res != CURLE_OK && !ss->failed)
 		ebcurl_setError(res, smtp_url, 0, emptyString);
 	if (handle)
 		curl_easy_cleanup(handle);
@@ -826,6 +1211,7 @@ sendMail(int account, const char **recipients, const char *body,
 	bool firstrec;
 	const char *ct, *ce;
 	char *encoded = 0;
+	struct SMTPSTREAM ss;
 
 	if (!validAccount(account))
 		return false;
@@ -931,7 +1317,8 @@ sendMail(int account, const char **recipients, const char *body,
 
 	boundary = makeBoundary();
 
-/* Build the outgoing mail, as one string. */
+/* Build the outgoing mail, attachment files are encoded as it is sent. */
+	smtpStart(&ss);
 	out = initString(&j);
 
 	firstrec = true;
@@ -1023,8 +1410,13 @@ this format, some or all of this message may not be legible.\r\n\r\n--");
 
 	if (mustmime) {
 		for (i = 0; (s = attachments[i]); ++i) {
-			if (!encodeAttachment(s, 0, false, &ct, &ce, &encoded))
-				return false;
+			bool isfile = (ismc || stringIsNum(s) < 0);
+			if (isfile) {
+				if (!scanAttachment(s, &ct, &ce))
+					goto done;
+			} else if (!encodeAttachment(s, 0, false, &ct, &ce,
+						     &encoded))
+				goto done;
 			sprintf(serverLine, "%s--%s%sContent-Type: %s%s", eol,
 				boundary, eol, ct, charsetString(ct, ce));
 			stringAndString(&out, &j, serverLine);
@@ -1039,6 +1431,11 @@ this format, some or all of this message may not be legible.\r\n\r\n--");
 				"%sContent-Transfer-Encoding: %s%s%s", eol, ce,
 				eol, eol);
 			stringAndString(&out, &j, serverLine);
+			if (isfile) {
+				smtpText(&ss, &out, &j);
+				smtpFile(&ss, s, ce);
+				continue;
+			}
 			appendAttachment(encoded, &out, &j);
 			nzFree(encoded);
 			encoded = 0;
@@ -1051,8 +1448,12 @@ this format, some or all of this message may not be legible.\r\n\r\n--");
 
 	/* mime format */
 
-	sendmail_success = sendMailSMTP(ao, reply, recipients, out);
+	smtpText(&ss, &out, &j);
+	sendmail_success = sendMailSMTP(ao, reply, recipients, &ss);
+
+done:
 	nzFree(out);
+	smtpFree(&ss);
 	return sendmail_success;
 }				/* sendMail */
 
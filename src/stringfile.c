@@ -5,6 +5,7 @@
 #include "eb.h"
 
 #include <dirent.h>
+#include <locale.h>
 #ifdef DOSLIKE
 #include <dos.h>
 #else
@@ -15,6 +16,10 @@
 #include <grp.h>
 #endif
 
+#ifdef _MSC_VER
+extern int gettimeofday(struct timeval *tp, void *tzp);	// from tidys.lib
+#endif
+
 char emptyString[] = "";
 bool showHiddenFiles, isInteractive;
 int debugLevel = 1;
@@ -683,6 +688,15 @@ unsigned pstLength(pst s)
 	return t + 1 - s;
 }				/* pstLength */
 
+/* The length of a line in a buffer, remembered in the line map,
+ * so long lines are not scanned again and again. */
+unsigned lineLength(struct lineMap *t)
+{
+	if (!t->len)
+		t->len = pstLength(t->text);
+	return t->len;
+}				/* lineLength */
+
 pst clonePstring(pst s)
 {
 	pst t;
@@ -695,6 +709,65 @@ pst clonePstring(pst s)
 	return t;
 }				/* clonePstring */
 
+/*********************************************************************
+The lines of a buffer are reference counted, so t, r and w between
+sessions, and the snapshot kept for undo, can share the text
+instead of copying it. The count sits just before the text.
+A line with more than one reference is never changed in place;
+ownLine gives you a private copy first, if it needs one.
+Lines are allocated by allocLine and released by releaseLine,
+never by allocMem or nzFree.
+*********************************************************************/
+
+struct lineHead {
+	unsigned refs;
+};
+#define lineHead(p) ((struct lineHead *)(p) - 1)
+
+pst allocLine(unsigned len)
+{
+	struct lineHead *h = allocMem(sizeof(struct lineHead) + len);
+	h->refs = 1;
+	return (pst) (h + 1);
+}				/* allocLine */
+
+pst reallocLine(pst p, unsigned len)
+{
+	struct lineHead *h;
+	p = ownLine(p);
+	h = reallocMem(lineHead(p), sizeof(struct lineHead) + len);
+	return (pst) (h + 1);
+}				/* reallocLine */
+
+pst cloneLine(pst s, unsigned len)
+{
+	pst t = allocLine(len);
+	memcpy(t, s, len);
+	return t;
+}				/* cloneLine */
+
+pst shareLine(pst p)
+{
+	++lineHead(p)->refs;
+	return p;
+}				/* shareLine */
+
+void releaseLine(pst p)
+{
+	if (p && !--lineHead(p)->refs)
+		free(lineHead(p));
+}				/* releaseLine */
+
+pst ownLine(pst p)
+{
+	pst t;
+	if (lineHead(p)->refs == 1)
+		return p;
+	t = cloneLine(p, pstLength(p));
+	--lineHead(p)->refs;
+	return t;
+}				/* ownLine */
+
 // Strings are assumed distinct, hence the use of memcpy.
 void copyPstring(pst s, const pst t)
 {
@@ -871,38 +944,39 @@ is ported to other operating systems.
 struct stat this_stat;
 static bool this_waslink, this_brokenlink;
 
-char fileTypeByName(const char *name, bool showlink)
+/* The work of fileTypeByName, into a stat record of your choosing,
+ * so it can run in more than one thread at a time.
+ * Type is always shown through a link, f if the link is broken,
+ * and 0 if the file can't be reached. */
+static char fileTypeStat(const char *name, struct FILESTAT *fs)
 {
-	bool islink = false;
 	char c;
 	int mode;
 
-	this_waslink = false;
-	this_brokenlink = false;
+	fs->waslink = false;
+	fs->brokenlink = false;
 
 #ifdef DOSLIKE
-	if (stat(name, &this_stat)) {
-		this_brokenlink = true;
-		setError(MSG_NoAccess, name);
-		return 0;
+	if (stat(name, &fs->st)) {
+		fs->brokenlink = true;
+		return fs->ftype = 0;
 	}
-	mode = this_stat.st_mode & S_IFMT;
+	mode = fs->st.st_mode & S_IFMT;
 #else // !DOSLIKE
 
-	if (lstat(name, &this_stat)) {
-		this_brokenlink = true;
-		setError(MSG_NoAccess, name);
-		return 0;
+	if (lstat(name, &fs->st)) {
+		fs->brokenlink = true;
+		return fs->ftype = 0;
 	}
-	mode = this_stat.st_mode & S_IFMT;
+	mode = fs->st.st_mode & S_IFMT;
 	if (mode == S_IFLNK) {	/* symbolic link */
-		islink = this_waslink = true;
+		fs->waslink = true;
 /* If this fails, I'm guessing it's just a file. */
-		if (stat(name, &this_stat)) {
-			this_brokenlink = true;
-			return (showlink ? 'F' : 0);
+		if (stat(name, &fs->st)) {
+			fs->brokenlink = true;
+			return fs->ftype = 'f';
 		}
-		mode = this_stat.st_mode & S_IFMT;
+		mode = fs->st.st_mode & S_IFMT;
 	}
 #endif // DOSLIKE y/n
 
@@ -920,11 +994,90 @@ char fileTypeByName(const char *name, bool showlink)
 	if (mode == S_IFSOCK)
 		c = 's';
 #endif
-	if (islink & showlink)
+	return fs->ftype = c;
+}				/* fileTypeStat */
+
+/* Make a stat record the current one, as though we had just called
+ * fileTypeByName, so lsattr() can use it. */
+char fileTypeByStat(const struct FILESTAT *fs, bool showlink)
+{
+	char c = fs->ftype;
+	this_stat = fs->st;
+	this_waslink = fs->waslink;
+	this_brokenlink = fs->brokenlink;
+	if (!c)
+		return 0;
+	if (fs->brokenlink)
+		return (showlink ? 'F' : 0);
+	if (fs->waslink & showlink)
 		c = toupper(c);
 	return c;
+}				/* fileTypeByStat */
+
+char fileTypeByName(const char *name, bool showlink)
+{
+	struct FILESTAT fs;
+	fileTypeStat(name, &fs);
+	if (!fs.ftype)
+		setError(MSG_NoAccess, name);
+	return fileTypeByStat(&fs, showlink);
 }				/* fileTypeByName */
 
+/*********************************************************************
+Stat a list of files in parallel.
+Over nfs each stat is a round trip to the server,
+and a directory of 200,000 files can take minutes, one at a time.
+A pool of threads, each taking the next file off the list,
+keeps several requests in flight.
+Small lists aren't worth the threads.
+*********************************************************************/
+
+#define STATTHREADS 16
+#define STATTHRESHOLD 64
+
+static struct STATLIST {
+	const char **names;
+	struct FILESTAT *out;
+	int count, next;
+	pthread_mutex_t lock;
+} statlist = {.lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void *statWorker(void *arg)
+{
+	int j;
+	(void)arg;
+	while (true) {
+		pthread_mutex_lock(&statlist.lock);
+		j = statlist.next++;
+		pthread_mutex_unlock(&statlist.lock);
+		if (j >= statlist.count)
+			break;
+		fileTypeStat(statlist.names[j], statlist.out + j);
+	}
+	return NULL;
+}				/* statWorker */
+
+void statFileList(const char **names, int count, struct FILESTAT *out)
+{
+	pthread_t tids[STATTHREADS];
+	int j, nt = 0;
+
+	statlist.names = names;
+	statlist.out = out;
+	statlist.count = count;
+	statlist.next = 0;
+	if (count >= STATTHRESHOLD) {
+		for (nt = 0; nt < STATTHREADS; ++nt)
+			if (pthread_create(tids + nt, NULL, statWorker, NULL))
+				break;
+	}
+/* this thread works too, and finishes the job if no threads could start */
+	statWorker(NULL);
+	for (j = 0; j < nt; ++j)
+		pthread_join(tids[j], NULL);
+	debugPrint(4, "stat %d files, %d threads", count, nt);
+}				/* statFileList */
+
 char fileTypeByHandle(int fd)
 {
 	struct stat buf;
@@ -982,6 +1135,21 @@ time_t fileTimeByName(const char *name)
 	return buf.st_mtime;
 }				/* fileTimeByName */
 
+/* Seconds on a clock that never steps back, for timing things.
+ * Only the difference between two readings means anything. */
+double secondsNow(void)
+{
+#ifdef _MSC_VER
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+}				/* secondsNow */
+
 char *conciseSize(size_t n)
 {
 	static char buf[32];
@@ -1085,6 +1253,50 @@ bool lsattrChars(const char *buf, char *dest)
 	return rc;
 }				/* lsattrChars */
 
+#ifndef DOSLIKE
+/* User and group names, remembered, since a directory listing
+ * asks for the same few, over and over again. */
+#define IDCACHE 32
+static struct IDNAME {
+	unsigned id;
+	bool isgroup, used;
+	char name[21];
+} idcache[IDCACHE];
+static int idcache_next;
+
+static const char *idName(unsigned id, bool isgroup)
+{
+	struct IDNAME *c;
+	struct passwd *pwbuf;
+	struct group *grpbuf;
+	const char *name = 0;
+	int j;
+
+	for (j = 0; j < IDCACHE; ++j) {
+		c = idcache + j;
+		if (c->used && c->id == id && c->isgroup == isgroup)
+			return c->name;
+	}
+
+	c = idcache + idcache_next;
+	idcache_next = (idcache_next + 1) % IDCACHE;
+	c->id = id, c->isgroup = isgroup, c->used = true;
+	if (isgroup) {
+		if ((grpbuf = getgrgid(id)))
+			name = grpbuf->gr_name;
+	} else {
+		if ((pwbuf = getpwuid(id)))
+			name = pwbuf->pw_name;
+	}
+	if (name) {
+		strncpy(c->name, name, 20);
+		c->name[20] = 0;
+	} else
+		sprintf(c->name, "%u", id);
+	return c->name;
+}				/* idName */
+#endif
+
 /* expand the ls attributes for a file into a static string. */
 /* This assumes user/group names will not be too long. */
 /* Assumes we just called fileTypeByName. */
@@ -1092,8 +1304,6 @@ char *lsattr(const char *path, const char *flags)
 {
 	static char buf[200 + ABSPATH];
 	char p[40];
-	struct passwd *pwbuf;
-	struct group *grpbuf;
 	char *s;
 	int l, modebits;
 	char newpath[ABSPATH];
@@ -1144,26 +1354,10 @@ p:
 			goto p;
 		case 'p':
 			s = buf + strlen(buf);
-			pwbuf = getpwuid(this_stat.st_uid);
-			if (pwbuf) {
-				l = strlen(pwbuf->pw_name);
-				if (l > 20)
-					l = 20;
-				strncpy(s, pwbuf->pw_name, l);
-				s[l] = 0;
-			} else
-				sprintf(s, "%d", this_stat.st_uid);
+			strcpy(s, idName(this_stat.st_uid, false));
 			s += strlen(s);
 			*s++ = ' ';
-			grpbuf = getgrgid(this_stat.st_gid);
-			if (grpbuf) {
-				l = strlen(grpbuf->gr_name);
-				if (l > 20)
-					l = 20;
-				strncpy(s, grpbuf->gr_name, l);
-				s[l] = 0;
-			} else
-				sprintf(s, "%d", this_stat.st_gid);
+			strcpy(s, idName(this_stat.st_gid, true));
 			s += strlen(s);
 			*s++ = ' ';
 			modebits = this_stat.st_mode;
@@ -1376,6 +1570,11 @@ void shellProtect(char *t, const char *s)
 	}
 }				/* shellProtect */
 
+/* The type of the file just returned by nextScanFile,
+ * if the directory entry tells us, and 0 if it doesn't,
+ * or if it is a link, which has to be followed. */
+static char scan_type;
+
 /* loop through the files in a directory */
 const char *nextScanFile(const char *base)
 {
@@ -1402,6 +1601,29 @@ const char *nextScanFile(const char *base)
 			if (!showHiddenFiles)
 				continue;
 		}
+		scan_type = 0;
+#ifdef DT_UNKNOWN
+		switch (de->d_type) {
+		case DT_REG:
+			scan_type = 'f';
+			break;
+		case DT_DIR:
+			scan_type = 'd';
+			break;
+		case DT_BLK:
+			scan_type = 'b';
+			break;
+		case DT_CHR:
+			scan_type = 'c';
+			break;
+		case DT_FIFO:
+			scan_type = 'p';
+			break;
+		case DT_SOCK:
+			scan_type = 's';
+			break;
+		}
+#endif
 		return s;
 	}			/* end loop over files in directory */
 
@@ -1410,17 +1632,91 @@ const char *nextScanFile(const char *base)
 	return 0;
 }				/* nextScanFile */
 
+/*********************************************************************
+Sort the names in a directory.
+strcoll derives the collation weights of both names, every time,
+and qsort calls it n log n times.
+Instead, transform each name once, with strxfrm,
+and compare the keys with strcmp, which gives the same order.
+If the locale is C or POSIX, collation is byte order,
+and we compare the names themselves.
+*********************************************************************/
+
+static bool byteCollate(void)
+{
+	const char *l = setlocale(LC_COLLATE, NULL);
+	return (!l || stringEqual(l, "C") || stringEqual(l, "POSIX"));
+}				/* byteCollate */
+
+/* compare two file names, in the order of a directory listing */
+int dirNameCompare(const char *s, const char *t)
+{
+	return (byteCollate() ? strcmp(s, t) : strcoll(s, t));
+}				/* dirNameCompare */
+
+struct DIRKEY {
+	const char *key;
+	int idx;
+};
+
 /* compare routine for quicksort directory scan */
 static bool dir_reverse;
 static int dircmp(const void *s, const void *t)
 {
-	int rc = strcoll((const char *)((const struct lineMap *)s)->text,
-			 (const char *)((const struct lineMap *)t)->text);
+	int rc = strcmp(((const struct DIRKEY *)s)->key,
+			((const struct DIRKEY *)t)->key);
 	if (dir_reverse)
 		rc = -rc;
 	return rc;
 }				/* dircmp */
 
+static void dirSort(struct lineMap *map, int n, bool reverse)
+{
+	struct DIRKEY *keys = allocMem(n * sizeof(struct DIRKEY));
+	struct lineMap *tmp;
+	char *arena = 0, *name;
+	size_t room = 0, used = 0, l;
+	int j;
+	bool bytes = byteCollate();
+
+	if (!bytes) {
+		room = 4096;
+		arena = allocMem(room);
+	}
+
+	for (j = 0; j < n; ++j) {
+		name = (char *)map[j].text;
+		keys[j].idx = j;
+		if (bytes) {
+			keys[j].key = name;
+			continue;
+		}
+		l = strxfrm(arena + used, name, room - used);
+		if (l >= room - used) {
+			room = room * 2 + l;
+			arena = reallocMem(arena, room);
+			strxfrm(arena + used, name, room - used);
+		}
+/* an offset for now, the arena could still move */
+		keys[j].key = (const char *)used;
+		used += l + 1;
+	}
+	if (!bytes)
+		for (j = 0; j < n; ++j)
+			keys[j].key = arena + (size_t) keys[j].key;
+
+	dir_reverse = reverse;
+	qsort(keys, n, sizeof(struct DIRKEY), dircmp);
+
+	tmp = allocMem(n * LMSIZE);
+	for (j = 0; j < n; ++j)
+		tmp[j] = map[keys[j].idx];
+	memcpy(map, tmp, n * LMSIZE);
+	free(tmp);
+	free(keys);
+	nzFree(arena);
+}				/* dirSort */
+
 bool sortedDirList(const char *dir, struct lineMap ** map_p, int *count_p,
 		   int othersort, bool reverse)
 {
@@ -1438,9 +1734,13 @@ bool sortedDirList(const char *dir, struct lineMap ** map_p, int *count_p,
 			t = map + linecount;
 		}
 /* leave room for @ / newline */
-		t->text = (pst) allocMem(strlen(f) + 3);
+		t->text = allocLine(strlen(f) + 3);
 		strcpy((char *)t->text, f);
-		t->ds1 = t->ds2 = 0;
+/* ds1 carries the file type, if readdir knows it, through the sort;
+ * the caller has to clear it. */
+		t->ds1 = scan_type;
+		t->ds2 = 0;
+		t->len = 0;
 		++t, ++linecount;
 	}
 
@@ -1452,10 +1752,8 @@ bool sortedDirList(const char *dir, struct lineMap ** map_p, int *count_p,
 
 // Sort the entries alphabetical,
 // unless we plan to sort them some other way.
-	if (!othersort) {
-		dir_reverse = reverse;
-		qsort(map, linecount, LMSIZE, dircmp);
-	}
+	if (!othersort)
+		dirSort(map, linecount, reverse);
 
 	return true;
 }				/* sortedDirList */